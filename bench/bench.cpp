@@ -0,0 +1,246 @@
+/*
+ * Synthetic scans and hardware counters for the benchmark drivers.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Internal
+#include "bench.h"
+#include "Zipper/mesh.h"
+#include "Zipper/near.h"
+#include "Zipper/polyfile.h"
+
+// file descriptor of the cache miss counter, or -1 if there is none
+static int miss_fd = -1;
+static int miss_tried = 0;
+
+/******************************************************************************
+Make a scan of a gently bumpy square grid of points, the way read_ply()
+makes a scan from a file.  The points can be given in a random order, as
+from a file that wasn't written in any spatial order.
+
+Entry:
+  n        - number of points along each side
+  x0,y0,z0 - corner of the grid
+  shuffle  - whether to shuffle the points and triangles
+
+Exit:
+  returns the new scan
+******************************************************************************/
+Scan* make_grid_scan(int n, float x0, float y0, float z0, int shuffle)
+{
+    int i, j, k;
+    int a, b, c, d;
+    int nverts, ntris;
+    int tmp;
+    float spacing;
+    float* coords;
+    int* tri_verts;
+    int* perm;
+    int* tperm;
+    int* new_tri_verts;
+    float* new_coords;
+    Scan* sc;
+    Mesh* mesh;
+    char name[80];
+
+    spacing = get_zipper_resolution();
+    nverts = n * n;
+    ntris = 2 * (n - 1) * (n - 1);
+
+    coords = (float*) malloc(sizeof(float) * 3 * nverts);
+    tri_verts = (int*) malloc(sizeof(int) * 3 * ntris);
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            k = i * n + j;
+            coords[3 * k] = x0 + i * spacing;
+            coords[3 * k + 1] = y0 + j * spacing;
+            coords[3 * k + 2] = z0 + 0.04f * spacing * ((i * 7 + j * 3) % 5);
+        }
+
+    k = 0;
+    for (i = 0; i < n - 1; i++)
+        for (j = 0; j < n - 1; j++) {
+            a = i * n + j;
+            b = a + 1;
+            c = a + n;
+            d = c + 1;
+            tri_verts[k++] = a;
+            tri_verts[k++] = b;
+            tri_verts[k++] = d;
+            tri_verts[k++] = a;
+            tri_verts[k++] = d;
+            tri_verts[k++] = c;
+        }
+
+    /* put the points and triangles in a random order */
+    if (shuffle) {
+        perm = (int*) malloc(sizeof(int) * nverts);
+        for (i = 0; i < nverts; i++)
+            perm[i] = i;
+        for (i = nverts - 1; i > 0; i--) {
+            j = rand() % (i + 1);
+            tmp = perm[i];
+            perm[i] = perm[j];
+            perm[j] = tmp;
+        }
+
+        new_coords = (float*) malloc(sizeof(float) * 3 * nverts);
+        for (i = 0; i < nverts; i++)
+            for (j = 0; j < 3; j++)
+                new_coords[3 * perm[i] + j] = coords[3 * i + j];
+
+        tperm = (int*) malloc(sizeof(int) * ntris);
+        for (i = 0; i < ntris; i++)
+            tperm[i] = i;
+        for (i = ntris - 1; i > 0; i--) {
+            j = rand() % (i + 1);
+            tmp = tperm[i];
+            tperm[i] = tperm[j];
+            tperm[j] = tmp;
+        }
+
+        new_tri_verts = (int*) malloc(sizeof(int) * 3 * ntris);
+        for (i = 0; i < ntris; i++)
+            for (j = 0; j < 3; j++)
+                new_tri_verts[3 * tperm[i] + j] = perm[tri_verts[3 * i + j]];
+
+        free(coords);
+        free(tri_verts);
+        free(perm);
+        free(tperm);
+        coords = new_coords;
+        tri_verts = new_tri_verts;
+    }
+
+    sprintf(name, "grid%d", nscans);
+    sc = new_scan(name, POLYFILE);
+
+    mesh = (Mesh*) calloc(1, sizeof(Mesh));
+    init_mesh_arena(mesh);
+
+    mesh->max_verts = nverts + 100;
+    mesh->verts = (Vertex**) malloc(sizeof(Vertex*) * mesh->max_verts);
+    mesh->max_tris = ntris + 100;
+    mesh->tris = (Triangle**) malloc(sizeof(Triangle*) * mesh->max_tris);
+    mesh->max_edges = 200;
+    mesh->edges = (Edge**) malloc(sizeof(Edge*) * mesh->max_edges);
+    mesh->eat_list_max = 200;
+    mesh->parent_scan = sc;
+
+    order_mesh_arrays(nverts, coords, ntris, tri_verts);
+    build_mesh_from_arrays(mesh, nverts, coords, ntris, tri_verts, 100.0);
+    init_table(mesh, 2.0f * spacing);
+
+    for (i = 0; i < MAX_MESH_LEVELS; i++)
+        sc->meshes[i] = mesh;
+
+    free(coords);
+    free(tri_verts);
+
+    return (sc);
+}
+
+/******************************************************************************
+Free the mesh of a scan made by make_grid_scan().  The scan itself stays in
+the list of scans.
+******************************************************************************/
+void free_grid_scan(Scan* sc)
+{
+    int i;
+    Mesh* mesh = sc->meshes[0];
+
+    clear_mesh(mesh);
+    free(mesh->table);
+    free_mesh_arena(mesh);
+    free(mesh);
+
+    for (i = 0; i < MAX_MESH_LEVELS; i++)
+        sc->meshes[i] = NULL;
+}
+
+/******************************************************************************
+Start counting the cache misses of this process (and the threads it starts
+from now on).  Does nothing where there is no hardware counter to read.
+******************************************************************************/
+void start_cache_misses()
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    if (!miss_tried) {
+        miss_tried = 1;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        miss_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    if (miss_fd >= 0) {
+        ioctl(miss_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/******************************************************************************
+Stop counting cache misses.
+
+Exit:
+  returns the number of misses since start_cache_misses(), or -1 if they
+  can't be counted here
+******************************************************************************/
+long long stop_cache_misses()
+{
+    long long count = -1;
+
+#ifdef __linux__
+    if (miss_fd >= 0) {
+        ioctl(miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(miss_fd, &count, sizeof(count)) != sizeof(count))
+            count = -1;
+    }
+#endif
+
+    return (count);
+}
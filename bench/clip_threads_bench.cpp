@@ -0,0 +1,124 @@
+/*
+ * Measure how clip_triangles() scales with the number of threads, by
+ * clipping the same pair of overlapping scans on 1, 2, 4, 8 and 16
+ * threads and printing the times of its phases (print_clip_times).
+ *
+ * Usage: clip_threads_bench [points per side] [repeats] [max threads]
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdio.h>
+#include <stdlib.h>
+
+// Internal
+#include "bench.h"
+#include "Zipper/zipper.h"
+#include "Zipper/mesh.h"
+#include "Zipper/remove.h"
+#include "Zipper/clip.h"
+#include "Zipper/edges.h"
+#include "Zipper/parallel.h"
+
+/******************************************************************************
+Make two overlapping scans, eat away the overlap, gather them into the first
+one and clip it on a given number of threads.
+
+Entry:
+  n       - number of points along each side of the scans
+  threads - number of threads to clip with
+
+Exit:
+  returns the number of triangles after clipping
+******************************************************************************/
+static int clip_scans(int n, int threads)
+{
+    int ntris;
+    float res = get_zipper_resolution();
+    Scan* sc1, *sc2;
+
+    /* the same scans every time, made and merged on one thread */
+    srand(1);
+    set_thread_count(1);
+    sc1 = make_grid_scan(n, 0, 0, 0, 0);
+    sc2 = make_grid_scan(n, 0.5f * n * res, 0.25f * n * res, 0.02f * res, 0);
+
+    eat_edge_pair(sc1, sc2);
+    gather_triangles(sc1, sc2);
+    find_mesh_edges(sc1->meshes[mesh_level]);
+
+    set_thread_count(threads);
+    clip_triangles(sc1, sc2);
+    ntris = sc1->meshes[mesh_level]->ntris;
+
+    free_grid_scan(sc1);
+    free_grid_scan(sc2);
+
+    return (ntris);
+}
+
+/******************************************************************************
+Main routine.
+******************************************************************************/
+int main(int argc, char* argv[])
+{
+    int i;
+    int n = 400;
+    int repeats = 3;
+    int max_threads = 16;
+    int threads;
+    int ntris = 0;
+
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        repeats = atoi(argv[2]);
+    if (argc > 3)
+        max_threads = atoi(argv[3]);
+
+    set_eat_near_dist_factor(2);
+    set_eat_near_cos(0.5);
+    set_eat_start_iters(2);
+    set_eat_start_factor(2);
+    set_clip_near_dist_factor(2);
+    set_clip_near_cos(0.3);
+    set_clip_boundary_dist_factor(4);
+    set_clip_boundary_cos(0.3);
+
+    printf("two %d x %d grids, %d repeats\n", n, n, repeats);
+
+    /* the clip times are summed over the repeats, and the triangle counts */
+    /* should not change with the number of threads */
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        for (i = 0; i < repeats; i++)
+            ntris = clip_scans(n, threads);
+        printf("%d triangles: ", ntris);
+        print_clip_times();
+    }
+
+    return (0);
+}
@@ -0,0 +1,152 @@
+/*
+ * Measure how sorting meshes along a Morton curve when they are read in
+ * (set_spatial_reorder) and again after they are gathered together
+ * (set_gather_reorder) changes the time and cache misses of whole-mesh
+ * passes over the gathered mesh.
+ *
+ * Usage: reorder_bench [points per side] [repeats] [shuffle 0/1] [threads]
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdio.h>
+#include <stdlib.h>
+
+// Internal
+#include "bench.h"
+#include "Zipper/zipper.h"
+#include "Zipper/mesh.h"
+#include "Zipper/near.h"
+#include "Zipper/remove.h"
+#include "Zipper/parallel.h"
+
+// when the meshes are sorted: not at all, when they are read in, or also
+// after they are gathered together
+#define ORDER_NONE   0
+#define ORDER_LOAD   1
+#define ORDER_GATHER 2
+
+static const char* order_names[] = {"none", "load", "load+gather"};
+
+// one pass over the gathered mesh
+typedef void (*Pass_Func)(Mesh* mesh);
+
+/******************************************************************************
+Find the nearest vertex to each vertex of a mesh, in the order of the mesh's
+list, the way the clipping and zippering passes look up their neighbors.
+******************************************************************************/
+static void search_pass(Mesh* mesh)
+{
+    int i;
+    float dist = 2 * get_zipper_resolution();
+    Vertex* v;
+
+    for (i = 0; i < mesh->nverts; i++) {
+        v = mesh->verts[i];
+        new_find_nearest(mesh, v->old_mesh, v->coord, v->normal, dist, -1);
+    }
+}
+
+/******************************************************************************
+Time one pass over a mesh, run several times.
+******************************************************************************/
+static void time_pass(const char* name, Pass_Func func, Mesh* mesh, int repeats)
+{
+    int i;
+    double start, secs;
+    long long misses;
+
+    start_cache_misses();
+    start = parallel_seconds();
+    for (i = 0; i < repeats; i++)
+        func(mesh);
+    secs = parallel_seconds() - start;
+    misses = stop_cache_misses();
+
+    if (misses >= 0)
+        printf("  %-10s %8.3f s  %12lld cache misses\n", name, secs, misses);
+    else
+        printf("  %-10s %8.3f s  (no cache miss counter)\n", name, secs);
+}
+
+/******************************************************************************
+Main routine.
+******************************************************************************/
+int main(int argc, char* argv[])
+{
+    int n = 700;
+    int repeats = 5;
+    int shuffle = 1;
+    int threads = 1;
+    int order;
+    float res;
+    double start;
+    Scan* sc1, *sc2;
+    Mesh* mesh;
+
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        repeats = atoi(argv[2]);
+    if (argc > 3)
+        shuffle = atoi(argv[3]);
+    if (argc > 4)
+        threads = atoi(argv[4]);
+
+    set_thread_count(threads);
+    res = get_zipper_resolution();
+
+    printf("two %d x %d grids, %s input, %d repeats, %d threads\n", n, n,
+           shuffle ? "shuffled" : "row-order", repeats, threads);
+
+    for (order = ORDER_NONE; order <= ORDER_GATHER; order++) {
+
+        /* same scans every time */
+        srand(1);
+        set_spatial_reorder(order != ORDER_NONE);
+        sc1 = make_grid_scan(n, 0, 0, 0, shuffle);
+        sc2 = make_grid_scan(n, 0.5f * n * res, 0.25f * n * res, 0.1f * res, shuffle);
+
+        set_gather_reorder(order == ORDER_GATHER);
+        start = parallel_seconds();
+        gather_triangles(sc1, sc2);
+        mesh = sc1->meshes[mesh_level];
+
+        printf("sorted at %s: %d vertices, %d triangles, gather %.3f s\n",
+               order_names[order], mesh->nverts, mesh->ntris,
+               parallel_seconds() - start);
+
+        time_pass("search", search_pass, mesh, repeats);
+        time_pass("geometry", refresh_mesh_geometry, mesh, repeats);
+        time_pass("edges", find_mesh_edges, mesh, repeats);
+
+        free_grid_scan(sc1);
+        free_grid_scan(sc2);
+    }
+
+    return (0);
+}
@@ -39,6 +39,7 @@
 #include "Zipper/remove.h"
 #include "Zipper/mesh.h"
 #include "Zipper/ply_wrapper.h"
+#include "Zipper/tritree.h"
 void update_eat_resolution();
 // Globals
 #define SCAN_MAX 200
@@ -97,6 +98,8 @@ static void init_parameters()
     set_conf_angle(0);
     set_conf_exponent(1.0);
 
+    set_spatial_reorder(1);
+
     set_eat_near_dist_factor(2.0);
     set_eat_near_cos(-0.5);
     set_eat_start_iters(2);
@@ -111,6 +114,11 @@ static void init_parameters()
     set_consensus_normal_dist_factor(3.0);
     set_consensus_jitter_dist_factor(0.01);
 
+    set_tri_tree_phase(EAT_PHASE, 0);
+    set_tri_tree_phase(CLIP_PHASE, 0);
+    set_tri_tree_phase(ZIPPER_PHASE, 0);
+    set_tri_tree_phase(CONSENSUS_PHASE, 0);
+
     /*set_range_data_sigma_factor(4.0);
     set_range_data_min_intensity(0.05);
     set_range_data_horizontal_erode(1);*/
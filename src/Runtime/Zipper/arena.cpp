@@ -0,0 +1,699 @@
+/*
+ * Slab allocation of the vertices, triangles and edges of a mesh.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Internal
+#include "arena.h"
+
+// bytes in each slab of records
+#define SLAB_BYTES 65536
+
+// fewest records in a slab
+#define SLAB_MIN 16
+
+// bytes in each block of a scratch arena, and the largest request that is
+// packed into a block instead of getting a block of its own
+#define SCRATCH_BLOCK 65536
+#define SCRATCH_LARGE (SCRATCH_BLOCK / 4)
+
+// scratch memory is handed out on multiples of this many bytes
+#define SCRATCH_ALIGN 16
+
+// pointers in the lists of each size (lists larger than the last size
+// come straight from the heap)
+static int list_sizes[ARENA_LIST_SIZES] = {4, 8, 16, 32, 64, 128, 256};
+
+/******************************************************************************
+Set up a pool to hand out records of a given size.
+
+Entry:
+  pool - the pool
+  size - bytes in each record
+******************************************************************************/
+static void init_pool(Pool* pool, int size)
+{
+    pool->size = size;
+    pool->per_slab = SLAB_BYTES / size;
+    if (pool->per_slab < SLAB_MIN)
+        pool->per_slab = SLAB_MIN;
+    pool->slabs = NULL;
+    pool->nslabs = 0;
+    pool->max_slabs = 0;
+    pool->used = pool->per_slab;
+    pool->free_list = NULL;
+}
+
+/******************************************************************************
+Get a record from a pool, re-using one that was given back if there is one.
+
+Entry:
+  pool - the pool
+
+Exit:
+  returns the (un-initialized) record
+******************************************************************************/
+static void* pool_alloc(Pool* pool)
+{
+    void* rec;
+    char* slab;
+
+    /* re-use a record that was given back */
+    if (pool->free_list != NULL) {
+        rec = pool->free_list;
+        pool->free_list = *(void**) rec;
+        return (rec);
+    }
+
+    /* maybe start a new slab */
+    if (pool->used == pool->per_slab) {
+
+        if (pool->nslabs == pool->max_slabs) {
+            pool->max_slabs = pool->max_slabs * 2 + 8;
+            pool->slabs = (char**)
+                          realloc(pool->slabs, sizeof(char*) * pool->max_slabs);
+        }
+
+        slab = (char*) malloc(pool->size * pool->per_slab);
+        if (pool->slabs == NULL || slab == NULL) {
+            fprintf(stderr, "pool_alloc: can't allocate %d records of %d bytes\n",
+                    pool->per_slab, pool->size);
+            exit(-1);
+        }
+
+        pool->slabs[pool->nslabs++] = slab;
+        pool->used = 0;
+    }
+
+    /* take the next record from the newest slab */
+    rec = pool->slabs[pool->nslabs - 1] + pool->size * pool->used;
+    pool->used++;
+
+    return (rec);
+}
+
+/******************************************************************************
+Give a record back to its pool.
+
+Entry:
+  pool - the pool
+  rec  - record to give back
+******************************************************************************/
+static void pool_free(Pool* pool, void* rec)
+{
+    *(void**) rec = pool->free_list;
+    pool->free_list = rec;
+}
+
+/******************************************************************************
+Free all the slabs of a pool.  Every record from the pool becomes invalid.
+
+Entry:
+  pool - the pool
+******************************************************************************/
+static void clear_pool(Pool* pool)
+{
+    int i;
+
+    for (i = 0; i < pool->nslabs; i++)
+        free(pool->slabs[i]);
+    free(pool->slabs);
+
+    pool->slabs = NULL;
+    pool->nslabs = 0;
+    pool->max_slabs = 0;
+    pool->used = pool->per_slab;
+    pool->free_list = NULL;
+}
+
+/******************************************************************************
+Move all the slabs of one pool to another pool of the same size records.
+
+Entry:
+  dest - pool to take the slabs
+  src  - pool to give them up (left empty)
+******************************************************************************/
+static void absorb_pool(Pool* dest, Pool* src)
+{
+    int i;
+    int num;
+    char* newest;
+    void* rec;
+
+    if (src->nslabs == 0)
+        return;
+
+    num = dest->nslabs + src->nslabs;
+    if (num > dest->max_slabs) {
+        dest->max_slabs = num + 8;
+        dest->slabs = (char**) realloc(dest->slabs, sizeof(char*) * dest->max_slabs);
+        if (dest->slabs == NULL) {
+            fprintf(stderr, "absorb_pool: can't allocate %d slabs\n", dest->max_slabs);
+            exit(-1);
+        }
+    }
+
+    /* keep handing out records from dest's newest slab, if it has one */
+    if (dest->nslabs > 0) {
+        newest = dest->slabs[dest->nslabs - 1];
+        for (i = 0; i < src->nslabs; i++)
+            dest->slabs[dest->nslabs - 1 + i] = src->slabs[i];
+        dest->slabs[num - 1] = newest;
+    } else {
+        for (i = 0; i < src->nslabs; i++)
+            dest->slabs[i] = src->slabs[i];
+        dest->used = src->used;
+    }
+    dest->nslabs = num;
+
+    /* records that src had been given back can be re-used by dest */
+    if (src->free_list != NULL) {
+        for (rec = src->free_list; *(void**) rec != NULL; rec = *(void**) rec)
+            ;
+        *(void**) rec = dest->free_list;
+        dest->free_list = src->free_list;
+    }
+
+    free(src->slabs);
+    src->slabs = NULL;
+    src->nslabs = 0;
+    src->max_slabs = 0;
+    src->used = src->per_slab;
+    src->free_list = NULL;
+}
+
+/******************************************************************************
+Give a mesh an empty arena to allocate its vertices, triangles and edges from.
+Each newly created mesh needs one.
+
+Entry:
+  mesh - the mesh
+******************************************************************************/
+void init_mesh_arena(Mesh* mesh)
+{
+    int i;
+    Mesh_Arena* arena;
+
+    arena = (Mesh_Arena*) malloc(sizeof(Mesh_Arena));
+    init_pool(&arena->verts, sizeof(Vertex));
+    init_pool(&arena->vert_data, sizeof(Vector) * 2);
+    init_pool(&arena->tris, sizeof(Triangle));
+    init_pool(&arena->edges, sizeof(Edge));
+    init_pool(&arena->planes, sizeof(Edge_Planes));
+    for (i = 0; i < ARENA_LIST_SIZES; i++)
+        init_pool(&arena->lists[i], sizeof(void*) * list_sizes[i]);
+
+    mesh->arena = arena;
+    mesh->mark_epoch = 0;
+
+    mesh->coords = NULL;
+    mesh->normals = NULL;
+    mesh->hash_next = NULL;
+    mesh->hash_prev = NULL;
+    mesh->confidence = NULL;
+    mesh->intensity = NULL;
+    mesh->colors = NULL;
+    mesh->max_vert_data = 0;
+}
+
+/******************************************************************************
+Make room in the arrays that hold the positions, normals, hash links and
+other attributes of a mesh's vertices.  The vertices of the mesh are pointed
+at the new arrays.
+
+Entry:
+  mesh - the mesh
+  num  - number of vertices that the arrays must hold
+******************************************************************************/
+void grow_vert_data(Mesh* mesh, int num)
+{
+    int i;
+    int size;
+    Vertex* vert;
+
+    if (num <= mesh->max_vert_data)
+        return;
+
+    size = mesh->max_vert_data + mesh->max_vert_data / 2;
+    if (size < num)
+        size = num;
+    if (size < 100)
+        size = 100;
+
+    mesh->coords = (Vector*) realloc(mesh->coords, sizeof(Vector) * size);
+    mesh->normals = (Vector*) realloc(mesh->normals, sizeof(Vector) * size);
+    mesh->hash_next = (int*) realloc(mesh->hash_next, sizeof(int) * size);
+    mesh->hash_prev = (int*) realloc(mesh->hash_prev, sizeof(int) * size);
+    mesh->confidence = (float*) realloc(mesh->confidence, sizeof(float) * size);
+    mesh->intensity = (float*) realloc(mesh->intensity, sizeof(float) * size);
+    mesh->colors = (Color*) realloc(mesh->colors, sizeof(Color) * size);
+    if (mesh->coords == NULL || mesh->normals == NULL ||
+            mesh->hash_next == NULL || mesh->hash_prev == NULL ||
+            mesh->confidence == NULL || mesh->intensity == NULL ||
+            mesh->colors == NULL) {
+        fprintf(stderr, "grow_vert_data: can't allocate room for %d vertices\n", size);
+        exit(-1);
+    }
+    mesh->max_vert_data = size;
+
+    for (i = 0; i < mesh->nverts; i++) {
+        vert = mesh->verts[i];
+        vert->coord = mesh->coords[i];
+        vert->normal = mesh->normals[i];
+    }
+}
+
+/******************************************************************************
+Free the arrays that hold the positions, normals, hash links and other
+attributes of a mesh's vertices.
+
+Entry:
+  mesh - the mesh
+******************************************************************************/
+void free_vert_data(Mesh* mesh)
+{
+    free(mesh->coords);
+    free(mesh->normals);
+    free(mesh->hash_next);
+    free(mesh->hash_prev);
+    free(mesh->confidence);
+    free(mesh->intensity);
+    free(mesh->colors);
+
+    mesh->coords = NULL;
+    mesh->normals = NULL;
+    mesh->hash_next = NULL;
+    mesh->hash_prev = NULL;
+    mesh->confidence = NULL;
+    mesh->intensity = NULL;
+    mesh->colors = NULL;
+    mesh->max_vert_data = 0;
+}
+
+/******************************************************************************
+Free all the vertices, triangles, edges and vertex lists of a mesh at once,
+along with the arrays of vertex positions and normals.  The arena can still
+be used afterwards.
+
+Entry:
+  mesh - the mesh
+******************************************************************************/
+void clear_mesh_arena(Mesh* mesh)
+{
+    int i;
+    Mesh_Arena* arena = mesh->arena;
+
+    if (arena == NULL)
+        return;
+
+    free_vert_data(mesh);
+
+    clear_pool(&arena->verts);
+    clear_pool(&arena->vert_data);
+    clear_pool(&arena->tris);
+    clear_pool(&arena->edges);
+    clear_pool(&arena->planes);
+    for (i = 0; i < ARENA_LIST_SIZES; i++)
+        clear_pool(&arena->lists[i]);
+}
+
+/******************************************************************************
+Free a mesh's arena and everything allocated from it.
+
+Entry:
+  mesh - the mesh
+******************************************************************************/
+void free_mesh_arena(Mesh* mesh)
+{
+    clear_mesh_arena(mesh);
+    free(mesh->arena);
+    mesh->arena = NULL;
+}
+
+/******************************************************************************
+Hand the storage of one mesh over to another.  This is for when all the
+vertices and triangles of one mesh are moved into another.
+
+Entry:
+  dest - mesh that now holds the vertices and triangles
+  src  - mesh they came from (its arena is left empty)
+******************************************************************************/
+void absorb_mesh_arena(Mesh* dest, Mesh* src)
+{
+    int i;
+
+    if (dest->arena == src->arena)
+        return;
+
+    absorb_pool(&dest->arena->verts, &src->arena->verts);
+    absorb_pool(&dest->arena->vert_data, &src->arena->vert_data);
+    absorb_pool(&dest->arena->tris, &src->arena->tris);
+    absorb_pool(&dest->arena->edges, &src->arena->edges);
+    absorb_pool(&dest->arena->planes, &src->arena->planes);
+    for (i = 0; i < ARENA_LIST_SIZES; i++)
+        absorb_pool(&dest->arena->lists[i], &src->arena->lists[i]);
+}
+
+/******************************************************************************
+Get room for a new vertex of a mesh.
+******************************************************************************/
+Vertex* arena_vertex(Mesh* mesh)
+{
+    return ((Vertex*) pool_alloc(&mesh->arena->verts));
+}
+
+/******************************************************************************
+Get room to keep the position and normal of a vertex that has been deleted
+from a mesh, so that they stay put until the mesh is cleared.  Live vertices
+keep theirs in the mesh's coords and normals arrays instead.
+******************************************************************************/
+float* arena_vertex_data(Mesh* mesh)
+{
+    return ((float*) pool_alloc(&mesh->arena->vert_data));
+}
+
+/******************************************************************************
+Get room for the edge planes of one of a mesh's triangles.
+******************************************************************************/
+Edge_Planes* arena_edge_planes(Mesh* mesh)
+{
+    return ((Edge_Planes*) pool_alloc(&mesh->arena->planes));
+}
+
+/******************************************************************************
+Give back the room of a triangle's edge planes.
+******************************************************************************/
+void arena_free_edge_planes(Mesh* mesh, Edge_Planes* planes)
+{
+    pool_free(&mesh->arena->planes, planes);
+}
+
+/******************************************************************************
+Get room for a new triangle of a mesh.
+******************************************************************************/
+Triangle* arena_triangle(Mesh* mesh)
+{
+    return ((Triangle*) pool_alloc(&mesh->arena->tris));
+}
+
+/******************************************************************************
+Give back the room of a deleted triangle.
+******************************************************************************/
+void arena_free_triangle(Mesh* mesh, Triangle* tri)
+{
+    pool_free(&mesh->arena->tris, tri);
+}
+
+/******************************************************************************
+Get room for a new edge of a mesh.
+******************************************************************************/
+Edge* arena_edge(Mesh* mesh)
+{
+    return ((Edge*) pool_alloc(&mesh->arena->edges));
+}
+
+/******************************************************************************
+Find which size of pointer list to use for a given number of entries.
+
+Entry:
+  num - number of entries
+
+Exit:
+  returns index into list_sizes
+******************************************************************************/
+static int list_size_index(int num)
+{
+    int i;
+
+    for (i = 0; i < ARENA_LIST_SIZES - 1; i++)
+        if (list_sizes[i] >= num)
+            return (i);
+
+    return (ARENA_LIST_SIZES - 1);
+}
+
+/******************************************************************************
+Find how much room a vertex list will have when asked for room for a given
+number of entries.  Lists grow to the next size up, and past the largest
+size they double.
+
+Entry:
+  num - number of entries needed
+
+Exit:
+  returns room in the list
+******************************************************************************/
+int list_room(int num)
+{
+    int room;
+
+    room = list_sizes[list_size_index(num)];
+    while (room < num)
+        room *= 2;
+
+    return (room);
+}
+
+/******************************************************************************
+Move a vertex's list of triangles, vertices or edges to a list of another
+size.
+
+Entry:
+  mesh    - mesh that the vertex belongs to
+  list    - the old list (may be NULL)
+  num     - number of entries in the old list to keep
+  old_max - room in the old list
+  new_max - room wanted in the new list (from list_room)
+
+Exit:
+  returns the new list
+******************************************************************************/
+void** arena_resize_list(Mesh* mesh, void** list, int num, int old_max, int new_max)
+{
+    int i;
+    void** new_list;
+
+    if (new_max > list_sizes[ARENA_LIST_SIZES - 1]) {
+        new_list = (void**) malloc(sizeof(void*) * new_max);
+        if (new_list == NULL) {
+            fprintf(stderr, "arena_resize_list: out of memory\n");
+            exit(-1);
+        }
+    }
+    else
+        new_list = (void**) pool_alloc(&mesh->arena->lists[list_size_index(new_max)]);
+
+    if (list != NULL) {
+        for (i = 0; i < num; i++)
+            new_list[i] = list[i];
+        arena_free_list(mesh, list, old_max);
+    }
+
+    return (new_list);
+}
+
+/******************************************************************************
+Give back a vertex's list of triangles, vertices or edges.
+
+Entry:
+  mesh - mesh that the vertex belongs to
+  list - the list (may be NULL)
+  max  - room in the list
+******************************************************************************/
+void arena_free_list(Mesh* mesh, void** list, int max)
+{
+    if (list == NULL)
+        return;
+
+    if (max > list_sizes[ARENA_LIST_SIZES - 1]) {
+        free(list);
+        return;
+    }
+
+    pool_free(&mesh->arena->lists[list_size_index(max)], list);
+}
+
+/******************************************************************************
+Set up an empty scratch arena.
+
+Entry:
+  arena - the arena
+******************************************************************************/
+void init_scratch_arena(Scratch_Arena* arena)
+{
+    arena->blocks = NULL;
+    arena->block_bytes = NULL;
+    arena->nblocks = 0;
+    arena->max_blocks = 0;
+    arena->used = SCRATCH_BLOCK;
+}
+
+/******************************************************************************
+Add a block of memory to a scratch arena.
+
+Entry:
+  arena - the arena
+  bytes - size of the block
+  fill  - whether later requests are to be taken from this block
+
+Exit:
+  returns the block
+******************************************************************************/
+static char* add_scratch_block(Scratch_Arena* arena, int bytes, int fill)
+{
+    char* block;
+    int last;
+
+    if (arena->nblocks == arena->max_blocks) {
+        arena->max_blocks = arena->max_blocks * 2 + 8;
+        arena->blocks = (char**)
+                        realloc(arena->blocks, sizeof(char*) * arena->max_blocks);
+        arena->block_bytes = (int*)
+                             realloc(arena->block_bytes, sizeof(int) * arena->max_blocks);
+    }
+
+    block = (char*) malloc(bytes);
+    if (arena->blocks == NULL || arena->block_bytes == NULL || block == NULL) {
+        fprintf(stderr, "add_scratch_block: can't allocate %d bytes\n", bytes);
+        exit(-1);
+    }
+
+    /* a block that isn't being filled goes below the one that is */
+    last = arena->nblocks++;
+    if (!fill && last > 0) {
+        arena->blocks[last] = arena->blocks[last - 1];
+        arena->block_bytes[last] = arena->block_bytes[last - 1];
+        last--;
+    }
+    arena->blocks[last] = block;
+    arena->block_bytes[last] = bytes;
+
+    if (fill)
+        arena->used = 0;
+
+    return (block);
+}
+
+/******************************************************************************
+Get memory from a scratch arena.  It can't be given back on its own, only
+all at once with free_scratch_arena().
+
+Entry:
+  arena - the arena
+  bytes - number of bytes wanted
+
+Exit:
+  returns the (un-initialized) memory
+******************************************************************************/
+void* scratch_alloc(Scratch_Arena* arena, int bytes)
+{
+    void* ptr;
+
+    bytes = (MAX(bytes, 1) + SCRATCH_ALIGN - 1) & ~(SCRATCH_ALIGN - 1);
+
+    /* large requests get a block of their own */
+    if (bytes > SCRATCH_LARGE)
+        return (add_scratch_block(arena, bytes, 0));
+
+    if (arena->used + bytes > SCRATCH_BLOCK)
+        add_scratch_block(arena, SCRATCH_BLOCK, 1);
+
+    ptr = arena->blocks[arena->nblocks - 1] + arena->used;
+    arena->used += bytes;
+
+    return (ptr);
+}
+
+/******************************************************************************
+Move something in a scratch arena to a larger piece of memory.
+
+Entry:
+  arena      - the arena
+  old        - memory from the arena (may be NULL)
+  keep_bytes - number of bytes at the start of old to keep
+  new_bytes  - size wanted
+
+Exit:
+  returns the new memory
+******************************************************************************/
+void* scratch_resize(Scratch_Arena* arena, void* old, int keep_bytes, int new_bytes)
+{
+    void* ptr;
+
+    ptr = scratch_alloc(arena, new_bytes);
+    if (old != NULL)
+        memcpy(ptr, old, MIN(keep_bytes, new_bytes));
+
+    return (ptr);
+}
+
+/******************************************************************************
+Tell whether some memory came from a scratch arena.
+
+Entry:
+  arena - the arena
+  ptr   - the memory
+
+Exit:
+  returns 1 if it came from the arena, 0 if not
+******************************************************************************/
+int scratch_owns(Scratch_Arena* arena, void* ptr)
+{
+    int i;
+    char* p = (char*) ptr;
+
+    /* newest blocks first, since recent memory is the most often asked about */
+    for (i = arena->nblocks - 1; i >= 0; i--)
+        if (p >= arena->blocks[i] && p < arena->blocks[i] + arena->block_bytes[i])
+            return (1);
+
+    return (0);
+}
+
+/******************************************************************************
+Give back everything that was handed out from a scratch arena.  The arena
+can still be used afterwards.
+
+Entry:
+  arena - the arena
+******************************************************************************/
+void free_scratch_arena(Scratch_Arena* arena)
+{
+    int i;
+
+    for (i = 0; i < arena->nblocks; i++)
+        free(arena->blocks[i]);
+    free(arena->blocks);
+    free(arena->block_bytes);
+
+    init_scratch_arena(arena);
+}
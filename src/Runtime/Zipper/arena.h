@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ZIPPER_ARENA_H
+#define ZIPPER_ARENA_H
+
+// Internal
+#include "zipper.h"
+
+// Number of different sizes of pointer lists that an arena keeps
+#define ARENA_LIST_SIZES 7
+
+// Records of one size, handed out from large slabs of memory
+typedef struct Pool {
+    int size;             /* bytes in each record */
+    int per_slab;         /* records in each slab */
+    char** slabs;         /* the slabs, newest last */
+    int nslabs;           /* number of slabs */
+    int max_slabs;        /* room in slabs */
+    int used;             /* records handed out from the newest slab */
+    void* free_list;      /* records given back, linked through their first word */
+} Pool;
+
+// Storage for the vertices, triangles and edges of a mesh
+typedef struct Mesh_Arena {
+    Pool verts;           /* Vertex records */
+    Pool vert_data;       /* positions and normals of deleted vertices */
+    Pool tris;            /* Triangle records */
+    Pool edges;           /* Edge records */
+    Pool planes;          /* edge planes of triangles (Edge_Planes) */
+    Pool lists[ARENA_LIST_SIZES]; /* pointer lists, from small to large */
+} Mesh_Arena;
+
+// Memory of any size handed out in order, and all given back at once
+typedef struct Scratch_Arena {
+    char** blocks;        /* the blocks, the one being filled last */
+    int* block_bytes;     /* size of each block */
+    int nblocks;          /* number of blocks */
+    int max_blocks;       /* room in blocks and block_bytes */
+    int used;             /* bytes handed out from the block being filled */
+} Scratch_Arena;
+
+// Declarations
+void init_mesh_arena(Mesh* mesh);
+void clear_mesh_arena(Mesh* mesh);
+void free_mesh_arena(Mesh* mesh);
+void absorb_mesh_arena(Mesh* dest, Mesh* src);
+void grow_vert_data(Mesh* mesh, int num);
+void free_vert_data(Mesh* mesh);
+Vertex* arena_vertex(Mesh* mesh);
+float* arena_vertex_data(Mesh* mesh);
+Triangle* arena_triangle(Mesh* mesh);
+void arena_free_triangle(Mesh* mesh, Triangle* tri);
+Edge* arena_edge(Mesh* mesh);
+Edge_Planes* arena_edge_planes(Mesh* mesh);
+void arena_free_edge_planes(Mesh* mesh, Edge_Planes* planes);
+int list_room(int num);
+void** arena_resize_list(Mesh* mesh, void** list, int num, int old_max, int new_max);
+void arena_free_list(Mesh* mesh, void** list, int max);
+void init_scratch_arena(Scratch_Arena* arena);
+void* scratch_alloc(Scratch_Arena* arena, int bytes);
+void* scratch_resize(Scratch_Arena* arena, void* old, int keep_bytes, int new_bytes);
+int scratch_owns(Scratch_Arena* arena, void* ptr);
+void free_scratch_arena(Scratch_Arena* arena);
+
+#endif
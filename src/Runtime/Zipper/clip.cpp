@@ -38,18 +38,29 @@
 #include "mesh.h"
 #include "draw.h"
 #include "near.h"
+#include "tritree.h"
 #include "triangulate.h"
-
-// Set of points near the edge of a mesh
-static Vertex** pts_near = NULL;
-static int pts_near_num;
-static int pts_near_max;
+#include "parallel.h"
 
 // Set of edges near the edge of a mesh
 static Edge** edges_near = NULL;
 static int edges_near_num;
 static int edges_near_max;
 
+// Cut and clip records made during clip_triangles(), all given back at once
+// when it finishes
+static Scratch_Arena clip_arena;
+static int clip_session = 0;      /* is clip_triangles() running? */
+static Triangle** clip_tris;      /* triangles given clipped edges from clip_arena */
+static int clip_tris_num;
+static int clip_tris_max;
+
+// Wall clock time spent in each phase of clip_triangles()
+static double clip_mark_time = 0;   /* finding which triangles to clip */
+static double clip_cut_time = 0;    /* finding where edges cut them */
+static double clip_redo_time = 0;   /* clipping and re-triangulating */
+static int clip_calls = 0;
+
 // Constants
 #define MESH_A    1
 #define MESH_B    2
@@ -113,43 +124,142 @@ float get_clip_boundary_cos()
 }
 
 /******************************************************************************
-Clip one set of triangles to the edges of another.  Actually, the triangles
-have already been gathered into one mesh by gather_triangles().
+Get memory for a cut or clipping record.  During clip_triangles() this comes
+from the arena of the clipping session, and otherwise from the heap.
 
 Entry:
-  sc1 - first mesh containing edge to clip to
-  sc2 - second mesh, containing triangles to clip
+  bytes - number of bytes wanted
+
+Exit:
+  returns the memory
 ******************************************************************************/
-void clip_triangles(Scan* sc1, Scan* sc2)
+static void* clip_alloc(int bytes)
 {
-    int i, j;
-    Mesh* m1, *m2;
-    Triangle* tri;
-    Vector c1, c2, c3;
-    Vector norm1, norm2, norm3;
-    int r1, r2, r3;
-    NearPosition n1, n2, n3;
-    float max_length;
-    extern float time_it();
-    extern float edge_length_max(int level);
-    int inc;
+    if (clip_session)
+        return (scratch_alloc(&clip_arena, bytes));
+    else
+        return (malloc(bytes));
+}
 
-    m1 = sc1->meshes[mesh_level];
-    m2 = sc2->meshes[mesh_level];
+/******************************************************************************
+Give a cut or clipping record more room.  Records from the heap (such as
+those left on a triangle by an earlier intersection) stay on the heap.
 
-    inc = level_to_inc(mesh_level);
+Entry:
+  old        - the old memory (may be NULL)
+  keep_bytes - number of bytes at the start of old to keep
+  new_bytes  - size wanted
 
-    /* mark all triangles that came from mesh 2 that may need clipping */
+Exit:
+  returns the new memory
+******************************************************************************/
+static void* clip_resize(void* old, int keep_bytes, int new_bytes)
+{
+    if (clip_session && (old == NULL || scratch_owns(&clip_arena, old)))
+        return (scratch_resize(&clip_arena, old, keep_bytes, new_bytes));
+    else
+        return (realloc(old, new_bytes));
+}
 
-    for (i = 0; i < m1->ntris; i++) {
+/******************************************************************************
+Give back a cut or clipping record.  During clip_triangles() this waits
+until the whole clipping session is done.
 
-        tri = m1->tris[i];
+Entry:
+  ptr - the memory
+******************************************************************************/
+static void clip_free(void* ptr)
+{
+    if (!clip_session)
+        free(ptr);
+}
+
+/******************************************************************************
+Start a clipping session, in which cut and clip records come from one arena.
+******************************************************************************/
+static void begin_clip_session()
+{
+    init_scratch_arena(&clip_arena);
+    clip_tris = NULL;
+    clip_tris_num = 0;
+    clip_tris_max = 0;
+    clip_session = 1;
+}
+
+/******************************************************************************
+End a clipping session, giving back all of its cut and clip records at once.
+
+Entry:
+  scan - scan whose mesh was clipped to (owner of the edge mesh)
+******************************************************************************/
+static void end_clip_session(Scan* scan)
+{
+    int i;
+    Mesh* mesh;
+
+    /* forget the clipped edges that triangles were given in this session */
+    for (i = 0; i < clip_tris_num; i++)
+        clip_tris[i]->clips = NULL;
+
+    /* the edge mesh was made in this session, so its triangles' */
+    /* double-precision info is also going away */
+    mesh = scan->edge_mesh;
+    if (mesh)
+        for (i = 0; i < mesh->ntris; i++)
+            mesh->tris[i]->more = NULL;
+
+    free_scratch_arena(&clip_arena);
+    clip_session = 0;
+}
+
+/* what the marking phase of clip_triangles() hands to its threads */
+typedef struct Clip_Mark_Info {
+    Scan* sc1;                /* scan with the gathered mesh */
+    Mesh* m1;                 /* the gathered mesh */
+    Mesh* m2;                 /* mesh that the triangles to clip came from */
+    float max;                /* farthest a match on the other mesh may be */
+    Vector* qpos;             /* vertex positions to match */
+    Vector* qnorm;            /* vertex normals to match */
+    NearPosition* near_list;  /* nearest place on the other mesh to each vertex */
+    int* found_list;          /* whether each vertex found a near place */
+    int* slot;                /* where a vertex's answer is, by vertex index */
+} Clip_Mark_Info;
+
+/******************************************************************************
+Find where a range of the vertices lie on the other mesh, for
+clip_triangles().
+******************************************************************************/
+static void clip_nearest_range(int first, int last, int thread, void* data)
+{
+    Clip_Mark_Info* info = (Clip_Mark_Info*) data;
+
+    nearest_on_mesh_batch(info->sc1, info->m1, info->m2, last - first,
+                          &info->qpos[first], &info->qnorm[first], info->max,
+                          CLIP_NEAR_COS, &info->near_list[first],
+                          &info->found_list[first]);
+}
+
+/******************************************************************************
+Mark a range of the gathered mesh's triangles that may need clipping, for
+clip_triangles().  Only the triangles' own mark and eat_mark are written.
+******************************************************************************/
+static void clip_mark_range(int first, int last, int thread, void* data)
+{
+    int i;
+    Triangle* tri;
+    int r1, r2, r3;
+    NearPosition* n1, *n2, *n3;
+    Clip_Mark_Info* info = (Clip_Mark_Info*) data;
+
+    for (i = first; i < last; i++) {
+
+        tri = info->m1->tris[i];
 
         /* assume at first that this triangle shouldn't be marked for clipping */
         tri->mark = 0;
 
         /* only look at triangles that used to be in the second mesh */
-        if (tri->verts[0]->old_mesh != m2)
+        if (tri->verts[0]->old_mesh != info->m2)
             continue;
 
 #if 1
@@ -169,35 +279,151 @@ void clip_triangles(Scan* sc1, Scan* sc2)
             continue;
 #endif
 
-        /* transform vertices of triangle to world coordinates */
-        mesh_to_world(sc1, tri->verts[0]->coord, c1);
-        mesh_to_world(sc1, tri->verts[1]->coord, c2);
-        mesh_to_world(sc1, tri->verts[2]->coord, c3);
-
-        mesh_to_world_normal(sc1, tri->verts[0]->normal, norm1);
-        mesh_to_world_normal(sc1, tri->verts[1]->normal, norm2);
-        mesh_to_world_normal(sc1, tri->verts[2]->normal, norm3);
-
-        /* find nearest places on the other mesh */
-        r1 = nearest_on_mesh(sc1, m1, m2, c1, norm1,
-                             inc * CLIP_NEAR_DIST, CLIP_NEAR_COS, &n1);
-        r2 = nearest_on_mesh(sc1, m1, m2, c2, norm2,
-                             inc * CLIP_NEAR_DIST, CLIP_NEAR_COS, &n2);
-        r3 = nearest_on_mesh(sc1, m1, m2, c3, norm3,
-                             inc * CLIP_NEAR_DIST, CLIP_NEAR_COS, &n3);
+        /* nearest places on the other mesh */
+        r1 = info->found_list[info->slot[tri->verts[0]->index]];
+        r2 = info->found_list[info->slot[tri->verts[1]->index]];
+        r3 = info->found_list[info->slot[tri->verts[2]->index]];
+        n1 = &info->near_list[info->slot[tri->verts[0]->index]];
+        n2 = &info->near_list[info->slot[tri->verts[1]->index]];
+        n3 = &info->near_list[info->slot[tri->verts[2]->index]];
 
         /* mark for clipping */
         if (r1 || r2 || r3)
             tri->mark = 1;
 
         /* see if these places are all valid and away from the edge of the mesh */
-        r1 = r1 && (n1.on_edge == 0);
-        r2 = r2 && (n2.on_edge == 0);
-        r3 = r3 && (n3.on_edge == 0);
+        r1 = r1 && (n1->on_edge == 0);
+        r2 = r2 && (n2->on_edge == 0);
+        r3 = r3 && (n3->on_edge == 0);
 
         /* save how many vertices are on the other mesh */
         tri->eat_mark = r1 + r2 + r3;
     }
+}
+
+/******************************************************************************
+Print how long each phase of clip_triangles() has taken since the last time
+the times were printed.  Running the same merge with different numbers of
+threads (see set_thread_count) shows how much the threads help.
+******************************************************************************/
+void print_clip_times()
+{
+    if (clip_calls == 0)
+        return;
+
+    printf("clip_triangles, %d calls on %d threads: marking %.3f s, cutting %.3f s, "
+           "clipping %.3f s\n", clip_calls, get_thread_count(), clip_mark_time,
+           clip_cut_time, clip_redo_time);
+
+    clip_mark_time = 0;
+    clip_cut_time = 0;
+    clip_redo_time = 0;
+    clip_calls = 0;
+}
+
+/******************************************************************************
+Clip one set of triangles to the edges of another.  Actually, the triangles
+have already been gathered into one mesh by gather_triangles().
+
+Triangles are marked for clipping in several threads.
+
+Entry:
+  sc1 - first mesh containing edge to clip to
+  sc2 - second mesh, containing triangles to clip
+******************************************************************************/
+void clip_triangles(Scan* sc1, Scan* sc2)
+{
+    int i, j;
+    Mesh* m1, *m2;
+    Triangle* tri;
+    Vertex* vert;
+    float max_length;
+    extern float edge_length_max(int level);
+    int inc;
+    int nquery;
+    Clip_Mark_Info info;
+    Near_List near_verts;
+    double start, cut_start, redo_start;
+
+    m1 = sc1->meshes[mesh_level];
+    m2 = sc2->meshes[mesh_level];
+
+    inc = level_to_inc(mesh_level);
+    start = parallel_seconds();
+
+    /* the vertices don't move while marking, so search a frozen table */
+    freeze_table(m1);
+    start_tri_tree_phase(CLIP_PHASE, m1);
+
+    /* find nearest places on the other mesh for the vertices of all the */
+    /* triangles that may be marked, in one batch ("slot" says where a */
+    /* vertex's answer is); both meshes are in sc1's coordinates by now */
+
+    info.sc1 = sc1;
+    info.m1 = m1;
+    info.m2 = m2;
+    info.max = inc * CLIP_NEAR_DIST;
+    info.slot = (int*) malloc(sizeof(int) * (m1->nverts + 1));
+    info.qpos = (Vector*) malloc(sizeof(Vector) * (m1->nverts + 1));
+    info.qnorm = (Vector*) malloc(sizeof(Vector) * (m1->nverts + 1));
+    if (info.slot == NULL || info.qpos == NULL || info.qnorm == NULL) {
+        fprintf(stderr, "clip_triangles: out of memory\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < m1->nverts; i++)
+        info.slot[i] = -1;
+
+    nquery = 0;
+    for (i = 0; i < m1->ntris; i++) {
+
+        tri = m1->tris[i];
+        if (tri->verts[0]->old_mesh != m2 || tri->dont_touch)
+            continue;
+
+        for (j = 0; j < 3; j++) {
+            vert = tri->verts[j];
+            if (info.slot[vert->index] != -1)
+                continue;
+            info.slot[vert->index] = nquery;
+            vcopy(vert->coord, info.qpos[nquery]);
+            vcopy(vert->normal, info.qnorm[nquery]);
+            nquery++;
+        }
+    }
+
+    info.near_list = (NearPosition*) malloc(sizeof(NearPosition) * (nquery + 1));
+    info.found_list = (int*) malloc(sizeof(int) * (nquery + 1));
+    if (info.near_list == NULL || info.found_list == NULL) {
+        fprintf(stderr, "clip_triangles: out of memory\n");
+        exit(-1);
+    }
+
+    /* the threads may only read the triangles' edge planes */
+    if (m1->tri_tree == NULL)
+        make_edge_planes(m1);
+
+    /* one batch search per thread, so each sorts its queries and sets up */
+    /* its search only once */
+    parallel_for(nquery, 1024, clip_nearest_range, &info);
+
+    /* mark all triangles that came from mesh 2 that may need clipping */
+    parallel_for(m1->ntris, 4096, clip_mark_range, &info);
+
+    free(info.slot);
+    free(info.qpos);
+    free(info.qnorm);
+    free(info.near_list);
+    free(info.found_list);
+
+    free_tri_tree(m1);
+    thaw_table(m1);
+
+    cut_start = parallel_seconds();
+
+    /* cut and clip records are all made from here on, and are given */
+    /* back together at the end */
+    begin_clip_session();
 
     /* initialize the intersection list for edges on the boundary */
     init_cuts(sc1, m1);
@@ -209,14 +435,9 @@ void clip_triangles(Scan* sc1, Scan* sc2)
     return;
     */
 
-    /* mark all vertices as untouched */
-    /* (count will be marker saying that a vertex is in pts_near) */
-
-    for (i = 0; i < m1->nverts; i++)
-        m1->verts[i]->count = 0;
-
     /* examine each marked triangle in turn and clip them */
     max_length = edge_length_max(mesh_level);
+    init_near_list(&near_verts);
 
     for (i = 0; i < m1->ntris; i++) {
 
@@ -227,14 +448,10 @@ void clip_triangles(Scan* sc1, Scan* sc2)
             continue;
 
         /* find nearby vertices that are on the mesh edge */
-        pts_near_num = 0;
+        clear_near_list(&near_verts, m1);
         for (j = 0; j < 3; j++)
-            verts_near_edges(m1, m2, tri->verts[j]->coord, tri->verts[j]->normal,
-                             max_length, CLIP_NEAR_COS);
-
-        /* un-mark all the vertices in pts_near */
-        for (j = 0; j < pts_near_num; j++)
-            pts_near[j]->count = 0;
+            verts_near_edges(&near_verts, m1, m2, tri->verts[j]->coord,
+                             tri->verts[j]->normal, max_length, CLIP_NEAR_COS);
 
 #if 0
         /* (DEBUGGING) */
@@ -242,23 +459,27 @@ void clip_triangles(Scan* sc1, Scan* sc2)
         /* mark for drawing those strange triangles that have no nearby verts */
         /* (DEBUGGING) */
         /* (DEBUGGING) */
-        if (pts_near_num == 0)
+        if (near_verts.num == 0)
             tri->mark++;
 #endif
 
         /* find which edges are near the current triangle */
-        edges_near_edges(tri, m1, m2, sc1);
+        edges_near_edges(tri, m1, m2, sc1, &near_verts);
 
         /* see which edges in edges_near clip the current triangle */
         cut_triangle(tri, m1, m2, sc1);
 
 #if 0
-        /* see which edges in pts_near cut across the current triangle */
-        old_cut_triangle(tri, m1, m2, sc1);
+        /* see which edges in near_verts cut across the current triangle */
+        old_cut_triangle(tri, m1, m2, sc1, &near_verts);
 #endif
 
     }
 
+    free_near_list(&near_verts);
+
+    redo_start = parallel_seconds();
+
     /* create new vertices at all the intersection points */
     create_cut_vertices(m1);
 
@@ -273,16 +494,44 @@ void clip_triangles(Scan* sc1, Scan* sc2)
         m1->verts[i]->old_mesh = m1;
 
     /* clean up info in triangles */
-    for (i = 0; i < m1->ntris; i++)
-        tri = m1->tris[i];
-    if (tri->dont_touch == 0 && tri->clips) {
-        free(tri->clips->cuts);
-        free(tri->clips);
-        tri->clips = NULL;
-    }
+    end_clip_session(sc1);
 
     /* remove un-used vertices */
     remove_unused_verts(m1);
+
+    clip_mark_time += cut_start - start;
+    clip_cut_time += redo_start - cut_start;
+    clip_redo_time += parallel_seconds() - redo_start;
+    clip_calls++;
+}
+
+/******************************************************************************
+Add a vertex to the list of vertices that perform_triangle_clipping() will
+re-examine once the clipped triangles are gone.
+
+Entry:
+  redo     - the list
+  nredo    - number of vertices in the list
+  max_redo - room in the list
+  vert     - vertex to add
+
+Exit:
+  nredo, max_redo - updated
+  returns the (maybe moved) list
+******************************************************************************/
+static Vertex** add_redo_vertex(Vertex** redo, int* nredo, int* max_redo, Vertex* vert)
+{
+    if (*nredo == *max_redo) {
+        *max_redo = *max_redo * 2 + 64;
+        redo = (Vertex**) realloc(redo, sizeof(Vertex*) * *max_redo);
+        if (redo == NULL) {
+            fprintf(stderr, "add_redo_vertex: out of memory\n");
+            exit(-1);
+        }
+    }
+
+    redo[(*nredo)++] = vert;
+    return (redo);
 }
 
 /******************************************************************************
@@ -305,9 +554,19 @@ void perform_triangle_clipping(Scan* sc1, Scan* sc2)
     int result;
     int tri_index;
     Vector tri_norm;
+    Tri_Batch batch;
+    Vertex** redo;
+    int nredo, max_redo;
 
     m1 = sc1->meshes[mesh_level];
 
+    /* the old triangles are deleted all at once at the end, and then the */
+    /* vertices around them are re-examined */
+    init_tri_batch(&batch);
+    nredo = 0;
+    max_redo = 0;
+    redo = NULL;
+
     /* find all triangles that have been clipped */
     for (i = m1->ntris - 1; i >= 0; i--) {
 
@@ -324,13 +583,10 @@ void perform_triangle_clipping(Scan* sc1, Scan* sc2)
                 v1 = tri->verts[0];
                 v2 = tri->verts[1];
                 v3 = tri->verts[2];
-                delete_triangle(tri, m1, 1);
-                vertex_edge_test(v1);
-                vertex_edge_test(v2);
-                vertex_edge_test(v3);
-                find_vertex_normal(v1);
-                find_vertex_normal(v2);
-                find_vertex_normal(v3);
+                add_to_tri_batch(&batch, tri, 1);
+                redo = add_redo_vertex(redo, &nredo, &max_redo, v1);
+                redo = add_redo_vertex(redo, &nredo, &max_redo, v2);
+                redo = add_redo_vertex(redo, &nredo, &max_redo, v3);
             }
             continue;
         }
@@ -361,17 +617,15 @@ void perform_triangle_clipping(Scan* sc1, Scan* sc2)
             tri_norm[Z] = -tri->cc;
 
             /* delete the old triangle */
-            delete_triangle(tri, m1, 0);
+            add_to_tri_batch(&batch, tri, 0);
 
             /* process the list by either dividing it into smaller lists or */
             /* by creating triangles that are bordered by the vertices in the list */
             process_vertices(tri_norm, tri_index, clist, m1);
 
-            /* re-compute vertex info around the old triangle */
-            for (j = 0; j < clist->count; j++) {
-                vertex_edge_test(clist->list[j].vert);
-                find_vertex_normal(clist->list[j].vert);
-            }
+            /* re-compute vertex info around the old triangle (later) */
+            for (j = 0; j < clist->count; j++)
+                redo = add_redo_vertex(redo, &nredo, &max_redo, clist->list[j].vert);
         } else {
 
 #if 0
@@ -386,21 +640,30 @@ void perform_triangle_clipping(Scan* sc1, Scan* sc2)
             /* triangle, so we'll delete it */
 
             /* delete the old triangle */
-            delete_triangle(tri, m1, 0);
+            add_to_tri_batch(&batch, tri, 0);
 
-            /* re-compute vertex info around the old triangle */
-            for (j = 0; j < clist->count; j++) {
-                vertex_edge_test(clist->list[j].vert);
-                find_vertex_normal(clist->list[j].vert);
-            }
+            /* re-compute vertex info around the old triangle (later) */
+            for (j = 0; j < clist->count; j++)
+                redo = add_redo_vertex(redo, &nredo, &max_redo, clist->list[j].vert);
 #endif
 
         }
 
         /* free up space from the list */
-        free(clist->list);
-        free(clist);
+        clip_free(clist->list);
+        clip_free(clist);
     }
+
+    /* delete the old triangles */
+    delete_tri_batch(&batch, m1);
+    free_tri_batch(&batch);
+
+    /* re-compute vertex info around them */
+    for (i = 0; i < nredo; i++) {
+        vertex_edge_test(redo[i]);
+        find_vertex_normal(redo[i]);
+    }
+    free(redo);
 }
 
 
@@ -475,8 +738,8 @@ void process_vertices(Vector tnorm, int tindex, Clip_List* clist, Mesh* mesh)
     process_vertices(tnorm, tindex, clist2, mesh);
 
     /* free up memory */
-    free(clist2->list);
-    free(clist2);
+    clip_free(clist2->list);
+    clip_free(clist2);
 }
 
 /******************************************************************************
@@ -780,17 +1043,17 @@ Clip_List* split_list(Clip_List* clist, int index1, int index2)
     }
 
     /* make a copy of the original list */
-    old_list = (Clip_List*) malloc(sizeof(Clip_List));
-    old_list->list = (Clip_Vertex*) malloc(sizeof(Clip_Vertex) * clist->count);
+    old_list = (Clip_List*) clip_alloc(sizeof(Clip_List));
+    old_list->list = (Clip_Vertex*) clip_alloc(sizeof(Clip_Vertex) * clist->count);
     old_list->count = clist->count;
     for (i = 0; i < old_list->count; i++)
         old_list->list[i] = clist->list[i];
 
     /*** create one of the new lists ***/
 
-    clist2 = (Clip_List*) malloc(sizeof(Clip_List));
+    clist2 = (Clip_List*) clip_alloc(sizeof(Clip_List));
     clist2->count = index2 - index1 + 1 + inter_list->count;
-    clist2->list = (Clip_Vertex*) malloc(sizeof(Clip_Vertex) * clist2->count);
+    clist2->list = (Clip_Vertex*) clip_alloc(sizeof(Clip_Vertex) * clist2->count);
 
     /* copy appropriate subset of old vertices */
     num = 0;
@@ -816,7 +1079,8 @@ Clip_List* split_list(Clip_List* clist, int index1, int index2)
     /* make sure there is enough room for inter_list vertices */
     if (num + inter_list->count > clist->count)
         clist->list = (Clip_Vertex*)
-                      realloc(clist->list, sizeof(Clip_Vertex) * (num + inter_list->count));
+                      clip_resize(clist->list, sizeof(Clip_Vertex) * num,
+                                  sizeof(Clip_Vertex) * (num + inter_list->count));
 
     /* add vertices along loop edge between cuts */
     if (!forward)
@@ -828,10 +1092,10 @@ Clip_List* split_list(Clip_List* clist, int index1, int index2)
     clist->count = num;
 
     /* free up helper lists */
-    free(old_list->list);
-    free(old_list);
-    free(inter_list->list);
-    free(inter_list);
+    clip_free(old_list->list);
+    clip_free(old_list);
+    clip_free(inter_list->list);
+    clip_free(inter_list);
 
     /* return new list */
     return (clist2);
@@ -855,11 +1119,11 @@ Clip_List* make_between_list(Clip_List* clist, Cut* cut1, Cut* cut2)
     int inter_num, inter_max;
 
     /* create list of vertices along loop edge that are between the two cuts */
-    inter_list = (Clip_List*) malloc(sizeof(Clip_List));
+    inter_list = (Clip_List*) clip_alloc(sizeof(Clip_List));
     inter_max = 4;
     inter_num = 0;
     inter_list->list = (Clip_Vertex*)
-                       malloc(sizeof(Clip_Vertex) * inter_max);
+                       clip_alloc(sizeof(Clip_Vertex) * inter_max);
 
     /* return an empty list if there are no vertices between the cuts */
     if (cut1->edge == cut2->edge) {
@@ -889,7 +1153,8 @@ Clip_List* make_between_list(Clip_List* clist, Cut* cut1, Cut* cut2)
         if (inter_num == inter_max) {
             inter_max += 4;
             inter_list->list = (Clip_Vertex*)
-                               realloc(inter_list->list, sizeof(Clip_Vertex) * inter_max);
+                               clip_resize(inter_list->list, sizeof(Clip_Vertex) * inter_num,
+                                           sizeof(Clip_Vertex) * inter_max);
         }
 
         /* add vertex to list */
@@ -928,8 +1193,8 @@ Clip_List* potential_vertices(Triangle* tri)
 
     count = tri->clips[0].cut_num + tri->clips[1].cut_num +
             tri->clips[2].cut_num + 3;
-    clist = (Clip_List*) malloc(sizeof(Clip_List));
-    clist->list = (Clip_Vertex*) malloc(sizeof(Clip_Vertex) * count);
+    clist = (Clip_List*) clip_alloc(sizeof(Clip_List));
+    clist->list = (Clip_Vertex*) clip_alloc(sizeof(Clip_Vertex) * count);
     clist->count = count;
     list = clist->list;
 
@@ -1516,14 +1781,16 @@ void cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
 }
 
 /******************************************************************************
-See which edges of triangles in pts_near cut across a particular triangle.
+See which edges of triangles in a list of nearby vertices cut across a
+particular triangle.
 
 Entry:
   tri   - triangle to cut
   m1,m2 - meshes that are concerned
   scan  - scan that triangles are in
+  near  - vertices near the triangle
 ******************************************************************************/
-void old_cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
+void old_cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan, Near_List* near)
 {
     int i, j;
     Vertex* vert;
@@ -1535,17 +1802,17 @@ void old_cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
 
     /* mark each edge of the vertices as untouched */
 
-    for (i = 0; i < pts_near_num; i++) {
-        vert = pts_near[i];
+    for (i = 0; i < near->num; i++) {
+        vert = near->verts[i];
         for (j = 0; j < vert->nedges; j++)
             vert->edges[j]->used = 0;
     }
 
     /* see which edges cut across the given triangle */
 
-    for (i = 0; i < pts_near_num; i++) {
+    for (i = 0; i < near->num; i++) {
 
-        vert = pts_near[i];
+        vert = near->verts[i];
 
         for (j = 0; j < vert->nedges; j++) {
 
@@ -1581,7 +1848,7 @@ void old_cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
         }
     }
 
-    printf("pts_near_num count: %d %d\n", pts_near_num, count);
+    printf("near->num count: %d %d\n", near->num, count);
 
 }
 
@@ -1687,6 +1954,7 @@ Find the collection of nearby vertices to a given position.  These vertices
 must be on the edge of the mesh.
 
 Entry:
+  near     - list to add the vertices to
   mesh     - the mesh
   not_mesh - mesh to reject matches from (old_mesh field of Vertex)
   pnt      - position (in mesh's coordinate system) to find nearest vertex to
@@ -1695,85 +1963,13 @@ Entry:
   min_dot  - minimum allowed dot product between given normal and match point
 
 Exit:
-  places nearby vertices in "pts_near"
+  adds nearby vertices to "near"
 ******************************************************************************/
-void verts_near_edges(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float radius, float min_dot)
-{
-    int a, b, c;
-    int aa, bb, cc;
-    int index;
-    Hash_Table* table = mesh->table;
-    Vertex* ptr;
-    float dx, dy, dz;
-    float dist;
-    float dot;
-
-    /* allocate room to keep nearby points */
-    if (pts_near == NULL) {
-        pts_near_max = 50;
-        pts_near = (Vertex**) malloc(sizeof(Vertex*) * pts_near_max);
-    }
-
-    /* use squared distance */
-    radius = radius * radius;
-
-    /* determine which cell the position lies within */
-    aa = floor(table->scale * pnt[X]);
-    bb = floor(table->scale * pnt[Y]);
-    cc = floor(table->scale * pnt[Z]);
-
-    /* look at nine cells, centered at cell containing location */
-    for (a = aa - 1; a <= aa + 1; a++)
-        for (b = bb - 1; b <= bb + 1; b++)
-            for (c = cc - 1; c <= cc + 1; c++) {
-
-                /* compute position in hash table */
-                index = (a * PR1 + b * PR2 + c) % table->num_entries;
-                if (index < 0)
-                    index += table->num_entries;
-
-                /* examine all points hashed to this cell */
-                for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
-
-                    /* don't examine point if it's old mesh is not_mesh */
-                    if (ptr->old_mesh == not_mesh)
-                        continue;
-
-                    /* go on if this vertex isn't on the mesh edge */
-                    if (ptr->nedges == 0)
-                        continue;
-
-                    /* go on if this vertex has already been placed on list */
-                    /* (count is a marker that says vertex is in pts_near) */
-                    if (ptr->count)
-                        continue;
-
-                    /* distance (squared) to this point */
-                    dx = ptr->coord[X] - pnt[X];
-                    dy = ptr->coord[Y] - pnt[Y];
-                    dz = ptr->coord[Z] - pnt[Z];
-                    dist = dx * dx + dy * dy + dz * dz;
-
-                    /* maybe we've found new closest point */
-                    if (dist < radius) {
-
-                        /* make sure the surface normals are roughly in the same direction */
-                        dot = vdot(norm, ptr->normal);
-                        if (dot < min_dot)
-                            continue;
-
-                        /* add this vertex to our list */
-                        if (pts_near_num == pts_near_max) {
-                            pts_near_max += 20;
-                            pts_near = (Vertex**)
-                                       realloc(pts_near, sizeof(Vertex*) * pts_near_max);
-                        }
-                        pts_near[pts_near_num] = ptr;
-                        pts_near_num++;
-                        ptr->count = 1;  /* this marks vertex as being in pts_near */
-                    }
-                }
-            }
+void verts_near_edges(
+    Near_List* near, Mesh* mesh, Mesh* not_mesh,
+    Vector pnt, Vector norm, float radius, float min_dot
+) {
+    verts_near(near, mesh, not_mesh, pnt, norm, radius, min_dot, NEAR_ON_EDGE);
 }
 
 /******************************************************************************
@@ -1784,8 +1980,9 @@ Entry:
   tri   - triangle to cut
   m1,m2 - meshes that are concerned
   scan  - scan that triangles are in
+  near  - nearby points that are on the edge
 ******************************************************************************/
-void edges_near_edges(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
+void edges_near_edges(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan, Near_List* near)
 {
     int i, j;
     Vertex* vert;
@@ -1801,8 +1998,8 @@ void edges_near_edges(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
     }
 
     /* mark each edge of the vertices as untouched */
-    for (i = 0; i < pts_near_num; i++) {
-        vert = pts_near[i];
+    for (i = 0; i < near->num; i++) {
+        vert = near->verts[i];
         for (j = 0; j < vert->nedges; j++) {
             edge = vert->edges[j];
             edge->used = 0;
@@ -1812,9 +2009,9 @@ void edges_near_edges(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan)
     }
 
     /* collect together nearby edges */
-    for (i = 0; i < pts_near_num; i++) {
+    for (i = 0; i < near->num; i++) {
 
-        vert = pts_near[i];
+        vert = near->verts[i];
 
         for (j = 0; j < vert->nedges; j++) {
 
@@ -1888,15 +2085,12 @@ void make_clip_triangles(Scan* scan, Mesh* clipto)
     /*** THIS SHOULD ACTUALLY FREE UP MORE STUFF !!! ***/
     if (scan->edge_mesh) {
         mesh = scan->edge_mesh;
-        /* free the triangles */
+        /* free the triangles and vertices */
         for (i = 0; i < mesh->ntris; i++) {
             if (mesh->tris[i]->more)
                 free(mesh->tris[i]->more);
-            free(mesh->tris[i]);
         }
-        /* free the vertices */
-        for (i = 0; i < mesh->nverts; i++)
-            free(mesh->verts[i]);
+        free_mesh_arena(mesh);
         free(mesh->verts);
         free(mesh->tris);
         free(mesh->edges);
@@ -1910,6 +2104,8 @@ void make_clip_triangles(Scan* scan, Mesh* clipto)
 
     scan->edge_mesh = (Mesh*) malloc(sizeof(Mesh));
     mesh = scan->edge_mesh;
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     /* allocate space for new triangles and vertices */
 
@@ -2033,6 +2229,7 @@ single-precision version.
 
 Entry:
   p1,p2 - endpoints of the line segment
+  mesh  - mesh the triangle belongs to
   tri   - triangle to intersect
 
 Exit:
@@ -2042,13 +2239,14 @@ Exit:
   barycentric - barycentric coordinates of intersection (if any)
   returns 1 if they intersect, 0 if not
 ******************************************************************************/
-int line_intersect_tri_single(Vector p1, Vector p2, Triangle* tri, Vector pos, float* tt, int* inward, Vector barycentric)
+int line_intersect_tri_single(Vector p1, Vector p2, Mesh* mesh, Triangle* tri, Vector pos, float* tt, int* inward, Vector barycentric)
 {
     double t;
     double pdir[3];
     double ldir[3];
     double dot1, dot2;
     double r1, r2, r3;
+    Edge_Planes* planes;
 
     /* direction of line */
     ldir[X] = p2[X] - p1[X];
@@ -2081,13 +2279,15 @@ int line_intersect_tri_single(Vector p1, Vector p2, Triangle* tri, Vector pos, f
 
     /* see if the intersection "pos" is on the right side of the triangle edges */
 
-    r1 = tri->a[0] * pos[X] + tri->b[0] * pos[Y] + tri->c[0] * pos[Z] + tri->d[0];
+    planes = tri_edge_planes(mesh, tri);
+
+    r1 = planes->a[0] * pos[X] + planes->b[0] * pos[Y] + planes->c[0] * pos[Z] + planes->d[0];
     if (r1 < 0) return (0);
 
-    r2 = tri->a[1] * pos[X] + tri->b[1] * pos[Y] + tri->c[1] * pos[Z] + tri->d[1];
+    r2 = planes->a[1] * pos[X] + planes->b[1] * pos[Y] + planes->c[1] * pos[Z] + planes->d[1];
     if (r2 < 0) return (0);
 
-    r3 = tri->a[2] * pos[X] + tri->b[2] * pos[Y] + tri->c[2] * pos[Z] + tri->d[2];
+    r3 = planes->a[2] * pos[X] + planes->b[2] * pos[Y] + planes->c[2] * pos[Z] + planes->d[2];
     if (r3 < 0) return (0);
 
     /* if we get here then the intersection point is in the triangle */
@@ -2253,7 +2453,7 @@ int new_cut(Edge* edge, Vertex* v1, Vertex* v2, float t, float s, int inward)
     }
 
     /* add the cut to the list */
-    cut = (Cut*) malloc(sizeof(Cut));
+    cut = (Cut*) clip_alloc(sizeof(Cut));
     cut->v1 = v1;
     cut->v2 = v2;
     cut->edge = edge;
@@ -2296,16 +2496,27 @@ void add_cut_to_triangle(Triangle* tri, Cut* cut)
     /* and if not, create a list of three clipped edges */
 
     if (tri->clips == NULL) {
-        clips = (Clipped_Edge*) malloc(sizeof(Clipped_Edge) * 3);
+        clips = (Clipped_Edge*) clip_alloc(sizeof(Clipped_Edge) * 3);
         tri->clips = clips;
         for (i = 0; i < 3; i++) {
             clips[i].v1 = tri->verts[i];
             clips[i].v2 = tri->verts[(i + 1) % 3];
             clips[i].cut_max = 2;
             clips[i].cut_num = 0;
-            clips[i].cuts = (Cut**) malloc(sizeof(Cut*) * clips[i].cut_max);
+            clips[i].cuts = (Cut**) clip_alloc(sizeof(Cut*) * clips[i].cut_max);
             clips[i].perp_intersect = 0;
         }
+
+        /* remember to forget these clipped edges when the session ends */
+        if (clip_session) {
+            if (clip_tris_num == clip_tris_max) {
+                clip_tris_max = clip_tris_max * 2 + 64;
+                clip_tris = (Triangle**)
+                            scratch_resize(&clip_arena, clip_tris, sizeof(Triangle*) * clip_tris_num,
+                                           sizeof(Triangle*) * clip_tris_max);
+            }
+            clip_tris[clip_tris_num++] = tri;
+        }
     }
 
     /* look for appropriate clipping edge to add the cut to */
@@ -2332,7 +2543,8 @@ void add_cut_to_triangle(Triangle* tri, Cut* cut)
     /* add this cut to the clipped edge's list of cuts */
     if (clip->cut_num == clip->cut_max) { /* check to see if there is room */
         clip->cut_max += 2;
-        clip->cuts = (Cut**) realloc(clip->cuts, sizeof(Cut*) * clip->cut_max);
+        clip->cuts = (Cut**) clip_resize(clip->cuts, sizeof(Cut*) * clip->cut_num,
+                                         sizeof(Cut*) * clip->cut_max);
     }
     clip->cuts[clip->cut_num++] = cut;
 }
@@ -2423,7 +2635,8 @@ void create_cut_vertices(Mesh* mesh)
                 vert = mesh->verts[vert_index];
                 add_to_hash(vert, mesh);
                 edge->cuts[j]->new_vert = vert;
-                vert->confidence = edge->v1->confidence + t * edge->v2->confidence;
+                mesh->confidence[vert_index] = mesh->confidence[edge->v1->index] +
+                                               t * mesh->confidence[edge->v2->index];
 
                 /* signal that this is a new vertex (kluge!) */
                 vert->moving = 1;
@@ -2714,7 +2927,7 @@ void double_stuff(Triangle* tri)
     More_Tri_Stuff* more;
 
     /* create room for new info */
-    more = (More_Tri_Stuff*) malloc(sizeof(More_Tri_Stuff));
+    more = (More_Tri_Stuff*) clip_alloc(sizeof(More_Tri_Stuff));
     tri->more = more;
 
     /* find plane equation of triangle */
@@ -31,6 +31,7 @@
 // Internal
 #include "zipper.h"
 #include "matrix.h"
+#include "near.h"
 
 // Parameters
 void update_clip_resolution();
@@ -45,6 +46,7 @@ float get_clip_boundary_cos();
 
 // Declarations
 void clip_triangles(Scan* sc1, Scan* sc2);
+void print_clip_times();
 void perform_triangle_clipping(Scan* sc1, Scan* sc2);
 void process_vertices(Vector tnorm, int tindex, Clip_List* clist, Mesh* mesh);
 int outside_mesh(Clip_List* clist);
@@ -57,13 +59,16 @@ int find_partner_cuts(Triangle* tri, Clip_List* clist, Mesh* mesh);
 Cut* next_similar_cut(Cut* cut, Clip_List* clist, int dir);
 void sort_triangle_cuts(Triangle* tri);
 void cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan);
-void old_cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan);
+void old_cut_triangle(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan, Near_List* near);
 void point_line_approach(Vector pt, Vector q1, Vector q2, Vector x, float* t);
 int two_line_approach(Vector p1, Vector q1, Vector p2, Vector q2, Vector x1, Vector x2, float* t1, float* t2);
-void verts_near_edges(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float radius, float min_dot);
-void edges_near_edges(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan);
+void verts_near_edges(
+    Near_List* near, Mesh* mesh, Mesh* not_mesh,
+    Vector pnt, Vector norm, float radius, float min_dot
+);
+void edges_near_edges(Triangle* tri, Mesh* m1, Mesh* m2, Scan* scan, Near_List* near);
 void make_clip_triangles(Scan* scan, Mesh* clipto);
-int line_intersect_tri_single(Vector p1, Vector p2, Triangle* tri, Vector pos, float* tt, int* inward, Vector barycentric);
+int line_intersect_tri_single(Vector p1, Vector p2, Mesh* mesh, Triangle* tri, Vector pos, float* tt, int* inward, Vector barycentric);
 int line_intersect_tri(Vector p1, Vector p2, Triangle* tri, Vector pos, float* tt, int* inward, Vector barycentric);
 float point_project_line(Vector v1, Vector v2, Vector v3, Vector p);
 int new_cut(Edge* edge, Vertex* v1, Vertex* v2, float t, float s, int inward);
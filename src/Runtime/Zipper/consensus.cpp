@@ -37,9 +37,11 @@
 // Internal
 #include "consensus.h"
 #include "near.h"
+#include "tritree.h"
 #include "clip.h"
 #include "draw.h"
 #include "mesh.h"
+#include "parallel.h"
 
 // Parameters
 static float CONSENSUS_POSITION_DIST_FACTOR;
@@ -103,7 +105,6 @@ void consensus_surface(Scan* scan, int level, float k_scale)
     int i;
     Mesh* mesh;
     Cinfo* cinfo;
-    Triangle* tri;
     int zeros;
     Vertex* v;
 
@@ -154,35 +155,29 @@ void consensus_surface(Scan* scan, int level, float k_scale)
         cinfo->pos[Z] *= s;
 
         /* move vertex to the average position */
-        remove_from_hash(v, mesh);
         world_to_mesh(scan, cinfo->pos, v->coord);
-        add_to_hash(v, mesh);
     }
 
-    /* re-compute triangle normals and edge planes */
-    for (i = 0; i < mesh->ntris; i++) {
-        tri = mesh->tris[i];
-        plane_thru_vectors(tri->verts[0]->coord, tri->verts[1]->coord, tri->verts[2]->coord,
-                           &tri->aa, &tri->bb, &tri->cc, &tri->dd);
-        compute_edge_planes(tri);
-    }
+    /* put the moved vertices in their new hash cells */
+    rehash_table(mesh);
 
-    /* re-compute vertex normals */
-    find_vertex_normals(mesh);
+    /* re-compute triangle normals, and edge planes of those that have */
+    /* them, then vertex normals */
+    refresh_mesh_geometry(mesh);
 
     /* compute the weighted average of confidences and intensities */
     for (i = 0; i < mesh->nverts; i++) {
         v = mesh->verts[i];
         if (v->cinfo->count == 0 || v->cinfo->weights == 0) {
-            v->confidence = 0.0;
-            v->intensity = 0.0;
-            v->red = v->grn = v->blu = 0;
+            mesh->confidence[i] = 0.0;
+            mesh->intensity[i] = 0.0;
+            mesh->colors[i][0] = mesh->colors[i][1] = mesh->colors[i][2] = 0;
         } else {
-            v->confidence = v->cinfo->weights / (float) v->cinfo->count;
-            v->intensity = v->cinfo->intensity / v->cinfo->weights;
-            v->red = v->cinfo->red / v->cinfo->weights;
-            v->grn = v->cinfo->grn / v->cinfo->weights;
-            v->blu = v->cinfo->blu / v->cinfo->weights;
+            mesh->confidence[i] = v->cinfo->weights / (float) v->cinfo->count;
+            mesh->intensity[i] = v->cinfo->intensity / v->cinfo->weights;
+            mesh->colors[i][0] = v->cinfo->red / v->cinfo->weights;
+            mesh->colors[i][1] = v->cinfo->grn / v->cinfo->weights;
+            mesh->colors[i][2] = v->cinfo->blu / v->cinfo->weights;
         }
     }
 
@@ -203,7 +198,6 @@ void new_consensus_surface(Scan* con_scan, Scan** scan_list, int* read_list, int
     int i;
     Mesh* mesh;
     Cinfo* cinfo;
-    Triangle* tri;
     int zeros;
     Vertex* v;
 
@@ -254,35 +248,29 @@ void new_consensus_surface(Scan* con_scan, Scan** scan_list, int* read_list, int
         cinfo->pos[Z] *= s;
 
         /* move vertex to the average position */
-        remove_from_hash(v, mesh);
         world_to_mesh(con_scan, cinfo->pos, v->coord);
-        add_to_hash(v, mesh);
     }
 
-    /* re-compute triangle normals and edge planes */
-    for (i = 0; i < mesh->ntris; i++) {
-        tri = mesh->tris[i];
-        plane_thru_vectors(tri->verts[0]->coord, tri->verts[1]->coord, tri->verts[2]->coord,
-                           &tri->aa, &tri->bb, &tri->cc, &tri->dd);
-        compute_edge_planes(tri);
-    }
+    /* put the moved vertices in their new hash cells */
+    rehash_table(mesh);
 
-    /* re-compute vertex normals */
-    find_vertex_normals(mesh);
+    /* re-compute triangle normals, and edge planes of those that have */
+    /* them, then vertex normals */
+    refresh_mesh_geometry(mesh);
 
     /* compute the weighted average of confidences and intensities */
     for (i = 0; i < mesh->nverts; i++) {
         v = mesh->verts[i];
         if (v->cinfo->count == 0 || v->cinfo->weights == 0) {
-            v->confidence = 0.0;
-            v->intensity = 0.0;
-            v->red = v->grn = v->blu = 0;
+            mesh->confidence[i] = 0.0;
+            mesh->intensity[i] = 0.0;
+            mesh->colors[i][0] = mesh->colors[i][1] = mesh->colors[i][2] = 0;
         } else {
-            v->confidence = v->cinfo->weights / (float) v->cinfo->count;
-            v->intensity = v->cinfo->intensity / v->cinfo->weights;
-            v->red = v->cinfo->red / v->cinfo->weights;
-            v->grn = v->cinfo->grn / v->cinfo->weights;
-            v->blu = v->cinfo->blu / v->cinfo->weights;
+            mesh->confidence[i] = v->cinfo->weights / (float) v->cinfo->count;
+            mesh->intensity[i] = v->cinfo->intensity / v->cinfo->weights;
+            mesh->colors[i][0] = v->cinfo->red / v->cinfo->weights;
+            mesh->colors[i][1] = v->cinfo->grn / v->cinfo->weights;
+            mesh->colors[i][2] = v->cinfo->blu / v->cinfo->weights;
         }
     }
 
@@ -295,6 +283,577 @@ void new_consensus_surface(Scan* con_scan, Scan** scan_list, int* read_list, int
 }
 
 
+/* what one thread of a consensus search keeps to itself */
+typedef struct Consensus_Scratch {
+    Near_List near;           /* vertices near the current vertex */
+    unsigned int* stamps;     /* vertex that last looked at each triangle, by index */
+    int max_stamps;
+    unsigned int stamp;       /* number of the current vertex */
+} Consensus_Scratch;
+
+/* what the threads searching one scan's mesh for consensus share */
+typedef struct Consensus_Search {
+    Mesh* mesh;               /* mesh whose vertices are being averaged */
+    Scan* vscan;              /* scan containing "mesh" */
+    Mesh* tmesh;              /* mesh of one of the scans */
+    Scan* mscan;              /* scan containing "tmesh" */
+    Scan_Xform xf;            /* takes "mesh" coordinates to "tmesh" coordinates */
+    float dist;               /* how far to search */
+    int mesh_index;           /* mesh index to use in mesh tags */
+    double (*jitter)[3];      /* jitter of each vertex's position */
+    int* slot;                /* where a vertex's nearest-point answer is, or -1 */
+    Vector* qpos;             /* positions that need a nearest point ("tmesh" coords) */
+    Vector* qnorm;            /* normals at those positions */
+    NearPosition* near_list;  /* the nearest points */
+    int* found_list;          /* whether each one was found */
+    Consensus_Scratch* scratch;  /* one for each thread */
+} Consensus_Search;
+
+/******************************************************************************
+Average the nearest point on a scan's mesh into a vertex's consensus info,
+for a vertex whose line segment missed the mesh.
+
+Entry:
+  v          - the vertex
+  tmesh      - the scan's mesh
+  near_info  - the nearest point on the mesh
+  mesh_index - mesh index to use in mesh tags
+******************************************************************************/
+static void add_nearest_position(
+    Vertex* v, Mesh* tmesh, NearPosition* near_info, int mesh_index
+) {
+    Cinfo* cinfo = v->cinfo;
+    Color* colors = tmesh->colors;
+    float bary_sum;
+    float red, grn, blu;
+    int i1, i2, i3;
+
+    if (near_info->on_edge != 0)
+        return;
+
+#if 0
+    vadd(cinfo->pos, near_info->pos, cinfo->pos);
+    v->cinfo->weights += 1;
+#endif
+
+    cinfo->pos[X] += near_info->confidence * near_info->pos[X];
+    cinfo->pos[Y] += near_info->confidence * near_info->pos[Y];
+    cinfo->pos[Z] += near_info->confidence * near_info->pos[Z];
+
+    v->cinfo->weights += near_info->confidence;
+    v->cinfo->count++;
+
+    /* add bit to mesh tags */
+    v->old_mesh = (Mesh*)(((size_t) v->old_mesh) | (1 << mesh_index));
+
+    switch (near_info->type) {
+        case NEAR_VERTEX:
+            i1 = near_info->v1->index;
+            red = colors[i1][0];
+            grn = colors[i1][1];
+            blu = colors[i1][2];
+            break;
+        case NEAR_EDGE:
+            i1 = near_info->v1->index;
+            i2 = near_info->v2->index;
+            red = colors[i1][0] * near_info->b1 +
+                  colors[i2][0] * near_info->b2;
+            grn = colors[i1][1] * near_info->b1 +
+                  colors[i2][1] * near_info->b2;
+            blu = colors[i1][2] * near_info->b1 +
+                  colors[i2][2] * near_info->b2;
+            break;
+        case NEAR_TRIANGLE:
+            i1 = near_info->tri->verts[0]->index;
+            i2 = near_info->tri->verts[1]->index;
+            i3 = near_info->tri->verts[2]->index;
+            bary_sum = near_info->b1 + near_info->b2 + near_info->b3;
+            red = (near_info->b1 * colors[i1][0] +
+                   near_info->b2 * colors[i2][0] +
+                   near_info->b3 * colors[i3][0]) / bary_sum;
+            grn = (near_info->b1 * colors[i1][1] +
+                   near_info->b2 * colors[i2][1] +
+                   near_info->b3 * colors[i3][1]) / bary_sum;
+            blu = (near_info->b1 * colors[i1][2] +
+                   near_info->b2 * colors[i2][2] +
+                   near_info->b3 * colors[i3][2]) / bary_sum;
+            break;
+        default:
+            fprintf(stderr, "add_nearest_position: bad switch = %d\n",
+                    near_info->type);
+            break;
+    }
+    v->cinfo->red += near_info->confidence * red;
+    v->cinfo->grn += near_info->confidence * grn;
+    v->cinfo->blu += near_info->confidence * blu;
+}
+
+/******************************************************************************
+Intersect the line segment at a vertex that is pointing in the surface
+normal's direction with a mesh.
+
+Only the vertex's own consensus info is changed, so that many vertices can
+be done at once in different threads.
+
+Entry:
+  search  - the search of a scan's mesh
+  scratch - the calling thread's scratch space
+  index   - index of the vertex that we construct line segment through
+
+Exit:
+  adds the nearest intersection to the vertice's consensus info, or if
+  there was none, puts the vertex on the search's list of vertices to find
+  the nearest point for
+******************************************************************************/
+static void intersect_segment_with_mesh(
+    Consensus_Search* search, Consensus_Scratch* scratch, int index
+) {
+    int i, j;
+    Vertex* v = search->mesh->verts[index];
+    Mesh* mesh = search->tmesh;
+    Scan* vscan = search->vscan;
+    Scan* mscan = search->mscan;
+    float search_dist = search->dist;
+    int mesh_index = search->mesh_index;
+    Near_List* near = &scratch->near;
+    Vertex* near_vert;
+    Vector pos, norm;
+    Vector wpos;
+    Vector near_pos;
+    Triangle* tri;
+    Cinfo* cinfo;
+    Vector end1, end2;
+    float t, tmin;
+    int result;
+    int found;
+    int count;
+    int in;
+    float nearest_conf;
+    float nearest_intensity;
+    Vector barycentric;
+    float bary_sum;
+    float red, grn, blu;
+    int i1, i2, i3;
+
+    cinfo = v->cinfo;
+
+    /* transform v's position and normal into "mesh" coordinates */
+    mesh_to_world(vscan, v->coord, wpos);
+    world_to_mesh(mscan, wpos, pos);
+    mesh_to_world_normal(vscan, v->normal, norm);
+    world_to_mesh_normal(mscan, norm, norm);
+
+#if 1
+    /* jitter the position of the vertex */
+    wpos[X] += search->jitter[index][X];
+    wpos[Y] += search->jitter[index][Y];
+    wpos[Z] += search->jitter[index][Z];
+#endif
+
+    /* build a line segment in the consensus normal direction */
+    /* (cinfo->pos contains global location of "v", computed above) */
+
+    end1[X] = wpos[X] + cinfo->normal[X];
+    end1[Y] = wpos[Y] + cinfo->normal[Y];
+    end1[Z] = wpos[Z] + cinfo->normal[Z];
+
+    end2[X] = wpos[X] - cinfo->normal[X];
+    end2[Y] = wpos[Y] - cinfo->normal[Y];
+    end2[Z] = wpos[Z] - cinfo->normal[Z];
+
+#if 0
+    if (mscan == scans[0])
+        add_extra_line(end1, end2, 0x00ff00);
+#endif
+
+    /* transform the endpoints into the mesh's local coordinates */
+    world_to_mesh(mscan, end1, end1);
+    world_to_mesh(mscan, end2, end2);
+
+    /* find out which points of "mesh" are near "v" */
+    verts_near_pos(near, mesh, pos, norm, search_dist);
+    count = near->num;
+
+    /* make room to stamp the triangles that have been looked at, and */
+    /* start a new stamp (starting over if the stamps run out) */
+    if (mesh->ntris > scratch->max_stamps) {
+        scratch->stamps = (unsigned int*)
+                          realloc(scratch->stamps, sizeof(unsigned int) * mesh->ntris);
+        if (scratch->stamps == NULL) {
+            fprintf(stderr, "intersect_segment_with_mesh: out of memory\n");
+            exit(-1);
+        }
+        for (i = scratch->max_stamps; i < mesh->ntris; i++)
+            scratch->stamps[i] = 0;
+        scratch->max_stamps = mesh->ntris;
+    }
+    scratch->stamp++;
+    if (scratch->stamp == 0) {
+        for (i = 0; i < scratch->max_stamps; i++)
+            scratch->stamps[i] = 0;
+        scratch->stamp = 1;
+    }
+
+    /* intersect this segment with any nearby triangles, looking */
+    /* for the nearest intersection */
+
+    tmin = 1e20;
+    found = 0;
+
+    for (i = 0; i < count; i++) {
+        near_vert = near->verts[i];
+        for (j = 0; j < near_vert->ntris; j++) {
+            tri = near_vert->tris[j];
+            /* don't look at a triangle again */
+            if (scratch->stamps[tri->index] == scratch->stamp)
+                continue;
+            scratch->stamps[tri->index] = scratch->stamp;
+
+            /* perform intersection test */
+
+#if 0
+            /* single-precision intersection */
+            result = line_intersect_tri_single(end1, end2, mesh, tri, pos, &t, &in,
+                                               barycentric);
+#endif
+
+#if 1
+            /* double-precision intersection (see double_stuff_range) */
+            result = line_intersect_tri(end1, end2, tri, pos, &t, &in, barycentric);
+#endif
+
+            /* if we get an intersection, remember it if it is nearest yet */
+            if (result) {
+                t = fabs(t - 0.5);
+                if (t < tmin) {
+                    t = tmin;
+                    found = 1;
+                    mesh_to_world(mscan, pos, near_pos);
+                    bary_sum = barycentric[X] + barycentric[Y] + barycentric[Z];
+                    i1 = tri->verts[0]->index;
+                    i2 = tri->verts[1]->index;
+                    i3 = tri->verts[2]->index;
+                    nearest_conf = (barycentric[X] * mesh->confidence[i1] +
+                                    barycentric[Y] * mesh->confidence[i2] +
+                                    barycentric[Z] * mesh->confidence[i3]) /
+                                   bary_sum;
+                    nearest_intensity = (barycentric[X] * mesh->intensity[i1] +
+                                         barycentric[Y] * mesh->intensity[i2] +
+                                         barycentric[Z] * mesh->intensity[i3]) /
+                                        bary_sum;
+                    red = (barycentric[X] * mesh->colors[i1][0] +
+                           barycentric[Y] * mesh->colors[i2][0] +
+                           barycentric[Z] * mesh->colors[i3][0]) / bary_sum;
+                    grn = (barycentric[X] * mesh->colors[i1][1] +
+                           barycentric[Y] * mesh->colors[i2][1] +
+                           barycentric[Z] * mesh->colors[i3][1]) / bary_sum;
+                    blu = (barycentric[X] * mesh->colors[i1][2] +
+                           barycentric[Y] * mesh->colors[i2][2] +
+                           barycentric[Z] * mesh->colors[i3][2]) / bary_sum;
+                }
+            }
+
+        }
+    }
+
+    /* if we found a nearby intersection, average it into the vertex position */
+
+    if (found) {
+
+#if 0
+        vadd(cinfo->pos, near_pos, cinfo->pos);
+        cinfo->weights += 1;
+#endif
+
+        cinfo->pos[X] += nearest_conf * near_pos[X];
+        cinfo->pos[Y] += nearest_conf * near_pos[Y];
+        cinfo->pos[Z] += nearest_conf * near_pos[Z];
+        cinfo->intensity += nearest_intensity * nearest_conf;
+        cinfo->red += nearest_conf * red;
+        cinfo->grn += nearest_conf * grn;
+        cinfo->blu += nearest_conf * blu;
+
+        cinfo->weights += nearest_conf;
+        cinfo->count++;
+
+        /* add bit to mesh tags */
+        v->old_mesh = (Mesh*)(((size_t) v->old_mesh) | (1 << mesh_index));
+    } else {
+        /* otherwise, see if we can find a nearest point and use that */
+        /* (see add_nearest_position) */
+        mesh_to_world_normal(vscan, v->normal, norm);
+        world_to_mesh(mscan, wpos, search->qpos[index]);
+        world_to_mesh_normal(mscan, norm, search->qnorm[index]);
+        search->slot[index] = index;
+        return;
+    }
+
+    search->slot[index] = -1;
+}
+
+/******************************************************************************
+Set up the threads' part of a search of one scan's mesh.
+
+Entry:
+  search - the search to set up
+  mesh   - mesh whose vertices are being averaged
+  vscan  - scan containing "mesh"
+  tmesh  - mesh to search
+  mscan  - scan containing "tmesh"
+  dist   - how far to search
+******************************************************************************/
+static void init_consensus_search(
+    Consensus_Search* search, Mesh* mesh, Scan* vscan, Mesh* tmesh, Scan* mscan, float dist
+) {
+    int i;
+    int nthreads = get_thread_count();
+
+    search->mesh = mesh;
+    search->vscan = vscan;
+    search->tmesh = tmesh;
+    search->mscan = mscan;
+    search->dist = dist;
+    search->mesh_index = 0;
+    search->jitter = NULL;
+    search->slot = NULL;
+    search->qpos = NULL;
+    search->qnorm = NULL;
+    search->near_list = NULL;
+    search->found_list = NULL;
+    scan_to_scan_xform(vscan, mscan, &search->xf);
+
+    search->scratch = (Consensus_Scratch*) malloc(sizeof(Consensus_Scratch) * nthreads);
+    if (search->scratch == NULL) {
+        fprintf(stderr, "init_consensus_search: out of memory\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        init_near_list(&search->scratch[i].near);
+        search->scratch[i].stamps = NULL;
+        search->scratch[i].max_stamps = 0;
+        search->scratch[i].stamp = 0;
+    }
+}
+
+/******************************************************************************
+Give back what a search of one scan's mesh used.
+******************************************************************************/
+static void free_consensus_search(Consensus_Search* search)
+{
+    int i;
+
+    for (i = 0; i < get_thread_count(); i++) {
+        free_near_list(&search->scratch[i].near);
+        free(search->scratch[i].stamps);
+    }
+    free(search->scratch);
+
+    free(search->jitter);
+    free(search->slot);
+    free(search->qpos);
+    free(search->qnorm);
+    free(search->near_list);
+    free(search->found_list);
+}
+
+/******************************************************************************
+Add the normals of the vertices of a scan's mesh that are near a range of
+the vertices being averaged to their consensus normals.
+******************************************************************************/
+static void consensus_normal_range(int first, int last, int thread, void* data)
+{
+    int j, k;
+    Consensus_Search* search = (Consensus_Search*) data;
+    Near_List* near_verts = &search->scratch[thread].near;
+    Vector pos, norm;
+    Vector diff;
+    Vertex* v;
+    Vertex* near_vert;
+    int count;
+
+    for (j = first; j < last; j++) {
+
+        v = search->mesh->verts[j];
+
+        /* find vertex position in "tmesh" coordinates */
+        xform_point(&search->xf, v->coord, pos);
+        xform_normal(&search->xf, v->normal, norm);
+
+        /* find nearby vertices */
+        verts_near_pos(near_verts, search->tmesh, pos, norm, search->dist);
+        count = near_verts->num;
+
+        /* compute consensus normal */
+        for (k = 0; k < count; k++) {
+            near_vert = near_verts->verts[k];
+            vsub(pos, near_vert->coord, diff);
+            mesh_to_world(search->mscan, near_vert->normal, norm);
+            vadd(v->cinfo->normal, norm, v->cinfo->normal);
+        }
+
+#if 0
+        if (j % 100 == 0) {
+            printf("vertex %d: count = %d, norm = %f %f %f\n", j, count,
+                   v->cinfo->normal[X], v->cinfo->normal[Y], v->cinfo->normal[Z]);
+        }
+#endif
+
+    }
+}
+
+/******************************************************************************
+Add the normals of one scan's mesh near each vertex of the mesh being
+averaged to the vertices' consensus normals, in several threads.  Each
+vertex's sum is only added to by one thread, so the sums don't depend on
+the number of threads.
+
+Entry:
+  mesh  - mesh whose vertices are being averaged
+  vscan - scan containing "mesh"
+  tmesh - mesh of one of the scans (with a frozen table)
+  mscan - scan containing "tmesh"
+  dist  - how far to search
+******************************************************************************/
+static void add_consensus_normals(Mesh* mesh, Scan* vscan, Mesh* tmesh, Scan* mscan, float dist)
+{
+    Consensus_Search search;
+
+    init_consensus_search(&search, mesh, vscan, tmesh, mscan, dist);
+    parallel_for(mesh->nverts, 256, consensus_normal_range, &search);
+    free_consensus_search(&search);
+}
+
+/******************************************************************************
+Find the double-precision planes of a range of a mesh's triangles, for the
+line intersections of add_consensus_positions().
+******************************************************************************/
+static void double_stuff_range(int first, int last, int thread, void* data)
+{
+    int i;
+    Mesh* mesh = (Mesh*) data;
+
+    for (i = first; i < last; i++)
+        if (mesh->tris[i]->more == NULL)
+            double_stuff(mesh->tris[i]);
+}
+
+/******************************************************************************
+Intersect the line segments through a range of the vertices being averaged
+with a scan's mesh.
+******************************************************************************/
+static void consensus_segment_range(int first, int last, int thread, void* data)
+{
+    int j;
+    Consensus_Search* search = (Consensus_Search*) data;
+
+    for (j = first; j < last; j++)
+        intersect_segment_with_mesh(search, &search->scratch[thread], j);
+}
+
+/******************************************************************************
+Find the nearest points on a scan's mesh for a range of the vertices whose
+line segments missed it.
+******************************************************************************/
+static void consensus_nearest_range(int first, int last, int thread, void* data)
+{
+    Consensus_Search* search = (Consensus_Search*) data;
+
+    nearest_on_mesh_batch(search->mscan, search->tmesh, NULL, last - first,
+                          &search->qpos[first], &search->qnorm[first], search->dist,
+                          0.0, &search->near_list[first], &search->found_list[first]);
+}
+
+/******************************************************************************
+Average the nearest points found for a range of the vertices whose line
+segments missed a scan's mesh into the vertices' consensus info.
+******************************************************************************/
+static void consensus_add_nearest_range(int first, int last, int thread, void* data)
+{
+    int j;
+    Consensus_Search* search = (Consensus_Search*) data;
+
+    for (j = first; j < last; j++)
+        if (search->slot[j] != -1 && search->found_list[search->slot[j]])
+            add_nearest_position(search->mesh->verts[j], search->tmesh,
+                                 &search->near_list[search->slot[j]],
+                                 search->mesh_index);
+}
+
+/******************************************************************************
+Average where one scan's mesh lies along the consensus normal of each
+vertex of the mesh being averaged into the vertices' consensus info, in
+several threads.
+
+The positions are jittered by the same random numbers, drawn in the same
+order, as when the vertices were done one after the other.  Each vertex's
+consensus info is only added to by one thread, and the scans are done in
+turn, so the sums don't depend on the number of threads.
+
+Entry:
+  mesh       - mesh whose vertices are being averaged
+  vscan      - scan containing "mesh"
+  tmesh      - mesh of one of the scans (with a frozen table)
+  mscan      - scan containing "tmesh"
+  dist       - how far to search
+  mesh_index - mesh index to use in mesh tags
+******************************************************************************/
+static void add_consensus_positions(
+    Mesh* mesh, Scan* vscan, Mesh* tmesh, Scan* mscan, float dist, int mesh_index
+) {
+    int j, k;
+    int nquery;
+    Consensus_Search search;
+
+    init_consensus_search(&search, mesh, vscan, tmesh, mscan, dist);
+    search.mesh_index = mesh_index;
+
+    search.jitter = (double (*)[3]) malloc(sizeof(double) * 3 * (mesh->nverts + 1));
+    search.slot = (int*) malloc(sizeof(int) * (mesh->nverts + 1));
+    search.qpos = (Vector*) malloc(sizeof(Vector) * (mesh->nverts + 1));
+    search.qnorm = (Vector*) malloc(sizeof(Vector) * (mesh->nverts + 1));
+    if (search.jitter == NULL || search.slot == NULL || search.qpos == NULL ||
+            search.qnorm == NULL) {
+        fprintf(stderr, "add_consensus_positions: out of memory\n");
+        exit(-1);
+    }
+
+    /* jitter the position of each vertex */
+    for (j = 0; j < mesh->nverts; j++)
+        for (k = 0; k < 3; k++)
+            search.jitter[j][k] = ((double)rand()/RAND_MAX - 0.5) * CONSENSUS_JITTER_DIST;
+
+    /* the threads may only read the triangles' planes */
+    parallel_for(tmesh->ntris, 4096, double_stuff_range, tmesh);
+    if (tmesh->tri_tree == NULL)
+        make_edge_planes(tmesh);
+
+    /* intersect the line segments with "tmesh" */
+    parallel_for(mesh->nverts, 256, consensus_segment_range, &search);
+
+    /* gather the vertices whose segments missed, and look for the */
+    /* nearest points to them instead */
+    nquery = 0;
+    for (j = 0; j < mesh->nverts; j++)
+        if (search.slot[j] != -1) {
+            vcopy(search.qpos[j], search.qpos[nquery]);
+            vcopy(search.qnorm[j], search.qnorm[nquery]);
+            search.slot[j] = nquery++;
+        }
+
+    search.near_list = (NearPosition*) malloc(sizeof(NearPosition) * (nquery + 1));
+    search.found_list = (int*) malloc(sizeof(int) * (nquery + 1));
+    if (search.near_list == NULL || search.found_list == NULL) {
+        fprintf(stderr, "add_consensus_positions: out of memory\n");
+        exit(-1);
+    }
+
+    parallel_for(nquery, 1024, consensus_nearest_range, &search);
+    parallel_for(mesh->nverts, 256, consensus_add_nearest_range, &search);
+
+    free_consensus_search(&search);
+}
+
 /******************************************************************************
 Find the "average" positions over all scans to the vertices in a given mesh.
 This version uses Marc's suggestion of first coming up with an average
@@ -308,16 +867,12 @@ Entry:
 ******************************************************************************/
 void marc_find_average_positions(Scan* scan, int level, float k_scale)
 {
-    int i, j, k;
+    int i, j;
     Mesh* mesh, *tmesh;
-    Vector pos, norm;
     int spacing;
     float search_dist;
     float normal_dist;
     Vertex* v;
-    Vertex* near_vert;
-    int count;
-    Vector diff;
     int mesh_index;
 
     mesh = scan->meshes[mesh_level];
@@ -358,38 +913,11 @@ void marc_find_average_positions(Scan* scan, int level, float k_scale)
 
         printf("mesh has %d vertices and %d triangles\n", tmesh->nverts, tmesh->ntris);
 
-        /* do neighbor search around vertices */
+        /* "tmesh" is only searched from here on */
+        freeze_table(tmesh);
 
-        for (j = 0; j < mesh->nverts; j++) {
-
-            v = mesh->verts[j];
-
-            /* find vertex position in "tmesh" coordinates */
-            mesh_to_world(scan, v->coord, pos);
-            world_to_mesh(scans[i], pos, pos);
-            mesh_to_world_normal(scan, v->normal, norm);
-            world_to_mesh_normal(scans[i], norm, norm);
-
-            /* find nearby vertices */
-            verts_near_pos(tmesh, pos, norm, normal_dist);
-            count = count_near_vert();
-
-            /* compute consensus normal */
-            for (k = 0; k < count; k++) {
-                near_vert = found_vert_near_vert(k);
-                vsub(pos, near_vert->coord, diff);
-                mesh_to_world(scans[i], near_vert->normal, norm);
-                vadd(v->cinfo->normal, norm, v->cinfo->normal);
-            }
-
-#if 0
-            if (j % 100 == 0) {
-                printf("vertex %d: count = %d, norm = %f %f %f\n", j, count,
-                       v->cinfo->normal[X], v->cinfo->normal[Y], v->cinfo->normal[Z]);
-            }
-#endif
-
-        }
+        /* do neighbor search around vertices */
+        add_consensus_normals(mesh, scan, tmesh, scans[i], normal_dist);
 
         /* free the mesh info */
         clear_mesh(tmesh);
@@ -431,17 +959,13 @@ void marc_find_average_positions(Scan* scan, int level, float k_scale)
 
         printf("mesh has %d vertices and %d triangles\n", tmesh->nverts, tmesh->ntris);
 
-        /* do neighbor search around vertices */
-
-        for (j = 0; j < mesh->nverts; j++) {
-
-            v = mesh->verts[j];
+        /* "tmesh" is only searched from here on */
+        freeze_table(tmesh);
+        start_tri_tree_phase(CONSENSUS_PHASE, tmesh);
 
-            /* intersect line segment through "v" with "tmesh", adding */
-            /* the intersection info to the consensus record of "v" */
-            intersect_segment_with_mesh(v, tmesh, scan, scans[i], search_dist,
-                                        mesh_index);
-        }
+        /* intersect line segment through each vertex with "tmesh", */
+        /* adding the intersection info to the vertex's consensus record */
+        add_consensus_positions(mesh, scan, tmesh, scans[i], search_dist, mesh_index);
 
         /* if we get here, we need to increment the mesh index */
         mesh_index++;
@@ -459,16 +983,12 @@ normal.
 ******************************************************************************/
 void new_find_average_positions(Scan* con_scan, Scan** scan_list, int* use_old_mesh, int num_scans, int level)
 {
-    int i, j, k;
+    int i, j;
     Mesh* mesh, *tmesh;
-    Vector pos, norm;
     int spacing;
     float search_dist;
     float normal_dist;
     Vertex* v;
-    Vertex* near_vert;
-    int count;
-    Vector diff;
     int mesh_index;
     float old_size;
 
@@ -522,45 +1042,20 @@ void new_find_average_positions(Scan* con_scan, Scan** scan_list, int* use_old_m
 
         printf("mesh has %d vertices and %d triangles\n", tmesh->nverts, tmesh->ntris);
 
-        /* do neighbor search around vertices */
-
-        for (j = 0; j < mesh->nverts; j++) {
-
-            v = mesh->verts[j];
+        /* "tmesh" is only searched from here on */
+        freeze_table(tmesh);
 
-            /* find vertex position in "tmesh" coordinates */
-            mesh_to_world(con_scan, v->coord, pos);
-            world_to_mesh(scan_list[i], pos, pos);
-            mesh_to_world_normal(con_scan, v->normal, norm);
-            world_to_mesh_normal(scan_list[i], norm, norm);
-
-            /* find nearby vertices */
-            verts_near_pos(tmesh, pos, norm, normal_dist);
-            count = count_near_vert();
-
-            /* compute consensus normal */
-            for (k = 0; k < count; k++) {
-                near_vert = found_vert_near_vert(k);
-                vsub(pos, near_vert->coord, diff);
-                mesh_to_world(scan_list[i], near_vert->normal, norm);
-                vadd(v->cinfo->normal, norm, v->cinfo->normal);
-            }
-
-#if 0
-            if (j % 100 == 0) {
-                printf("vertex %d: count = %d, norm = %f %f %f\n", j, count,
-                       v->cinfo->normal[X], v->cinfo->normal[Y], v->cinfo->normal[Z]);
-            }
-#endif
-
-        }
+        /* do neighbor search around vertices */
+        add_consensus_normals(mesh, con_scan, tmesh, scan_list[i], normal_dist);
 
         /* free the mesh info */
+        free_tri_tree(tmesh);
+        thaw_table(tmesh);
         if (!use_old_mesh[i] && scan_list[i]->file_type != POLYFILE)
             clear_mesh(tmesh);
         else {
-            if (tmesh->table->verts != NULL)
-                free(tmesh->table->verts);
+            if (tmesh->table->cells != NULL)
+                free(tmesh->table->cells);
 
             /* Re-build old hash table */
             init_table(tmesh, old_size);
@@ -616,27 +1111,26 @@ void new_find_average_positions(Scan* con_scan, Scan** scan_list, int* use_old_m
 
         printf("mesh has %d vertices and %d triangles\n", tmesh->nverts, tmesh->ntris);
 
-        /* do neighbor search around vertices */
-
-        for (j = 0; j < mesh->nverts; j++) {
+        /* "tmesh" is only searched from here on */
+        freeze_table(tmesh);
+        start_tri_tree_phase(CONSENSUS_PHASE, tmesh);
 
-            v = mesh->verts[j];
-
-            /* intersect line segment through "v" with "tmesh", adding */
-            /* the intersection info to the consensus record of "v" */
-            intersect_segment_with_mesh(v, tmesh, con_scan, scan_list[i],
-                                        search_dist, mesh_index);
-        }
+        /* intersect line segment through each vertex with "tmesh", */
+        /* adding the intersection info to the vertex's consensus record */
+        add_consensus_positions(mesh, con_scan, tmesh, scan_list[i], search_dist,
+                                mesh_index);
 
         /* if we get here, we need to increment the mesh index */
         mesh_index++;
 
         /* free the mesh info */
+        free_tri_tree(tmesh);
+        thaw_table(tmesh);
         if (!use_old_mesh[i] && scan_list[i]->file_type != POLYFILE)
             clear_mesh(tmesh);
         else {
-            if (tmesh->table->verts != NULL)
-                free(tmesh->table->verts);
+            if (tmesh->table->cells != NULL)
+                free(tmesh->table->cells);
 
             /* Re-build old hash table */
             init_table(tmesh, old_size);
@@ -645,237 +1139,6 @@ void new_find_average_positions(Scan* con_scan, Scan** scan_list, int* use_old_m
 }
 
 
-/******************************************************************************
-Intersect the line segment at a vertex that is pointing in the surface
-normal's direction with a mesh.
-
-Entry:
-  v           - vertex that we construct line segment through
-  mesh        - mesh to intersect this line segment with
-  vscan       - scan containing "v"
-  mscan       - scan containing "mesh"
-  search_dist - distance to extend the line segment
-  mesh_index  - mesh index to use in mesh tags
-
-Exit:
-  adds the nearest intersection to the vertice's consensus info
-******************************************************************************/
-void intersect_segment_with_mesh(Vertex* v, Mesh* mesh, Scan* vscan, Scan* mscan, float search_dist, int mesh_index)
-{
-    int i, j;
-    Vertex* near_vert;
-    Vector pos, norm;
-    Vector wpos;
-    Vector near_pos;
-    Triangle* tri;
-    Cinfo* cinfo;
-    Vector end1, end2;
-    float t, tmin;
-    int result;
-    int found;
-    int count;
-    int in;
-    NearPosition near_info;
-    float nearest_conf;
-    float nearest_intensity;
-    Vector barycentric;
-    float bary_sum;
-    float red, grn, blu;
-    Vertex* v1, *v2, *v3;
-
-    cinfo = v->cinfo;
-
-    /* transform v's position and normal into "mesh" coordinates */
-    mesh_to_world(vscan, v->coord, wpos);
-    world_to_mesh(mscan, wpos, pos);
-    mesh_to_world_normal(vscan, v->normal, norm);
-    world_to_mesh_normal(mscan, norm, norm);
-
-#if 1
-    /* jitter the position of the vertex */
-    wpos[X] += ((double)rand()/RAND_MAX - 0.5) * CONSENSUS_JITTER_DIST;
-    wpos[Y] += ((double)rand()/RAND_MAX - 0.5) * CONSENSUS_JITTER_DIST;
-    wpos[Z] += ((double)rand()/RAND_MAX - 0.5) * CONSENSUS_JITTER_DIST;
-#endif
-
-    /* build a line segment in the consensus normal direction */
-    /* (cinfo->pos contains global location of "v", computed above) */
-
-    end1[X] = wpos[X] + cinfo->normal[X];
-    end1[Y] = wpos[Y] + cinfo->normal[Y];
-    end1[Z] = wpos[Z] + cinfo->normal[Z];
-
-    end2[X] = wpos[X] - cinfo->normal[X];
-    end2[Y] = wpos[Y] - cinfo->normal[Y];
-    end2[Z] = wpos[Z] - cinfo->normal[Z];
-
-#if 0
-    if (mscan == scans[0])
-        add_extra_line(end1, end2, 0x00ff00);
-#endif
-
-    /* transform the endpoints into the mesh's local coordinates */
-    world_to_mesh(mscan, end1, end1);
-    world_to_mesh(mscan, end2, end2);
-
-    /* find out which points of "mesh" are near "v" */
-    verts_near_pos(mesh, pos, norm, search_dist);
-    count = count_near_vert();
-
-    /* mark all nearby triangles as not looked at (mark = 0) */
-    for (i = 0; i < count; i++) {
-        near_vert = found_vert_near_vert(i);
-        for (j = 0; j < near_vert->ntris; j++)
-            near_vert->tris[j]->mark = 0;
-    }
-
-    /* intersect this segment with any nearby triangles, looking */
-    /* for the nearest intersection */
-
-    tmin = 1e20;
-    found = 0;
-
-    for (i = 0; i < count; i++) {
-        near_vert = found_vert_near_vert(i);
-        for (j = 0; j < near_vert->ntris; j++) {
-            tri = near_vert->tris[j];
-            /* don't look at a triangle again */
-            if (tri->mark)
-                continue;
-            tri->mark = 1;
-
-            /* perform intersection test */
-
-#if 0
-            /* single-precision intersection */
-            result = line_intersect_tri_single(end1, end2, tri, pos, &t, &in,
-                                               barycentric);
-#endif
-
-#if 1
-            /* double-precision intersection */
-            if (tri->more == NULL)
-                double_stuff(tri);
-            result = line_intersect_tri(end1, end2, tri, pos, &t, &in, barycentric);
-#endif
-
-            /* if we get an intersection, remember it if it is nearest yet */
-            if (result) {
-                t = fabs(t - 0.5);
-                if (t < tmin) {
-                    t = tmin;
-                    found = 1;
-                    mesh_to_world(mscan, pos, near_pos);
-                    bary_sum = barycentric[X] + barycentric[Y] + barycentric[Z];
-                    nearest_conf = (barycentric[X] * tri->verts[0]->confidence +
-                                    barycentric[Y] * tri->verts[1]->confidence +
-                                    barycentric[Z] * tri->verts[2]->confidence) /
-                                   bary_sum;
-                    nearest_intensity = (barycentric[X] * tri->verts[0]->intensity +
-                                         barycentric[Y] * tri->verts[1]->intensity +
-                                         barycentric[Z] * tri->verts[2]->intensity) /
-                                        bary_sum;
-                    red = (barycentric[X] * tri->verts[0]->red +
-                           barycentric[Y] * tri->verts[1]->red +
-                           barycentric[Z] * tri->verts[2]->red) / bary_sum;
-                    grn = (barycentric[X] * tri->verts[0]->grn +
-                           barycentric[Y] * tri->verts[1]->grn +
-                           barycentric[Z] * tri->verts[2]->grn) / bary_sum;
-                    blu = (barycentric[X] * tri->verts[0]->blu +
-                           barycentric[Y] * tri->verts[1]->blu +
-                           barycentric[Z] * tri->verts[2]->blu) / bary_sum;
-                }
-            }
-
-        }
-    }
-
-    /* if we found a nearby intersection, average it into the vertex position */
-
-    if (found) {
-
-#if 0
-        vadd(cinfo->pos, near_pos, cinfo->pos);
-        cinfo->weights += 1;
-#endif
-
-        cinfo->pos[X] += nearest_conf * near_pos[X];
-        cinfo->pos[Y] += nearest_conf * near_pos[Y];
-        cinfo->pos[Z] += nearest_conf * near_pos[Z];
-        cinfo->intensity += nearest_intensity * nearest_conf;
-        cinfo->red += nearest_conf * red;
-        cinfo->grn += nearest_conf * grn;
-        cinfo->blu += nearest_conf * blu;
-
-        cinfo->weights += nearest_conf;
-        cinfo->count++;
-
-        /* add bit to mesh tags */
-        v->old_mesh = (Mesh*)(((size_t) v->old_mesh) | (1 << mesh_index));
-    } else {
-        /* otherwise, see if we can find a nearest point and use that */
-        mesh_to_world_normal(vscan, v->normal, norm);
-        result = nearest_on_mesh(mscan, mesh, NULL, wpos, norm,
-                                 search_dist, 0.0, &near_info);
-        if (result && near_info.on_edge == 0) {
-
-#if 0
-            vadd(cinfo->pos, near_info.pos, cinfo->pos);
-            v->cinfo->weights += 1;
-#endif
-
-            cinfo->pos[X] += near_info.confidence * near_info.pos[X];
-            cinfo->pos[Y] += near_info.confidence * near_info.pos[Y];
-            cinfo->pos[Z] += near_info.confidence * near_info.pos[Z];
-
-            v->cinfo->weights += near_info.confidence;
-            v->cinfo->count++;
-
-            /* add bit to mesh tags */
-            v->old_mesh = (Mesh*)(((size_t) v->old_mesh) | (1 << mesh_index));
-
-            switch (near_info.type) {
-                case NEAR_VERTEX:
-                    red = near_info.v1->red;
-                    grn = near_info.v1->grn;
-                    blu = near_info.v1->blu;
-                    break;
-                case NEAR_EDGE:
-                    red = near_info.v1->red * near_info.b1 +
-                          near_info.v2->red * near_info.b2;
-                    grn = near_info.v1->grn * near_info.b1 +
-                          near_info.v2->grn * near_info.b2;
-                    blu = near_info.v1->blu * near_info.b1 +
-                          near_info.v2->blu * near_info.b2;
-                    break;
-                case NEAR_TRIANGLE:
-                    v1 = near_info.tri->verts[0];
-                    v2 = near_info.tri->verts[1];
-                    v3 = near_info.tri->verts[2];
-                    bary_sum = near_info.b1 + near_info.b2 + near_info.b3;
-                    red = (near_info.b1 * v1->red +
-                           near_info.b2 * v2->red +
-                           near_info.b3 * v3->red) / bary_sum;
-                    grn = (near_info.b1 * v1->grn +
-                           near_info.b2 * v2->grn +
-                           near_info.b3 * v3->grn) / bary_sum;
-                    blu = (near_info.b1 * v1->blu +
-                           near_info.b2 * v2->blu +
-                           near_info.b3 * v3->blu) / bary_sum;
-                    break;
-                default:
-                    fprintf(stderr, "intersect_segment_with_mesh: bad switch = %d\n",
-                            near_info.type);
-                    break;
-            }
-            v->cinfo->red += near_info.confidence * red;
-            v->cinfo->grn += near_info.confidence * grn;
-            v->cinfo->blu += near_info.confidence * blu;
-        }
-    }
-}
-
-
 /******************************************************************************
 Find the "average" positions over all scans to the vertices in a given mesh.
 
@@ -931,6 +1194,10 @@ void find_average_positions(Scan* scan, int level, float k_scale)
 
         printf("mesh has %d vertices and %d triangles\n", tmesh->nverts, tmesh->ntris);
 
+        /* "tmesh" is only searched from here on */
+        freeze_table(tmesh);
+        start_tri_tree_phase(CONSENSUS_PHASE, tmesh);
+
         /* do neighbor search around vertices */
 
         for (j = 0; j < mesh->nverts; j++) {
@@ -972,7 +1239,8 @@ print_sizes()
     float mverts, mtris;
     Mesh* mesh;
 
-    vsize = sizeof(Vertex);
+    /* the record, plus its place in the position, normal and hash arrays */
+    vsize = sizeof(Vertex) + 2 * sizeof(Vector) + 2 * sizeof(int);
     tsize = sizeof(Triangle);
 
     printf("%d bytes per vertex\n", vsize);
@@ -994,112 +1262,23 @@ print_sizes()
 }
 #endif
 
-/*** set of nearby points to a given position ***/
-static Vertex** pts_near = NULL;
-static int pts_near_num;
-static int pts_near_max;
-
-/******************************************************************************
-Return how many vertices are in pts_near.
-******************************************************************************/
-int count_near_vert()
-{
-    return (pts_near_num);
-}
-
-
-/******************************************************************************
-Return nth vertex in pts_near.
-******************************************************************************/
-Vertex* found_vert_near_vert(int n)
-{
-    return (pts_near[n]);
-}
-
-
 /******************************************************************************
 Find the collection of nearby vertices to a given position.
 
 Entry:
-  mesh     - the mesh containing the (possibly) nearby vertices
-  pnt      - position (in mesh's coordinate system) to find nearest vertex to
-  norm     - surface normal at pnt
-  radius   - distance within which to check
+  near   - list to place the vertices in
+  mesh   - the mesh containing the (possibly) nearby vertices
+  pnt    - position (in mesh's coordinate system) to find nearest vertex to
+  norm   - surface normal at pnt
+  radius - distance within which to check
 
 Exit:
-  places nearby vertices in "pts_near"
+  places nearby vertices in "near"
 ******************************************************************************/
-
-void verts_near_pos(Mesh* mesh, Vector pnt, Vector norm, float radius)
+void verts_near_pos(Near_List* near, Mesh* mesh, Vector pnt, Vector norm, float radius)
 {
-    int a, b, c;
-    int aa, bb, cc;
-    int index;
-    Hash_Table* table = mesh->table;
-    Vertex* ptr;
-    float dx, dy, dz;
-    float dist;
-
-    /* allocate room to keep nearby points */
-    if (pts_near == NULL) {
-        pts_near_max = 50;
-        pts_near = (Vertex**) malloc(sizeof(Vertex*) * pts_near_max);
-    }
-    pts_near_num = 0;
-
-    /* use squared distance */
-    radius = radius * radius;
-
-    /* determine which cell the position lies within */
-    aa = floor(table->scale * pnt[X]);
-    bb = floor(table->scale * pnt[Y]);
-    cc = floor(table->scale * pnt[Z]);
-
-    /* look at nine cells, centered at cell containing location */
-
-    for (a = aa - 1; a <= aa + 1; a++)
-        for (b = bb - 1; b <= bb + 1; b++)
-            for (c = cc - 1; c <= cc + 1; c++) {
-
-                /* compute position in hash table */
-                index = (a * PR1 + b * PR2 + c) % table->num_entries;
-                if (index < 0)
-                    index += table->num_entries;
-
-                /* examine all points hashed to this cell */
-                for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
-
-                    /* don't look at a vertex if it is used in no triangles */
-                    if (ptr->ntris == 0)
-                        continue;
-
-                    /* distance (squared) to this point */
-                    dx = ptr->coord[X] - pnt[X];
-                    dy = ptr->coord[Y] - pnt[Y];
-                    dz = ptr->coord[Z] - pnt[Z];
-                    dist = dx * dx + dy * dy + dz * dz;
-
-                    /* maybe we've found new closest point */
-                    if (dist < radius) {
-
-#if 0
-                        /* make sure the surface normals are roughly in the same direction */
-                        dot = vdot(norm, ptr->normal);
-                        if (dot < 0.3)
-                            continue;
-#endif
-
-                        /* add this vertex to our list */
-                        if (pts_near_num == pts_near_max) {
-                            pts_near_max += 20;
-                            pts_near = (Vertex**)
-                                       realloc(pts_near, sizeof(Vertex*) * pts_near_max);
-                        }
-                        pts_near[pts_near_num] = ptr;
-                        pts_near_num++;
-                        ptr->count = 1;  /* this marks vertex as being in pts_near */
-                    }
-                }
-            }
+    /* (the surface normals aren't compared) */
+    clear_near_list(near, mesh);
+    verts_near(near, mesh, NULL, pnt, NULL, radius, 0, NEAR_IN_TRIS | NEAR_ANY_MESH);
 }
 
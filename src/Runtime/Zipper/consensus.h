@@ -31,6 +31,7 @@
 // Internal
 #include "zipper.h"
 #include "matrix.h"
+#include "near.h"
 
 // Vertex to help find consensus
 typedef struct Cvert {
@@ -68,10 +69,7 @@ void consensus_surface(Scan* scan, int level, float k_scale);
 void new_consensus_surface(Scan* con_scan, Scan** scan_list, int* read_list, int num_scans, int level);
 void marc_find_average_positions(Scan* scan, int level, float k_scale);
 void new_find_average_positions(Scan* con_scan, Scan** scan_list, int* use_old_mesh, int num_scans, int level);
-void intersect_segment_with_mesh(Vertex* v, Mesh* mesh, Scan* vscan, Scan* mscan, float search_dist, int mesh_index);
 void find_average_positions(Scan* scan, int level, float k_scale);
-int count_near_vert();
-Vertex* found_vert_near_vert(int n);
-void verts_near_pos(Mesh* mesh, Vector pnt, Vector norm, float radius);
+void verts_near_pos(Near_List* near, Mesh* mesh, Vector pnt, Vector norm, float radius);
 
 #endif
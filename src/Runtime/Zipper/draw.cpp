@@ -177,3 +177,132 @@ void mesh_to_world_normal(Scan* sc, Vector in_norm, Vector out_norm)
     out_norm[Y] = v[Y];
     out_norm[Z] = v[Z];
 }
+
+/******************************************************************************
+Find the transformation that takes points from one scan's mesh space to
+another's.  This is the same as mesh_to_world followed by world_to_mesh,
+but only takes one matrix multiply per point.  Scans may be moved between
+operations, so make a new one at the start of each operation.
+
+Entry:
+  from - scan whose mesh space points start in
+  to   - scan whose mesh space they are taken to
+
+Exit:
+  xf - the transformation
+******************************************************************************/
+void scan_to_scan_xform(Scan* from, Scan* to, Scan_Xform* xf)
+{
+    int i, j, k;
+    Vector t;
+
+    /* rotation: world_to_mesh (to) times mesh_to_world (from) */
+    for (i = 0; i < 3; i++)
+        for (k = 0; k < 3; k++) {
+            xf->rot[i][k] = 0;
+            for (j = 0; j < 3; j++)
+                xf->rot[i][k] += to->rotmat[i][j] * from->rotmat[k][j];
+        }
+
+    /* translation: difference of the scan positions, in "to" mesh space */
+    t[X] = from->xtrans - to->xtrans;
+    t[Y] = from->ytrans - to->ytrans;
+    t[Z] = from->ztrans - to->ztrans;
+
+    for (i = 0; i < 3; i++)
+        xf->trans[i] = t[X] * to->rotmat[i][X] + t[Y] * to->rotmat[i][Y] +
+                       t[Z] * to->rotmat[i][Z];
+}
+
+/******************************************************************************
+Transform a point from one scan's mesh space to another's.
+
+Entry:
+  xf    - transformation from scan_to_scan_xform
+  invec - point to transform
+
+Exit:
+  outvec - transformed point (may be the same as invec)
+******************************************************************************/
+void xform_point(Scan_Xform* xf, Vector invec, Vector outvec)
+{
+    int i;
+    Vector v;
+
+    for (i = 0; i < 3; i++)
+        v[i] = xf->rot[i][X] * invec[X] + xf->rot[i][Y] * invec[Y] +
+               xf->rot[i][Z] * invec[Z] + xf->trans[i];
+
+    outvec[X] = v[X];
+    outvec[Y] = v[Y];
+    outvec[Z] = v[Z];
+}
+
+/******************************************************************************
+Transform a surface normal from one scan's mesh space to another's.
+
+Entry:
+  xf      - transformation from scan_to_scan_xform
+  in_norm - normal to transform
+
+Exit:
+  out_norm - transformed normal (may be the same as in_norm)
+******************************************************************************/
+void xform_normal(Scan_Xform* xf, Vector in_norm, Vector out_norm)
+{
+    int i;
+    Vector v;
+
+    for (i = 0; i < 3; i++)
+        v[i] = xf->rot[i][X] * in_norm[X] + xf->rot[i][Y] * in_norm[Y] +
+               xf->rot[i][Z] * in_norm[Z];
+
+    out_norm[X] = v[X];
+    out_norm[Y] = v[Y];
+    out_norm[Z] = v[Z];
+}
+
+/******************************************************************************
+Transform a list of points and their normals, in place, from one scan's mesh
+space to another's.  The matrix is held in locals for the whole list so that
+the compiler can keep it in registers and vectorize the loop.
+
+Entry:
+  xf   - transformation from scan_to_scan_xform
+  num  - number of points
+  pos  - the points
+  norm - normals at the points (may be NULL)
+
+Exit:
+  pos, norm - transformed
+******************************************************************************/
+void xform_points(Scan_Xform* xf, int num, Vector* pos, Vector* norm)
+{
+    int i;
+    float r00 = xf->rot[0][0], r01 = xf->rot[0][1], r02 = xf->rot[0][2];
+    float r10 = xf->rot[1][0], r11 = xf->rot[1][1], r12 = xf->rot[1][2];
+    float r20 = xf->rot[2][0], r21 = xf->rot[2][1], r22 = xf->rot[2][2];
+    float tx = xf->trans[X], ty = xf->trans[Y], tz = xf->trans[Z];
+    float x, y, z;
+
+    for (i = 0; i < num; i++) {
+        x = pos[i][X];
+        y = pos[i][Y];
+        z = pos[i][Z];
+        pos[i][X] = r00 * x + r01 * y + r02 * z + tx;
+        pos[i][Y] = r10 * x + r11 * y + r12 * z + ty;
+        pos[i][Z] = r20 * x + r21 * y + r22 * z + tz;
+    }
+
+    if (norm == NULL)
+        return;
+
+    for (i = 0; i < num; i++) {
+        x = norm[i][X];
+        y = norm[i][Y];
+        z = norm[i][Z];
+        norm[i][X] = r00 * x + r01 * y + r02 * z;
+        norm[i][Y] = r10 * x + r11 * y + r12 * z;
+        norm[i][Z] = r20 * x + r21 * y + r22 * z;
+    }
+}
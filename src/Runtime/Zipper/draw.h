@@ -32,11 +32,21 @@
 #include "zipper.h"
 #include "matrix.h"
 
+// Transformation from one scan's mesh space to another's
+typedef struct Scan_Xform {
+    float rot[3][3];      /* rotation */
+    Vector trans;         /* translation, applied after rotation */
+} Scan_Xform;
+
 // Declarations
 int backface_tri(Triangle* tri, Matrix mat, Matrix timat);
 void mesh_to_world(Scan* sc, Vector invec, Vector outvec);
 void world_to_mesh(Scan* sc, Vector invec, Vector outvec);
 void world_to_mesh_normal(Scan* sc, Vector in_norm, Vector out_norm);
 void mesh_to_world_normal(Scan* sc, Vector in_norm, Vector out_norm);
+void scan_to_scan_xform(Scan* from, Scan* to, Scan_Xform* xf);
+void xform_point(Scan_Xform* xf, Vector invec, Vector outvec);
+void xform_normal(Scan_Xform* xf, Vector in_norm, Vector out_norm);
+void xform_points(Scan_Xform* xf, int num, Vector* pos, Vector* norm);
 
 #endif
@@ -55,7 +55,8 @@ void create_edge_list(Mesh* mesh)
     int abnormal;
     int num_adj;
     int nverts;
-    static Vertex* near_verts[100];
+    static Vertex** near_verts = NULL;
+    static int max_near = 0;
 
     /*** do this cleaner !!!! ***/
     /*** do this cleaner !!!! ***/
@@ -139,6 +140,11 @@ void create_edge_list(Mesh* mesh)
 
             /* save a list of adjacent vertices */
             nverts = v1->nverts;
+            if (nverts > max_near) {
+                max_near = nverts;
+                near_verts = (Vertex**)
+                             realloc(near_verts, sizeof(Vertex*) * max_near);
+            }
             for (i = 0; i < nverts; i++)
                 near_verts[i] = v1->verts[i];
 
@@ -422,7 +428,7 @@ void add_edge_to_mesh(Mesh* mesh, Vertex* v1, Vertex* v2)
 
     /* create edge and place it on edge list of the mesh */
 
-    e = (Edge*) malloc(sizeof(Edge));
+    e = arena_edge(mesh);
     e->v1 = v1;
     e->v2 = v2;
     e->used = 0;
@@ -431,24 +437,12 @@ void add_edge_to_mesh(Mesh* mesh, Vertex* v1, Vertex* v2)
 
     /* add edge to each vertices list of edges */
 
-    if (v1->nedges >= v1->max_edges) {
-        v1->max_edges += 2;
-        if (v1->edges == NULL)
-            v1->edges = (Edge**) malloc(sizeof(Edge*) * v1->max_edges);
-        else
-            v1->edges = (Edge**)
-                        realloc(v1->edges, sizeof(Edge*) * v1->max_edges);
-    }
+    if (v1->nedges >= v1->max_edges)
+        grow_vertex_edges(mesh, v1);
     v1->edges[v1->nedges++] = e;
 
-    if (v2->nedges >= v2->max_edges) {
-        v2->max_edges += 2;
-        if (v2->edges == NULL)
-            v2->edges = (Edge**) malloc(sizeof(Edge*) * v2->max_edges);
-        else
-            v2->edges = (Edge**)
-                        realloc(v2->edges, sizeof(Edge*) * v2->max_edges);
-    }
+    if (v2->nedges >= v2->max_edges)
+        grow_vertex_edges(mesh, v2);
     v2->edges[v2->nedges++] = e;
 
     /* determine which triangle this edge belongs to */
@@ -493,6 +487,90 @@ void new_zipper_proc()
 }
 
 
+/******************************************************************************
+Find the nearest positions on the second mesh to all the vertices of the
+first mesh's boundary loops, in one batch.
+
+Entry:
+  sc1,sc2 - scans containing the two meshes
+  m1,m2   - the two meshes
+
+Exit:
+  returns the near positions, to be freed with free_loop_neighbors()
+******************************************************************************/
+static Loop_Neighbors find_loop_neighbors(Scan* sc1, Scan* sc2, Mesh* m1, Mesh* m2)
+{
+    Loop_Neighbors nbrs;
+    int i;
+    int nquery;
+    EdgeLoop* list1;
+    Edge* e, *e_orig;
+    Vertex* vert;
+    Vector* qpos;
+    Vector* qnorm;
+    Scan_Xform xf;
+    int inc;
+
+    inc = level_to_inc(mesh_level);
+    list1 = &m1->looplist;
+
+    nbrs.slot = (int*) malloc(sizeof(int) * (m1->nverts + 1));
+    qpos = (Vector*) malloc(sizeof(Vector) * (m1->nverts + 1));
+    qnorm = (Vector*) malloc(sizeof(Vector) * (m1->nverts + 1));
+
+    for (i = 0; i < m1->nverts; i++)
+        nbrs.slot[i] = -1;
+
+    nquery = 0;
+    for (i = 0; i < list1->nloops; i++) {
+        e_orig = list1->loops[i];
+        e = e_orig;
+        do {
+            vert = e->v1;
+            if (nbrs.slot[vert->index] == -1) {
+                nbrs.slot[vert->index] = nquery;
+                vcopy(vert->coord, qpos[nquery]);
+                vcopy(vert->normal, qnorm[nquery]);
+                nquery++;
+            }
+            e = e->next;
+        } while (e != e_orig);
+    }
+
+    /* take the loop vertices into mesh 2's coordinates at once */
+    scan_to_scan_xform(sc1, sc2, &xf);
+    xform_points(&xf, nquery, qpos, qnorm);
+
+    nbrs.near = (NearPosition*) malloc(sizeof(NearPosition) * (nquery + 1));
+    nbrs.found = (int*) malloc(sizeof(int) * (nquery + 1));
+
+    nearest_on_mesh_batch(sc2, m2, NULL, nquery, qpos, qnorm,
+                          inc * ZIPPER_RESOLUTION, FIND_COS, nbrs.near, nbrs.found);
+
+    free(qpos);
+    free(qnorm);
+
+    return nbrs;
+}
+
+
+/******************************************************************************
+Free the near positions made by find_loop_neighbors().
+
+Entry:
+  nbrs - near positions to free
+******************************************************************************/
+static void free_loop_neighbors(Loop_Neighbors* nbrs)
+{
+    free(nbrs->slot);
+    free(nbrs->near);
+    free(nbrs->found);
+    nbrs->slot = NULL;
+    nbrs->near = NULL;
+    nbrs->found = NULL;
+}
+
+
 /******************************************************************************
 Join boundary loops from two meshes together.
 
@@ -506,17 +584,14 @@ void join_loops(Scan* sc1, Scan* sc2)
     EdgeLoop* list1;
     Edge* e, *e_orig;
     NearPosition near_info;
-    Vector pos, norm;
     int result;
     Vertex* vert;
     Vertex* vnear;
-    int inc;
+    Loop_Neighbors nbrs;
 
     m1 = sc1->meshes[mesh_level];
     m2 = sc2->meshes[mesh_level];
 
-    inc = level_to_inc(mesh_level);
-
     if (!m1->edges_valid)
         create_edge_list(m1);
 
@@ -525,6 +600,9 @@ void join_loops(Scan* sc1, Scan* sc2)
 
     list1 = &m1->looplist;
 
+    /* find where every loop vertex of mesh 1 lies on mesh 2 */
+    nbrs = find_loop_neighbors(sc1, sc2, m1, m2);
+
     /* mark all vertices from both meshes as untouched */
 
     for (i = 0; i < m1->nverts; i++)
@@ -550,10 +628,8 @@ void join_loops(Scan* sc1, Scan* sc2)
             vert = e->v1;
             if (vert->count == 0) {
 
-                mesh_to_world(sc1, vert->coord, pos);
-                mesh_to_world_normal(sc1, vert->normal, norm);
-                result = nearest_on_mesh(sc2, m2, NULL, pos, norm,
-                                         inc * ZIPPER_RESOLUTION, FIND_COS, &near_info);
+                result = nbrs.found[nbrs.slot[vert->index]];
+                near_info = nbrs.near[nbrs.slot[vert->index]];
 
                 /* go on to next vertex if this one has already been matched */
                 if (!result) {
@@ -570,10 +646,12 @@ void join_loops(Scan* sc1, Scan* sc2)
                 }
 
                 /* follow the adjacent loops */
-                follow_loops(sc1, sc2, m1, m2, vert, vnear, e);
+                follow_loops(&nbrs, vert, vnear, e);
             }
         }
     }
+
+    free_loop_neighbors(&nbrs);
 }
 
 
@@ -582,25 +660,20 @@ Follow around two loops to find how long the portion they should be zippered
 is.
 
 Entry:
-  sc1,sc2 - scans of the two meshes
-  m1,m2   - two meshes that the loops belong to
-  v1,v2   - vertices from first and second mesh
-  e1      - edge from first mesh
+  nbrs  - near positions of the first mesh's loop vertices on the second mesh
+  v1,v2 - vertices from first and second mesh
+  e1    - edge from first mesh
 ******************************************************************************/
-void follow_loops(Scan* sc1, Scan* sc2, Mesh* m1, Mesh* m2, Vertex* v1, Vertex* v2, Edge* e1)
+void follow_loops(Loop_Neighbors* nbrs, Vertex* v1, Vertex* v2, Edge* e1)
 {
     int num2;
     Edge* e;
     int still_adjacent;
     int result;
     NearPosition near_info;
-    Vector pos, norm;
     Vertex* vert, *vnear;
     Edge* e_min, *e_max;
     int count;
-    int inc;
-
-    inc = level_to_inc(mesh_level);
 
     num2 = v2->edges[0]->num;
 
@@ -612,10 +685,8 @@ void follow_loops(Scan* sc1, Scan* sc2, Mesh* m1, Mesh* m2, Vertex* v1, Vertex*
 
     while (still_adjacent) {
         vert = e->v1;
-        mesh_to_world(sc1, vert->coord, pos);
-        mesh_to_world_normal(sc1, vert->normal, norm);
-        result = nearest_on_mesh(sc2, m2, NULL, pos, norm,
-                                 inc * ZIPPER_RESOLUTION, FIND_COS, &near_info);
+        result = nbrs->found[nbrs->slot[vert->index]];
+        near_info = nbrs->near[nbrs->slot[vert->index]];
         vnear = near_info.v1;
         if (result == 0 || vnear->count != 0 || vnear->nedges == 0 ||
             vnear->edges[0]->num != num2) {
@@ -634,10 +705,8 @@ void follow_loops(Scan* sc1, Scan* sc2, Mesh* m1, Mesh* m2, Vertex* v1, Vertex*
 
     while (still_adjacent) {
         vert = e->v1;
-        mesh_to_world(sc1, vert->coord, pos);
-        mesh_to_world_normal(sc1, vert->normal, norm);
-        result = nearest_on_mesh(sc2, m2, NULL, pos, norm,
-                                 inc * ZIPPER_RESOLUTION, FIND_COS, &near_info);
+        result = nbrs->found[nbrs->slot[vert->index]];
+        near_info = nbrs->near[nbrs->slot[vert->index]];
         vnear = near_info.v1;
         if (result == 0 || vnear->count != 0 || vnear->nedges == 0 ||
             vnear->edges[0]->num != num2) {
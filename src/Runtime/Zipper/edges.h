@@ -32,6 +32,13 @@
 #include "zipper.h"
 #include "matrix.h"
 
+// Near positions of one mesh's boundary loop vertices on another mesh
+typedef struct Loop_Neighbors {
+    NearPosition* near;         /* near positions on the other mesh */
+    int* found;                 /* whether each one was found */
+    int* slot;                  /* where a vertex's answer is, by index */
+} Loop_Neighbors;
+
 // Declarations
 void create_edge_list(Mesh* mesh);
 void make_edge_loops(Mesh* mesh);
@@ -40,6 +47,6 @@ void swap_verts_in_edge(Edge* e);
 void add_edge_to_mesh(Mesh* mesh, Vertex* v1, Vertex* v2);
 void new_zipper_proc();
 void join_loops(Scan* sc1, Scan* sc2);
-void follow_loops(Scan* sc1, Scan* sc2, Mesh* m1, Mesh* m2, Vertex* v1, Vertex* v2, Edge* e1);
+void follow_loops(Loop_Neighbors* nbrs, Vertex* v1, Vertex* v2, Edge* e1);
 
 #endif
@@ -49,6 +49,12 @@ static FillTri** ftris = NULL;
 static int num_ftris = 0;
 static int max_ftris = 50;
 
+static Mesh* fill_mesh = NULL;  /* mesh whose hole is being filled */
+
+/* fill vertex of a mesh vertex, or NULL if it isn't part of the hole */
+#define FILL_VERTEX(v) \
+    (MARK_CURRENT(fill_mesh, v) ? (FillVertex*) (v)->move_to : NULL)
+
 // Parameters
 static float FILL_EDGE_LENGTH_FACTOR;
 static float FILL_EDGE_LENGTH;
@@ -154,8 +160,8 @@ void better_fill_loop(int loop, Scan* scan)
     }
 
     /* mark all vertices in mesh as not part of the hole */
-    for (i = 0; i < mesh->nverts; i++)
-        mesh->verts[i]->move_to = NULL;
+    fill_mesh = mesh;
+    new_mark_epoch(mesh);
 
     /* initialize list of fill triangles and vertices */
     init_fill_lists();
@@ -229,8 +235,7 @@ void better_fill_loop(int loop, Scan* scan)
     }
 
     /* fix the geometry of all the triangles that fill the hole */
-    for (i = 0; i < mesh->ntris; i++)
-        set_triangle_geometry(mesh->tris[i]);
+    refresh_geometry(mesh->tris, mesh->ntris, NULL, 0);
 
     /* compute normals and edge conditions for all new vertices */
 
@@ -295,9 +300,9 @@ int fix_fill_size(int loop, Scan* scan, float max_len, float* size)
         tri = ftris[i]->tri;
 
         /* get pointers to the fill vertices of this triangle */
-        verts[0] = (FillVertex*) tri->verts[0]->move_to;
-        verts[1] = (FillVertex*) tri->verts[1]->move_to;
-        verts[2] = (FillVertex*) tri->verts[2]->move_to;
+        verts[0] = FILL_VERTEX(tri->verts[0]);
+        verts[1] = FILL_VERTEX(tri->verts[1]);
+        verts[2] = FILL_VERTEX(tri->verts[2]);
 
         /* examine each edge of the triangle to see if it should be split */
         for (j = 0; j < 3; j++) {
@@ -401,8 +406,8 @@ int maybe_split_edge(Triangle* tri, Scan* scan, int idx1, int idx2)
     /* see if this edge is on the hole's boundary, and if so */
     /* then don't split the edge */
 
-    fv1 = (FillVertex*) v1->move_to;
-    fv2 = (FillVertex*) v2->move_to;
+    fv1 = FILL_VERTEX(v1);
+    fv2 = FILL_VERTEX(v2);
     if (fv1->on_edge && fv2->on_edge) {
         if (fv1->e1 == v2 || fv1->e2 == v2 ||
             fv2->e1 == v1 || fv2->e2 == v1)
@@ -593,6 +598,7 @@ void new_fvert(Vertex* vert, int on_edge, Vertex* v1, Vertex* v2)
 
     /* have vertex point back to position in this list */
     vert->move_to = (Vertex*) fvert;
+    vert->mark_epoch = fill_mesh->mark_epoch;
 }
 
 /******************************************************************************
@@ -790,8 +796,8 @@ void swap_hole_edges(Scan* sc)
             vert2 = vert1->verts[j];
 
             /* make sure the edge between vertices isn't on the hole's boundary */
-            fv1 = (FillVertex*) vert1->move_to;
-            fv2 = (FillVertex*) vert2->move_to;
+            fv1 = FILL_VERTEX(vert1);
+            fv2 = FILL_VERTEX(vert2);
             if (fv1 == NULL || fv2 == NULL)
                 continue;
             if (fv1->on_edge && fv2->on_edge) {
@@ -843,7 +849,7 @@ void swap_hole_edges(Scan* sc)
             }
 
             /* make sure these vertices are hole-filling vertices */
-            if (v1->move_to == NULL || v3->move_to == NULL)
+            if (FILL_VERTEX(v1) == NULL || FILL_VERTEX(v3) == NULL)
                 continue;
 
             /* create normalized vectors around the boundary */
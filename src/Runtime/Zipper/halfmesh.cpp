@@ -0,0 +1,421 @@
+/*
+ * Compact half-edge description of a triangle mesh, using indices instead
+ * of pointers.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Internal
+#include "halfmesh.h"
+#include "mesh.h"
+
+// most triangles to step around a vertex when looking for the next
+// boundary half-edge
+#define HALF_FAN_MAX 256
+
+/* one half-edge of a triangle, by the vertices of its edge */
+typedef struct Half_Key {
+    int lo, hi;           /* lower and higher vertex index of the edge */
+    int half;             /* the half-edge */
+} Half_Key;
+
+/******************************************************************************
+Compare two half-edges by their edge, for qsort.
+******************************************************************************/
+static int compare_half_keys(const void* p1, const void* p2)
+{
+    const Half_Key* k1 = (const Half_Key*) p1;
+    const Half_Key* k2 = (const Half_Key*) p2;
+
+    if (k1->lo != k2->lo)
+        return (k1->lo < k2->lo ? -1 : 1);
+    if (k1->hi != k2->hi)
+        return (k1->hi < k2->hi ? -1 : 1);
+    if (k1->half != k2->half)
+        return (k1->half < k2->half ? -1 : 1);
+    return (0);
+}
+
+/******************************************************************************
+Allocate a half-edge mesh with room for a given number of vertices and
+triangles.  The vertex attributes are zeroed.
+******************************************************************************/
+static Half_Mesh* new_half_mesh(int nverts, int ntris)
+{
+    int i;
+    int max_half;
+    Half_Mesh* hm;
+
+    /* worst case: every edge of every triangle is on the boundary */
+    max_half = 6 * ntris;
+
+    hm = (Half_Mesh*) malloc(sizeof(Half_Mesh));
+    hm->nverts = nverts;
+    hm->ntris = ntris;
+    hm->nhalf = 3 * ntris;
+    hm->coords = (float*) malloc(sizeof(float) * 3 * (nverts + 1));
+    hm->normals = (float*) malloc(sizeof(float) * 3 * (nverts + 1));
+    hm->confidence = (float*) malloc(sizeof(float) * (nverts + 1));
+    hm->intensity = (float*) malloc(sizeof(float) * (nverts + 1));
+    hm->colors = (unsigned char*) malloc(3 * (nverts + 1));
+    hm->on_edge = (unsigned char*) malloc(nverts + 1);
+    hm->vert_half = (int*) malloc(sizeof(int) * (nverts + 1));
+    hm->half_vert = (int*) malloc(sizeof(int) * (max_half + 1));
+    hm->half_twin = (int*) malloc(sizeof(int) * (max_half + 1));
+    hm->half_next = (int*) malloc(sizeof(int) * (max_half + 1));
+
+    if (hm->coords == NULL || hm->normals == NULL || hm->confidence == NULL ||
+        hm->intensity == NULL || hm->colors == NULL || hm->on_edge == NULL ||
+        hm->vert_half == NULL || hm->half_vert == NULL ||
+        hm->half_twin == NULL || hm->half_next == NULL) {
+        fprintf(stderr, "new_half_mesh: can't allocate %d vertices and %d triangles\n",
+                nverts, ntris);
+        exit(-1);
+    }
+
+    for (i = 0; i < 3 * nverts; i++) {
+        hm->normals[i] = 0;
+        hm->colors[i] = 0;
+    }
+    for (i = 0; i < nverts; i++) {
+        hm->confidence[i] = 0;
+        hm->intensity[i] = 0;
+        hm->on_edge[i] = 0;
+    }
+
+    return (hm);
+}
+
+/******************************************************************************
+Find the next boundary half-edge after a given one, by stepping around the
+fan of triangles at the vertex where the given one ends.
+
+Entry:
+  hm - the half-edge mesh (triangle half-edges and twins set up)
+  g  - boundary half-edge
+
+Exit:
+  returns the boundary half-edge leaving g's end vertex, or -1 if stepping
+  around the vertex didn't find one (the mesh isn't a manifold there)
+******************************************************************************/
+static int next_boundary_half(Half_Mesh* hm, int g)
+{
+    int i;
+    int x, prev, t;
+
+    /* the triangle half-edge along the same edge leaves g's end vertex */
+    x = hm->half_twin[g];
+
+    for (i = 0; i < HALF_FAN_MAX; i++) {
+
+        /* the half-edge before x in its triangle comes into the vertex, */
+        /* and its twin leaves the vertex in the next triangle over */
+        prev = 3 * (x / 3) + (x + 2) % 3;
+        t = hm->half_twin[prev];
+
+        if (HALF_BOUNDARY(hm, t))
+            return (t);
+
+        x = t;
+        if (x == hm->half_twin[g])
+            break;
+    }
+
+    return (-1);
+}
+
+/******************************************************************************
+Build the half-edges of a mesh from its list of triangles.  This is the
+common part of building from arrays and from a Mesh.
+
+Entry:
+  hm        - half-edge mesh with vertices filled in
+  tri_verts - three vertex indices per triangle
+******************************************************************************/
+static void build_half_edges(Half_Mesh* hm, int* tri_verts)
+{
+    int i, j, k;
+    int a, b;
+    int nkeys;
+    int first, last;
+    int nfwd, nback;
+    int h, g;
+    int* out_first;
+    int* out_list;
+    Half_Key* keys;
+
+    /* half-edges around each triangle */
+    for (i = 0; i < hm->ntris; i++)
+        for (j = 0; j < 3; j++) {
+            h = 3 * i + j;
+            hm->half_vert[h] = tri_verts[h];
+            hm->half_next[h] = 3 * i + (j + 1) % 3;
+            hm->half_twin[h] = -1;
+        }
+
+    /* sort the half-edges by edge so that twins are next to each other */
+
+    nkeys = 3 * hm->ntris;
+    keys = (Half_Key*) malloc(sizeof(Half_Key) * (nkeys + 1));
+
+    for (h = 0; h < nkeys; h++) {
+        a = hm->half_vert[h];
+        b = tri_verts[3 * (h / 3) + (h + 1) % 3];
+        keys[h].lo = (a < b) ? a : b;
+        keys[h].hi = (a < b) ? b : a;
+        keys[h].half = h;
+    }
+
+    qsort(keys, nkeys, sizeof(Half_Key), compare_half_keys);
+
+    /* pair each half-edge going one way along an edge with one going the */
+    /* other way (an edge used by more than two triangles pairs up as many */
+    /* as it can, in order) */
+
+    for (first = 0; first < nkeys; first = last) {
+
+        for (last = first + 1; last < nkeys; last++)
+            if (keys[last].lo != keys[first].lo || keys[last].hi != keys[first].hi)
+                break;
+
+        /* an edge from a vertex to itself stays un-paired */
+        if (keys[first].lo == keys[first].hi)
+            continue;
+
+        j = first;
+        k = first;
+        for (;;) {
+            /* next un-paired half-edge going from lo to hi, and hi to lo */
+            while (j < last && hm->half_vert[keys[j].half] != keys[j].lo)
+                j++;
+            while (k < last && hm->half_vert[keys[k].half] != keys[k].hi)
+                k++;
+            if (j == last || k == last)
+                break;
+            hm->half_twin[keys[j].half] = keys[k].half;
+            hm->half_twin[keys[k].half] = keys[j].half;
+            j++;
+            k++;
+        }
+    }
+
+    free(keys);
+
+    /* give each un-paired half-edge a boundary twin going the other way */
+
+    nfwd = 3 * hm->ntris;
+    for (h = 0; h < nfwd; h++) {
+        if (hm->half_twin[h] != -1)
+            continue;
+        g = hm->nhalf++;
+        hm->half_vert[g] = hm->half_vert[hm->half_next[h]];
+        hm->half_twin[g] = h;
+        hm->half_twin[h] = g;
+        hm->half_next[g] = -1;
+    }
+
+    /* link the boundary half-edges into loops */
+
+    nback = 0;
+    for (g = nfwd; g < hm->nhalf; g++) {
+        hm->half_next[g] = next_boundary_half(hm, g);
+        if (hm->half_next[g] == -1)
+            nback++;
+    }
+
+    /* where the mesh isn't a manifold, take any boundary half-edge that */
+    /* leaves the right vertex */
+
+    if (nback > 0) {
+
+        out_first = (int*) malloc(sizeof(int) * (hm->nverts + 2));
+        out_list = (int*) malloc(sizeof(int) * (hm->nhalf - nfwd + 1));
+
+        for (i = 0; i <= hm->nverts + 1; i++)
+            out_first[i] = 0;
+        for (g = nfwd; g < hm->nhalf; g++)
+            out_first[hm->half_vert[g] + 2]++;
+        for (i = 2; i <= hm->nverts + 1; i++)
+            out_first[i] += out_first[i - 1];
+        for (g = nfwd; g < hm->nhalf; g++)
+            out_list[out_first[hm->half_vert[g] + 1]++] = g;
+
+        for (g = nfwd; g < hm->nhalf; g++) {
+            if (hm->half_next[g] != -1)
+                continue;
+            a = hm->half_vert[hm->half_twin[g]];
+            hm->half_next[g] = out_list[out_first[a]];
+        }
+
+        free(out_first);
+        free(out_list);
+    }
+
+    /* a half-edge leaving each vertex, preferring boundary ones */
+
+    for (i = 0; i < hm->nverts; i++)
+        hm->vert_half[i] = -1;
+    for (h = 0; h < hm->nhalf; h++)
+        if (hm->vert_half[hm->half_vert[h]] == -1 || HALF_BOUNDARY(hm, h))
+            hm->vert_half[hm->half_vert[h]] = h;
+
+    /* give back the room that wasn't needed for boundary half-edges */
+    hm->half_vert = (int*) realloc(hm->half_vert, sizeof(int) * (hm->nhalf + 1));
+    hm->half_twin = (int*) realloc(hm->half_twin, sizeof(int) * (hm->nhalf + 1));
+    hm->half_next = (int*) realloc(hm->half_next, sizeof(int) * (hm->nhalf + 1));
+}
+
+/******************************************************************************
+Build a half-edge mesh from arrays of vertex positions and triangles, such
+as those read from a file.
+
+Entry:
+  nverts    - number of vertices
+  coords    - three coordinates per vertex
+  ntris     - number of triangles
+  tri_verts - three vertex indices per triangle
+
+Exit:
+  returns the new half-edge mesh
+******************************************************************************/
+Half_Mesh* build_half_mesh(int nverts, float* coords, int ntris, int* tri_verts)
+{
+    int i;
+    Half_Mesh* hm;
+
+    hm = new_half_mesh(nverts, ntris);
+
+    for (i = 0; i < 3 * nverts; i++)
+        hm->coords[i] = coords[i];
+
+    build_half_edges(hm, tri_verts);
+
+    return (hm);
+}
+
+/******************************************************************************
+Make a half-edge copy of a mesh.  Vertices and triangles keep their order.
+
+Entry:
+  mesh - mesh to copy
+
+Exit:
+  returns the new half-edge mesh
+******************************************************************************/
+Half_Mesh* mesh_to_half_mesh(Mesh* mesh)
+{
+    int i, j;
+    int* tri_verts;
+    Vertex* v;
+    Half_Mesh* hm;
+
+    hm = new_half_mesh(mesh->nverts, mesh->ntris);
+
+    for (i = 0; i < mesh->nverts; i++) {
+        v = mesh->verts[i];
+        for (j = 0; j < 3; j++) {
+            hm->coords[3 * i + j] = v->coord[j];
+            hm->normals[3 * i + j] = v->normal[j];
+        }
+        hm->confidence[i] = mesh->confidence[i];
+        hm->intensity[i] = mesh->intensity[i];
+        memcpy(&hm->colors[3 * i], mesh->colors[i], sizeof(Color));
+        hm->on_edge[i] = v->on_edge;
+    }
+
+    tri_verts = (int*) malloc(sizeof(int) * (3 * mesh->ntris + 1));
+    for (i = 0; i < mesh->ntris; i++)
+        for (j = 0; j < 3; j++)
+            tri_verts[3 * i + j] = mesh->tris[i]->verts[j]->index;
+
+    build_half_edges(hm, tri_verts);
+    free(tri_verts);
+
+    return (hm);
+}
+
+/******************************************************************************
+Fill a mesh with the vertices and triangles of a half-edge mesh.  Vertices
+and triangles keep their order, and the vertex attributes are copied, so
+that a mesh copied with mesh_to_half_mesh comes back the same.  Triangle
+geometry, vertex lists, normals and edge flags are re-computed from the
+triangles, and triangles with no area or with too long an edge are left
+out.
+
+Entry:
+  hm      - half-edge mesh to copy
+  mesh    - empty mesh to put the vertices and triangles in (as set up by
+            the file readers, before its hash table is made)
+  max_len - maximum allowed length of a triangle edge
+******************************************************************************/
+void half_mesh_to_mesh(Half_Mesh* hm, Mesh* mesh, float max_len)
+{
+    /* half-edges 3*t, 3*t+1 and 3*t+2 start at the vertices of triangle t */
+    build_mesh_from_arrays(mesh, hm->nverts, hm->coords, hm->ntris, hm->half_vert,
+                           max_len);
+
+    /* the mesh keeps these in arrays by vertex index too */
+    memcpy(mesh->confidence, hm->confidence, sizeof(float) * hm->nverts);
+    memcpy(mesh->intensity, hm->intensity, sizeof(float) * hm->nverts);
+    memcpy(mesh->colors, hm->colors, sizeof(Color) * hm->nverts);
+}
+
+/******************************************************************************
+Free a half-edge mesh.
+******************************************************************************/
+void free_half_mesh(Half_Mesh* hm)
+{
+    free(hm->coords);
+    free(hm->normals);
+    free(hm->confidence);
+    free(hm->intensity);
+    free(hm->colors);
+    free(hm->on_edge);
+    free(hm->vert_half);
+    free(hm->half_vert);
+    free(hm->half_twin);
+    free(hm->half_next);
+    free(hm);
+}
+
+/******************************************************************************
+Find how much memory a half-edge mesh takes up.
+******************************************************************************/
+int half_mesh_bytes(Half_Mesh* hm)
+{
+    int per_vert;
+    int per_half;
+
+    per_vert = 8 * sizeof(float) + 4 + sizeof(int);
+    per_half = 3 * sizeof(int);
+
+    return (sizeof(Half_Mesh) + per_vert * hm->nverts + per_half * hm->nhalf);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ZIPPER_HALFMESH_H
+#define ZIPPER_HALFMESH_H
+
+// Internal
+#include "zipper.h"
+
+// Compact, index-based description of a triangle mesh.  Half-edges 3*t,
+// 3*t+1 and 3*t+2 go around triangle t, starting at its first vertex.
+// Every edge that belongs to only one triangle also gets a boundary
+// half-edge, numbered after all the triangles' half-edges, going the
+// other way; boundary half-edges link into loops around the holes.
+typedef struct Half_Mesh {
+    int nverts;           /* number of vertices */
+    int ntris;            /* number of triangles */
+    int nhalf;            /* number of half-edges (triangle and boundary) */
+    float* coords;        /* position of each vertex (3 per vertex) */
+    float* normals;       /* surface normal at each vertex (3 per vertex) */
+    float* confidence;    /* confidence of each vertex */
+    float* intensity;     /* intensity of each vertex */
+    unsigned char* colors; /* color of each vertex (3 per vertex) */
+    unsigned char* on_edge; /* on_edge flag of each vertex */
+    int* vert_half;       /* a half-edge leaving each vertex (a boundary one if
+                             there is one), -1 if the vertex is unused */
+    int* half_vert;       /* vertex each half-edge starts at */
+    int* half_twin;       /* half-edge going the other way along the same edge */
+    int* half_next;       /* next half-edge around a triangle or a hole */
+} Half_Mesh;
+
+// triangle of a half-edge, or -1 for a boundary half-edge
+#define HALF_TRI(hm, h)      ((h) < 3 * (hm)->ntris ? (h) / 3 : -1)
+
+// is a half-edge on the boundary of the mesh (part of no triangle)?
+#define HALF_BOUNDARY(hm, h) ((h) >= 3 * (hm)->ntris)
+
+// vertex a half-edge ends at
+#define HALF_END(hm, h)      ((hm)->half_vert[(hm)->half_next[h]])
+
+// Declarations
+Half_Mesh* build_half_mesh(int nverts, float* coords, int ntris, int* tri_verts);
+Half_Mesh* mesh_to_half_mesh(Mesh* mesh);
+void half_mesh_to_mesh(Half_Mesh* hm, Mesh* mesh, float max_len);
+void free_half_mesh(Half_Mesh* hm);
+int half_mesh_bytes(Half_Mesh* hm);
+
+#endif
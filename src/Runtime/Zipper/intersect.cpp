@@ -42,11 +42,7 @@
 #include "triangulate.h"
 #include "meshops.h"
 #include "remove.h"
-
-// Set of points near the edge of a mesh
-static Vertex** pts_near = NULL;
-static int pts_near_num;
-static int pts_near_max;
+#include "parallel.h"
 
 // Constants
 #define MESH_A    1
@@ -54,217 +50,266 @@ static int pts_near_max;
 #define CUT       3
 #define USED_CUT  4
 
+/* one place where an edge of a triangle passes through a triangle of the */
+/* other mesh, found by a thread and recorded later by new_tri_intersection() */
+typedef struct Tri_Hit {
+    Triangle* cut_tri;        /* triangle that supplied the edge */
+    int edge;                 /* which edge of cut_tri (0, 1, 2) */
+    Triangle* near_tri;       /* triangle that was passed through */
+    Vector pos;               /* where, in the other mesh's coordinates */
+    float t;                  /* parameter of the cut along the edge */
+    int inward;               /* direction the edge passed through */
+    float dot;                /* dot product between the two triangles */
+} Tri_Hit;
+
+/* what one thread finds, in the order of the triangles it looked at */
+typedef struct Hit_Buffer {
+    Tri_Hit* hits;
+    int num;
+    int max;
+    Near_List near;           /* vertices near the current triangle */
+    unsigned int* stamps;     /* edge that last looked at each triangle, by index */
+    int max_stamps;
+    unsigned int stamp;       /* number of the current edge */
+} Hit_Buffer;
+
+/* one direction of intersecting: edges of m1's triangles against m2 */
+typedef struct Intersect_Pass {
+    Mesh* m1;                 /* mesh whose triangle edges cut */
+    Mesh* m2;                 /* mesh whose triangles are cut */
+    Scan_Xform xf;            /* takes mesh 1 coordinates to mesh 2 coordinates */
+    float max_length;         /* how far to look for nearby vertices */
+} Intersect_Pass;
+
+/* what the threads of find_intersections() share */
+typedef struct Intersect_Info {
+    Intersect_Pass* passes;
+    int npasses;
+    Hit_Buffer* buffers;      /* one for each thread */
+} Intersect_Info;
+
 /******************************************************************************
-Intersect one mesh with another.
+Set up one direction of intersecting two meshes.
 
 Entry:
-  sc1 - first mesh
-  sc2 - second mesh
+  pass    - the pass to set up
+  sc1,sc2 - scans whose triangle edges cut and whose triangles are cut
 ******************************************************************************/
-void intersect_meshes(Scan* sc1, Scan* sc2)
+static void init_intersect_pass(Intersect_Pass* pass, Scan* sc1, Scan* sc2)
 {
-    int i;
-    Mesh* m1, *m2;
-    Triangle* tri;
-
-    m1 = sc1->meshes[mesh_level];
-    m2 = sc2->meshes[mesh_level];
-
-#if 1
-    /* set all vertex colors to neutral */
-    for (i = 0; i < m1->nverts; i++)
-        m1->verts[i]->confidence = -1;
-
-    for (i = 0; i < m2->nverts; i++)
-        m2->verts[i]->confidence = -1;
-#endif
+    float edge_length_max(int level);
 
-    /* mark those tris in mesh 2 that are intersected by tris in mesh 1 */
-    mark_intersected_tris(sc1, sc2);
+    pass->m1 = sc1->meshes[mesh_level];
+    pass->m2 = sc2->meshes[mesh_level];
+    scan_to_scan_xform(sc1, sc2, &pass->xf);
+    pass->max_length = edge_length_max(mesh_level);
+}
 
-    /* mark those tris in mesh 1 that are intersected by tris in mesh 2 */
-    mark_intersected_tris(sc2, sc1);
+/******************************************************************************
+Is a triangle the first one of its mesh (by index) with a given edge?  Only
+that triangle's edge is intersected with the other mesh; the others that
+share the edge find that it's already been done.
+******************************************************************************/
+static int first_with_edge(Triangle* tri, Vertex* v1, Vertex* v2)
+{
+    int i, j;
+    Triangle* other;
 
-    /* have triangle colors reflect the dont_touch flag */
-    for (i = 0; i < m1->ntris; i++) {
-        tri = m1->tris[i];
-        tri->mark = tri->dont_touch;
-#if 1
-        tri->mark = 0;
-#endif
-        if (tri->dont_touch == 0 && tri->clips) {
-            free(tri->clips);
-            tri->clips = NULL;
-        }
+    for (i = 0; i < v1->ntris; i++) {
+        other = v1->tris[i];
+        if (other->index >= tri->index)
+            continue;
+        for (j = 0; j < 3; j++)
+            if (other->verts[j] == v2)
+                return (0);
     }
 
-    for (i = 0; i < m2->ntris; i++) {
-        tri = m2->tris[i];
-        tri->mark = tri->dont_touch;
-#if 1
-        tri->mark = 0;
-#endif
-        if (tri->dont_touch == 0 && tri->clips) {
-            free(tri->clips);
-            tri->clips = NULL;
-        }
-    }
+    return (1);
 }
 
 /******************************************************************************
-Finish the mesh intersection.
+Find where an edge of a triangle passes through the triangles used by the
+nearby points collected in a list.  Nothing is changed in either mesh; the
+places are added to a thread's buffer.
 
 Entry:
-  sc1 - first mesh
-  sc2 - second mesh
+  buf     - buffer to add to, with its list of nearby points
+  cut_tri - triangle with the edge
+  index   - which edge (from vertex index to vertex index + 1)
+  pass    - the pass, whose m2 is the mesh that the points in the list come
+            from and whose xf takes the coordinates of cut_tri into its own
 ******************************************************************************/
-void finish_intersect_meshes(Scan* sc1, Scan* sc2)
+static void find_edge_hits(Hit_Buffer* buf, Triangle* cut_tri, int index, Intersect_Pass* pass)
 {
-    /* comment this out if we're also doing a "merge" */
-    /* comment this out if we're also doing a "merge" */
-    /* comment this out if we're also doing a "merge" */
+    int i, j;
+    Vertex* vert;
+    Triangle* tri;
+    Tri_Hit* hit;
+    Vector pos;
+    float t;
+    int inward;
+    float dot;
+    Vector coord1, coord2;
+    Vector ct_norm;
+    Vector temp_norm;
+    Vector barycentric;
+    Near_List* near = &buf->near;
 
-#if 1
+    /* get cut_tri's normal into mesh 2 coordinates */
+    temp_norm[X] = -cut_tri->aa;
+    temp_norm[Y] = -cut_tri->bb;
+    temp_norm[Z] = -cut_tri->cc;
+    xform_normal(&pass->xf, temp_norm, ct_norm);
 
-    /* gather the two sets of traingles into the same mesh */
-    gather_triangles(sc1, sc2);
+    /* transform the endpoints into the mesh 2 coordinate system */
+    xform_point(&pass->xf, cut_tri->verts[index]->coord, coord1);
+    xform_point(&pass->xf, cut_tri->verts[(index + 1) % 3]->coord, coord2);
+
+    /* new stamp for the triangles looked at, starting over if they run out */
+    buf->stamp++;
+    if (buf->stamp == 0) {
+        for (i = 0; i < buf->max_stamps; i++)
+            buf->stamps[i] = 0;
+        buf->stamp = 1;
+    }
 
-#endif
+    /* test all nearby triangles with the edge */
+    for (i = 0; i < near->num; i++) {
+        vert = near->verts[i];
+        for (j = 0; j < vert->ntris; j++) {
 
-    /* comment this out if we're also doing a "merge" */
-    /* comment this out if we're also doing a "merge" */
-    /* comment this out if we're also doing a "merge" */
+            tri = vert->tris[j];
 
+            /* don't examine the same triangle twice */
+            if (buf->stamps[tri->index] == buf->stamp)
+                continue;
+            buf->stamps[tri->index] = buf->stamp;
 
-    /* add the points of intersection to the mesh as new vertices */
-    add_intersect_points(sc1, sc2);
+            /* don't look at triangles that are too nearly parallel to cut_tri */
+            dot = -1 * (ct_norm[X] * tri->aa +
+                        ct_norm[Y] * tri->bb +
+                        ct_norm[Z] * tri->cc);
+            if (dot > 0.8)
+                continue;
 
-    /* actually do the clipping of the triangles */
-    perform_intersect_clipping(sc1, sc2);
+            /* perform intersection */
+            if (!line_intersect_tri_single(coord1, coord2, pass->m2, tri, pos, &t, &inward, barycentric))
+                continue;
+
+            /* save away info on the intersection */
+            if (buf->num == buf->max) {
+                buf->max = (buf->max == 0) ? 64 : buf->max * 2;
+                buf->hits = (Tri_Hit*) realloc(buf->hits, sizeof(Tri_Hit) * buf->max);
+                if (buf->hits == NULL) {
+                    fprintf(stderr, "find_edge_hits: out of memory\n");
+                    exit(-1);
+                }
+            }
+            hit = &buf->hits[buf->num++];
+            hit->cut_tri = cut_tri;
+            hit->edge = index;
+            hit->near_tri = tri;
+            vcopy(pos, hit->pos);
+            hit->t = t;
+            hit->inward = inward;
+            hit->dot = dot;
+        }
+    }
 }
 
 /******************************************************************************
-Mark which triangles of one mesh intersect with triangles of another.  We
-will later do the actual clipping of the triangles.
-
-Entry:
-  sc1,sc2 - scans containing the meshes
+Find where the edges of a range of triangles pass through the other mesh,
+for find_intersections().  The triangles of all the passes are numbered
+one after the other.
 ******************************************************************************/
-void mark_intersected_tris(Scan* sc1, Scan* sc2)
+static void find_hits_range(int first, int last, int thread, void* data)
 {
-    int i, j;
-    Mesh* m1, *m2;
+    int i, j, k;
+    Intersect_Info* info = (Intersect_Info*) data;
+    Intersect_Pass* pass;
+    Hit_Buffer* buf = &info->buffers[thread];
     Triangle* tri;
-    float max_length;
-    float edge_length_max(int level);
     Vector coord, normal;
 
-    m1 = sc1->meshes[mesh_level];
-    m2 = sc2->meshes[mesh_level];
-
-    max_length = edge_length_max(mesh_level);
+    for (k = first; k < last; k++) {
 
-    /* mark all vertices in mesh 2 as untouched */
-    /* (count will be marker saying that a vertex is in pts_near) */
-    for (i = 0; i < m2->nverts; i++)
-        m2->verts[i]->count = 0;
-
-    /* see which triangles of mesh 1 are near triangles of mesh 2 */
-
-    for (i = 0; i < m1->ntris; i++) {
-
-        tri = m1->tris[i];
+        /* which pass and which triangle */
+        i = k;
+        pass = info->passes;
+        while (i >= pass->m1->ntris) {
+            i -= pass->m1->ntris;
+            pass++;
+        }
+        tri = pass->m1->tris[i];
+
+        /* make room to stamp the other mesh's triangles */
+        if (pass->m2->ntris > buf->max_stamps) {
+            buf->stamps = (unsigned int*)
+                          realloc(buf->stamps, sizeof(unsigned int) * pass->m2->ntris);
+            if (buf->stamps == NULL) {
+                fprintf(stderr, "find_hits_range: out of memory\n");
+                exit(-1);
+            }
+            for (j = buf->max_stamps; j < pass->m2->ntris; j++)
+                buf->stamps[j] = 0;
+            buf->max_stamps = pass->m2->ntris;
+        }
 
         /* find nearby vertices to this triangle */
-        pts_near_num = 0;
+        clear_near_list(&buf->near, pass->m2);
         for (j = 0; j < 3; j++) {
 
             /* transform between coordinate systems */
-            mesh_to_world(sc1, tri->verts[j]->coord, coord);
-            world_to_mesh(sc2, coord, coord);
-            mesh_to_world_normal(sc1, tri->verts[j]->normal, normal);
-            world_to_mesh_normal(sc2, normal, normal);
+            xform_point(&pass->xf, tri->verts[j]->coord, coord);
+            xform_normal(&pass->xf, tri->verts[j]->normal, normal);
 
             /* look nearby for vertices on other meshes */
-            verts_near_vert(m2, NULL, coord, normal, max_length);
+            verts_near_vert(&buf->near, pass->m2, NULL, coord, normal, pass->max_length);
         }
 
         /* mark the current triangle if it had nearby vertices */
-        if (pts_near_num) {
+        if (buf->near.num) {
             tri->mark = 1;
         }
 
-        /* un-mark all the vertices in pts_near */
-        for (j = 0; j < pts_near_num; j++)
-            pts_near[j]->count = 0;
-
         /* intersect triangle edges with nearby triangles */
-        for (j = 0; j < 3; j++) {
-            intersect_edge_with_near_tris(tri->verts[j], tri->verts[(j + 1) % 3], tri,
-                                          sc1, sc2);
-        }
-
-#if 0
-        if (tri->clips) {
-            int n;
-            n = tri->clips[0].cut_num + tri->clips[1].cut_num + tri->clips[2].cut_num;
-            if (n > 0)
-                printf("number of cuts: %d\n", n);
-        }
-#endif
+        for (j = 0; j < 3; j++)
+            if (first_with_edge(tri, tri->verts[j], tri->verts[(j + 1) % 3]))
+                find_edge_hits(buf, tri, j, pass);
     }
 }
 
 /******************************************************************************
-Intersect an edge with all the triangles used by the nearby points collected
-in the list pts_near.
+Get an edge of a triangle ready to be given cuts: make sure each triangle
+that shares the edge has a "clips" field, and mark the edge as examined in
+all of them.  This also leaves the triangles sharing the edge where
+shared_triangle() finds them.
 
 Entry:
-  v1,v2   - endpoints of the edge in question
-  cut_tri - the triangle from which v1 and v2 come
-  sc1     - mesh that v1 and v2 are from
-  sc2     - mesh that the points in pts_near come from
+  cut_tri - the triangle
+  index   - which edge (from vertex index to vertex index + 1)
+
+Exit:
+  share_count - how many triangles share the edge
+  returns 1 if the edge is to be examined, 0 if it already was
 ******************************************************************************/
-void intersect_edge_with_near_tris(Vertex* v1, Vertex* v2, Triangle* cut_tri, Scan* sc1, Scan* sc2)
+static int claim_edge(Triangle* cut_tri, int index, int* share_count)
 {
     int i, j, k;
-    Vertex* vert;
+    Vertex* v1 = cut_tri->verts[index];
+    Vertex* v2 = cut_tri->verts[(index + 1) % 3];
     Triangle* tri;
-    Vector pos;
-    float t;
-    int inward;
-    int result;
-    float dot;
-    int share_count;
     int found;
-    int index;
     Triangle* shared_triangle(int index);
-    Vector coord1, coord2;
-    Vector ct_norm;
-    Vector temp_norm;
-    Vector barycentric;
-
-    /* get cut_tri's normal into mesh 2 coordinates */
-    temp_norm[X] = -tri->aa;
-    temp_norm[Y] = -tri->bb;
-    temp_norm[Z] = -tri->cc;
-    mesh_to_world_normal(sc1, temp_norm, ct_norm);
-    world_to_mesh_normal(sc2, ct_norm, ct_norm);
-
-    /* transform the endpoints into the mesh 2 coordinate system */
-    mesh_to_world(sc1, v1->coord, coord1);
-    world_to_mesh(sc2, coord1, coord1);
-    mesh_to_world(sc1, v2->coord, coord2);
-    world_to_mesh(sc2, coord2, coord2);
 
     /* See which other triangles (if any) share this edge.  If there */
     /* are others, then we may have already computed the intersections. */
 
-    share_count = edges_shared_count(v1, v2);
+    *share_count = edges_shared_count(v1, v2);
 
     /* Create the "clips" field for all triangles sharing this edge. */
 
-    for (i = 0; i < share_count; i++) {
+    for (i = 0; i < *share_count; i++) {
 
         tri = shared_triangle(i);
 
@@ -289,29 +334,12 @@ void intersect_edge_with_near_tris(Vertex* v1, Vertex* v2, Triangle* cut_tri, Sc
         }
     }
 
-    /* find the index of v1 and v2 */
-
-    found = 0;
-    for (j = 0; j < 3; j++) {
-        if (cut_tri->verts[j] == v1 && cut_tri->verts[(j + 1) % 3] == v2) {
-            index = j;
-            found = 1;
-            break;
-        }
-    }
-
-    /* sanity check */
-    if (!found) {
-        fprintf(stderr, "intersect_edge_with_near_tris: can't find vertices\n");
-        exit(-1);
-    }
-
     /* if the edge has already been examined, we can leave this routine */
     if (cut_tri->clips[index].done_edge == 1)
-        return;
+        return (0);
 
     /* mark the edge in question as "examined" in each triangle that it shares */
-    for (i = 0; i < share_count; i++) {
+    for (i = 0; i < *share_count; i++) {
 
         tri = shared_triangle(i);
 
@@ -330,161 +358,245 @@ void intersect_edge_with_near_tris(Vertex* v1, Vertex* v2, Triangle* cut_tri, Sc
 
         /* sanity check */
         if (!found) {
-            fprintf(stderr, "intersect_edge_with_near_tris: can't find vertices\n");
+            fprintf(stderr, "claim_edge: can't find vertices\n");
             exit(-1);
         }
     }
 
-    /* un-mark all nearby triangles, using "eat_mark" as the marker */
-    for (i = 0; i < pts_near_num; i++) {
-        vert = pts_near[i];
-        for (j = 0; j < vert->ntris; j++)
-            vert->tris[j]->eat_mark = 0;
+    return (1);
+}
+
+/******************************************************************************
+Mark which triangles of one mesh intersect with triangles of another, for
+one or more passes at once.  The triangles of all the passes are searched
+in several threads, each keeping what it finds in its own buffer.  The cuts
+are then recorded one triangle at a time, in the order of the passes and of
+the triangles, just as if each pass had been done by itself.
+
+Entry:
+  passes  - the passes
+  npasses - how many
+******************************************************************************/
+static void find_intersections(Intersect_Pass* passes, int npasses)
+{
+    int i, j, k;
+    int p;
+    int num;
+    int nthreads;
+    int share_count;
+    int claimed;
+    Intersect_Info info;
+    Hit_Buffer* buf;
+    Tri_Hit* hit;
+    Triangle* tri;
+    Mesh* m1;
+
+    /* the vertices don't move here, so search frozen tables, and the */
+    /* threads may only read the triangles' edge planes */
+    num = 0;
+    for (p = 0; p < npasses; p++) {
+        freeze_table(passes[p].m2);
+        make_edge_planes(passes[p].m2);
+        num += passes[p].m1->ntris;
     }
 
-    /* test all nearby triangles with the edge */
-    for (i = 0; i < pts_near_num; i++) {
-        vert = pts_near[i];
-        for (j = 0; j < vert->ntris; j++) {
+    nthreads = get_thread_count();
+    info.passes = passes;
+    info.npasses = npasses;
+    info.buffers = (Hit_Buffer*) malloc(sizeof(Hit_Buffer) * nthreads);
+    if (info.buffers == NULL) {
+        fprintf(stderr, "find_intersections: out of memory\n");
+        exit(-1);
+    }
+    for (i = 0; i < nthreads; i++) {
+        buf = &info.buffers[i];
+        buf->hits = NULL;
+        buf->num = 0;
+        buf->max = 0;
+        init_near_list(&buf->near);
+        buf->stamps = NULL;
+        buf->max_stamps = 0;
+        buf->stamp = 0;
+    }
 
-            tri = vert->tris[j];
+    /* see which triangles of each mesh 1 are near triangles of its mesh 2 */
+    parallel_for(num, 256, find_hits_range, &info);
 
-            /* don't examine the same triangle twice */
-            if (tri->eat_mark)
-                continue;
-            tri->eat_mark = 1;
+    for (p = 0; p < npasses; p++)
+        thaw_table(passes[p].m2);
 
-            /* don't look at triangles that are too nearly parallel to cut_tri */
-            dot = -1 * (ct_norm[X] * tri->aa +
-                        ct_norm[Y] * tri->bb +
-                        ct_norm[Z] * tri->cc);
-            if (dot > 0.8)
-                continue;
+    /* Each thread worked on the next range of triangles, so the buffers */
+    /* taken in turn list the hits in triangle order.  Record them along */
+    /* with every triangle edge, which gets "clips" fields whether or not */
+    /* it was cut. */
 
-            /* perform intersection */
-            result = line_intersect_tri_single(coord1, coord2, tri, pos, &t, &inward, barycentric);
+    buf = info.buffers;
+    k = 0;
 
-            /* save away info on an intersection, if there was one */
-            if (result) {
-#if 0
-                col = dot;
-                if (col > 1)
-                    col = 1;
-                else if (col < -1)
-                    col = -1;
-                col = (col + 1) * 0.5;
-                v1->confidence = col;
-                v2->confidence = col;
-#endif
+    for (p = 0; p < npasses; p++) {
+
+        m1 = passes[p].m1;
+
+        for (i = 0; i < m1->ntris; i++) {
+
+            tri = m1->tris[i];
+
+            for (j = 0; j < 3; j++) {
 
-                /* record information about this intersection */
-                new_tri_intersection(v1, v2, share_count,
-                                     tri, cut_tri, pos, t, inward, dot);
+                /* move on to the next buffer when this one is used up */
+                while (k == buf->num && buf < info.buffers + nthreads - 1) {
+                    buf++;
+                    k = 0;
+                }
+
+                /* (an edge examined before this started keeps no new cuts) */
+                claimed = claim_edge(tri, j, &share_count);
+
+                for (; k < buf->num; k++) {
+                    hit = &buf->hits[k];
+                    if (hit->cut_tri != tri || hit->edge != j)
+                        break;
+                    if (claimed)
+                        new_tri_intersection(tri->verts[j], tri->verts[(j + 1) % 3],
+                                             share_count, hit->near_tri, tri, hit->pos,
+                                             hit->t, hit->inward, hit->dot);
+                }
             }
         }
     }
 
-    /* set all "eat_mark" flags here back to zero */
-    for (i = 0; i < pts_near_num; i++) {
-        vert = pts_near[i];
-        for (j = 0; j < vert->ntris; j++)
-            vert->tris[j]->eat_mark = 0;
+    for (i = 0; i < nthreads; i++) {
+        free(info.buffers[i].hits);
+        free_near_list(&info.buffers[i].near);
+        free(info.buffers[i].stamps);
     }
+    free(info.buffers);
 }
 
-
 /******************************************************************************
-Find the collection of nearby vertices to a given vertex.
+Intersect one mesh with another.
 
 Entry:
-  mesh     - the mesh containing the (possibly) nearby vertices
-  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
-  pnt      - position (in mesh's coordinate system) to find nearest vertex to
-  norm     - surface normal at pnt
-  radius   - distance within which to check
-
-Exit:
-  places nearby vertices in "pts_near"
+  sc1 - first mesh
+  sc2 - second mesh
 ******************************************************************************/
-void verts_near_vert(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float radius)
+void intersect_meshes(Scan* sc1, Scan* sc2)
 {
-    int a, b, c;
-    int aa, bb, cc;
-    int index;
-    Hash_Table* table = mesh->table;
-    Vertex* ptr;
-    float dx, dy, dz;
-    float dist;
-
-    /* allocate room to keep nearby points */
-    if (pts_near == NULL) {
-        pts_near_max = 50;
-        pts_near = (Vertex**) malloc(sizeof(Vertex*) * pts_near_max);
+    int i;
+    Mesh* m1, *m2;
+    Triangle* tri;
+    Intersect_Pass passes[2];
+
+    m1 = sc1->meshes[mesh_level];
+    m2 = sc2->meshes[mesh_level];
+
+#if 1
+    /* set all vertex colors to neutral */
+    for (i = 0; i < m1->nverts; i++)
+        m1->confidence[i] = -1;
+
+    for (i = 0; i < m2->nverts; i++)
+        m2->confidence[i] = -1;
+#endif
+
+    /* mark those tris in mesh 2 that are intersected by tris in mesh 1, */
+    /* and those in mesh 1 that are intersected by tris in mesh 2 */
+    init_intersect_pass(&passes[0], sc1, sc2);
+    init_intersect_pass(&passes[1], sc2, sc1);
+    find_intersections(passes, 2);
+
+    /* have triangle colors reflect the dont_touch flag */
+    for (i = 0; i < m1->ntris; i++) {
+        tri = m1->tris[i];
+        tri->mark = tri->dont_touch;
+#if 1
+        tri->mark = 0;
+#endif
+        if (tri->dont_touch == 0 && tri->clips) {
+            free(tri->clips);
+            tri->clips = NULL;
+        }
     }
 
-    /* use squared distance */
-    radius = radius * radius;
+    for (i = 0; i < m2->ntris; i++) {
+        tri = m2->tris[i];
+        tri->mark = tri->dont_touch;
+#if 1
+        tri->mark = 0;
+#endif
+        if (tri->dont_touch == 0 && tri->clips) {
+            free(tri->clips);
+            tri->clips = NULL;
+        }
+    }
+}
 
-    /* determine which cell the position lies within */
-    aa = floor(table->scale * pnt[X]);
-    bb = floor(table->scale * pnt[Y]);
-    cc = floor(table->scale * pnt[Z]);
+/******************************************************************************
+Finish the mesh intersection.
 
-    /* look at nine cells, centered at cell containing location */
+Entry:
+  sc1 - first mesh
+  sc2 - second mesh
+******************************************************************************/
+void finish_intersect_meshes(Scan* sc1, Scan* sc2)
+{
+    /* comment this out if we're also doing a "merge" */
+    /* comment this out if we're also doing a "merge" */
+    /* comment this out if we're also doing a "merge" */
 
-    for (a = aa - 1; a <= aa + 1; a++)
-        for (b = bb - 1; b <= bb + 1; b++)
-            for (c = cc - 1; c <= cc + 1; c++) {
+#if 1
 
-                /* compute position in hash table */
-                index = (a * PR1 + b * PR2 + c) % table->num_entries;
-                if (index < 0)
-                    index += table->num_entries;
+    /* gather the two sets of traingles into the same mesh */
+    gather_triangles(sc1, sc2);
 
-                /* examine all points hashed to this cell */
-                for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
+#endif
 
-                    /* don't examine point if it's old mesh is not_mesh */
-                    if (ptr->old_mesh == not_mesh)
-                        continue;
+    /* comment this out if we're also doing a "merge" */
+    /* comment this out if we're also doing a "merge" */
+    /* comment this out if we're also doing a "merge" */
 
-                    /* go on if this vertex has already been placed on list */
-                    /* (count is a marker that says vertex is in pts_near) */
-                    if (ptr->count)
-                        continue;
 
-                    /* don't look at a vertex if it is used in no triangles */
-                    if (ptr->ntris == 0)
-                        continue;
+    /* add the points of intersection to the mesh as new vertices */
+    add_intersect_points(sc1, sc2);
 
-                    /* distance (squared) to this point */
-                    dx = ptr->coord[X] - pnt[X];
-                    dy = ptr->coord[Y] - pnt[Y];
-                    dz = ptr->coord[Z] - pnt[Z];
-                    dist = dx * dx + dy * dy + dz * dz;
+    /* actually do the clipping of the triangles */
+    perform_intersect_clipping(sc1, sc2);
+}
 
-                    /* maybe we've found new closest point */
-                    if (dist < radius) {
+/******************************************************************************
+Mark which triangles of one mesh intersect with triangles of another.  We
+will later do the actual clipping of the triangles.
 
-#if 0
-                        /* make sure the surface normals are roughly in the same direction */
-                        dot = vdot(norm, ptr->normal);
-                        if (dot < 0.3)
-                            continue;
-#endif
+Entry:
+  sc1,sc2 - scans containing the meshes
+******************************************************************************/
+void mark_intersected_tris(Scan* sc1, Scan* sc2)
+{
+    Intersect_Pass pass;
 
-                        /* add this vertex to our list */
-                        if (pts_near_num == pts_near_max) {
-                            pts_near_max += 20;
-                            pts_near = (Vertex**)
-                                       realloc(pts_near, sizeof(Vertex*) * pts_near_max);
-                        }
-                        pts_near[pts_near_num] = ptr;
-                        pts_near_num++;
-                        ptr->count = 1;  /* this marks vertex as being in pts_near */
-                    }
-                }
-            }
+    init_intersect_pass(&pass, sc1, sc2);
+    find_intersections(&pass, 1);
+}
+
+/******************************************************************************
+Find the collection of nearby vertices to a given vertex.
+
+Entry:
+  near     - list to add the vertices to
+  mesh     - the mesh containing the (possibly) nearby vertices
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  pnt      - position (in mesh's coordinate system) to find nearest vertex to
+  norm     - surface normal at pnt
+  radius   - distance within which to check
+
+Exit:
+  adds nearby vertices to "near"
+******************************************************************************/
+void verts_near_vert(
+    Near_List* near, Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float radius
+) {
+    /* (the surface normals aren't compared) */
+    verts_near(near, mesh, not_mesh, pnt, NULL, radius, 0, NEAR_IN_TRIS);
 }
 
 
@@ -31,13 +31,16 @@
 // Internal
 #include "zipper.h"
 #include "matrix.h"
+#include "near.h"
+#include "draw.h"
 
 // Declarations
 void intersect_meshes(Scan* sc1, Scan* sc2);
 void finish_intersect_meshes(Scan* sc1, Scan* sc2);
 void mark_intersected_tris(Scan* sc1, Scan* sc2);
-void intersect_edge_with_near_tris(Vertex* v1, Vertex* v2, Triangle* cut_tri, Scan* sc1, Scan* sc2);
-void verts_near_vert(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float radius);
+void verts_near_vert(
+    Near_List* near, Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float radius
+);
 void new_tri_intersection(
     Vertex* v1, Vertex* v2, int share_count,
     Triangle* near_tri, Triangle* cut_tri, Vector pos,
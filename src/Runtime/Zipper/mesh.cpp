@@ -40,13 +40,17 @@
 #include "mesh.h"
 #include "raw.h"
 #include "near.h"
+#include "tritree.h"
 #include "meshops.h"
+#include "parallel.h"
 
 // Parameters
 static int CONF_EDGE_ZERO;
 static float CONF_EDGE_COUNT_FACTOR;
 static float CONF_ANGLE;
 static float CONF_EXPONENT;
+static int SPATIAL_REORDER;
+static int GATHER_REORDER;
 
 void set_conf_edge_count_factor(float factor)
 {
@@ -88,6 +92,26 @@ int get_conf_edge_zero()
     return CONF_EDGE_ZERO;
 }
 
+void set_spatial_reorder(int set)
+{
+    SPATIAL_REORDER = set != 0;
+}
+
+int get_spatial_reorder()
+{
+    return SPATIAL_REORDER;
+}
+
+void set_gather_reorder(int set)
+{
+    GATHER_REORDER = set != 0;
+}
+
+int get_gather_reorder()
+{
+    return GATHER_REORDER;
+}
+
 /******************************************************************************
 Place into a scan a newly-created triangle mesh of a given vertex spacing.
 
@@ -176,6 +200,8 @@ Mesh* make_mesh(Scan* sc, int level, float table_dist)
 
     /* create mesh */
     mesh = (Mesh*) malloc(sizeof(Mesh));
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     /* allocate space for new triangles and vertices */
     mesh->nverts = 0;
@@ -209,7 +235,7 @@ Mesh* make_mesh(Scan* sc, int level, float table_dist)
                 index = make_vertex(mesh, vec);
                 vert_index[a + b * max_lt] = index;
                 /* tuck longitude into confidence for vertex error finding later */
-                mesh->verts[index]->confidence = j;
+                mesh->confidence[index] = j;
             } else {          /* coordinate void */
                 vert_index[a + b * max_lt] = -1;
             }
@@ -370,6 +396,8 @@ Mesh* make_mesh_raw(Scan* sc, int level, float table_dist)
 
     /* create mesh */
     mesh = (Mesh*) malloc(sizeof(Mesh));
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     /* allocate space for new triangles and vertices */
     mesh->nverts = 0;
@@ -403,7 +431,7 @@ Mesh* make_mesh_raw(Scan* sc, int level, float table_dist)
                 index = make_vertex(mesh, vec);
                 vert_index[a + b * max_lt] = index;
                 /* tuck longitude into confidence for vertex error finding later */
-                mesh->verts[index]->confidence = j;
+                mesh->confidence[index] = j;
             } else {          /* coordinate void */
                 vert_index[a + b * max_lt] = -1;
             }
@@ -524,6 +552,8 @@ Mesh* make_mesh_ply(Scan* sc, int level, float table_dist)
 
     /* create mesh */
     mesh = (Mesh*) malloc(sizeof(Mesh));
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     /* allocate space for new triangles and vertices */
     mesh->nverts = 0;
@@ -567,11 +597,11 @@ Mesh* make_mesh_ply(Scan* sc, int level, float table_dist)
         vec[Z] = plydata->points[i][Z];
         index = make_vertex(mesh, vec);
         vert_index[i] = index;
-        mesh->verts[index]->confidence = plydata->confidence[i];
-        mesh->verts[index]->intensity = plydata->intensity[i];
-        mesh->verts[index]->red = plydata->red[i];
-        mesh->verts[index]->grn = plydata->grn[i];
-        mesh->verts[index]->blu = plydata->blu[i];
+        mesh->confidence[index] = plydata->confidence[i];
+        mesh->intensity[index] = plydata->intensity[i];
+        mesh->colors[index][0] = plydata->red[i];
+        mesh->colors[index][1] = plydata->grn[i];
+        mesh->colors[index][2] = plydata->blu[i];
     }
 
     /* create the triangles */
@@ -684,7 +714,7 @@ void vertex_errors(Mesh* mesh, Scan* scan, int rot_flag, int mult)
             vert = mesh->verts[i];
 
             /* we stashed the longitude in confidence for now */
-            lg = (int) vert->confidence;
+            lg = (int) mesh->confidence[i];
 
             /* (s, 0, c) is laser direction */
             c = scan->cos_theta[lg] * 1.0e6;
@@ -700,9 +730,9 @@ void vertex_errors(Mesh* mesh, Scan* scan, int rot_flag, int mult)
                 val = 1;
 
             if (mult)
-                vert->confidence *= val;
+                mesh->confidence[i] *= val;
             else
-                vert->confidence = val;
+                mesh->confidence[i] = val;
         }
     } else {
         /* for linear scans */
@@ -727,9 +757,9 @@ void vertex_errors(Mesh* mesh, Scan* scan, int rot_flag, int mult)
                 val = 1;
 
             if (mult)
-                vert->confidence *= val;
+                mesh->confidence[i] *= val;
             else
-                vert->confidence = val;
+                mesh->confidence[i] = val;
         }
     }
 }
@@ -793,7 +823,7 @@ void lower_edge_confidence(Mesh* mesh, int level)
             v = mesh->verts[i];
             val = v->on_edge;
             if (val) {
-                v->confidence *= (val - 1) * recip;
+                mesh->confidence[i] *= (val - 1) * recip;
                 if (val > 1)
                     v->on_edge = 0;
             }
@@ -805,7 +835,7 @@ void lower_edge_confidence(Mesh* mesh, int level)
             v = mesh->verts[i];
             val = v->on_edge;
             if (val) {
-                v->confidence *= val * recip;
+                mesh->confidence[i] *= val * recip;
                 if (val > 1)
                     v->on_edge = 0;
             }
@@ -814,7 +844,9 @@ void lower_edge_confidence(Mesh* mesh, int level)
 }
 
 /******************************************************************************
-Free up all the memory used in a mesh.
+Free up all the memory used in a mesh.  The vertices, triangles and edges
+(and the vertices' lists) all come from the mesh's arena, so they are freed
+together, a slab at a time.
 
 Entry:
   mesh - mesh to clear out
@@ -822,44 +854,33 @@ Entry:
 void clear_mesh(Mesh* mesh)
 {
     int i;
-    Vertex* v;
     Triangle* t;
 
-    /* free the hash table */
-    if (mesh->table->verts != NULL)
-        free(mesh->table->verts);
+    /* free the search structures */
+    free_tri_tree(mesh);
+    thaw_table(mesh);
+    if (mesh->table->cells != NULL)
+        free(mesh->table->cells);
 
-    /* free the vertices */
-    if (mesh->verts != NULL) {
-        for (i = 0; i < mesh->nverts; i++) {
-            v = mesh->verts[i];
-            free(v->verts);
-            free(v->tris);
-            if (v->edges)
-                free(v->edges);
-            free(v);
-        }
-        free(mesh->verts);
-    }
+    /* free the vertex lists that outgrew the arena */
+    for (i = 0; i < mesh->nverts; i++)
+        free_vertex_lists(mesh, mesh->verts[i]);
 
-    /* free the triangles */
+    /* free the clipping information that triangles may still have */
     if (mesh->tris != NULL) {
         for (i = 0; i < mesh->ntris; i++) {
             t = mesh->tris[i];
             if (t->more)
                 free(t->more);
-            free(t);
         }
-        free(mesh->tris);
     }
 
-    /* free the edges */
-    if (mesh->edges != NULL) {
-        for (i = 0; i < mesh->nedges; i++) {
-            free(mesh->edges[i]);
-        }
-        free(mesh->edges);
-    }
+    /* free the vertices, triangles and edges */
+    clear_mesh_arena(mesh);
+
+    free(mesh->verts);
+    free(mesh->tris);
+    free(mesh->edges);
 
     mesh->ntris = 0;
     mesh->nverts = 0;
@@ -879,6 +900,11 @@ Exit:
 int make_vertex(Mesh* mesh, Vector vec)
 {
     Vertex* vert;
+    Vector pos;
+
+    /* vec may be the position of another vertex of this mesh, which */
+    /* could move if the mesh's arrays grow */
+    vcopy(vec, pos);
 
     /* maybe make room for more vertices */
     if (mesh->nverts == mesh->max_verts) {
@@ -886,33 +912,44 @@ int make_vertex(Mesh* mesh, Vector vec)
         mesh->verts = (Vertex**)
                       realloc(mesh->verts, sizeof(Vertex*) * mesh->max_verts);
     }
+    grow_vert_data(mesh, mesh->nverts + 1);
 
     /* create new vertex and add it to the list */
-    vert = (Vertex*) malloc(sizeof(Vertex));
-    vert->coord[X] = vec[X];
-    vert->coord[Y] = vec[Y];
-    vert->coord[Z] = vec[Z];
+    vert = arena_vertex(mesh);
+    vert->index = mesh->nverts;
+    vert->coord = mesh->coords[vert->index];
+    vert->normal = mesh->normals[vert->index];
+    mesh->hash_next[vert->index] = -1;
+    mesh->hash_prev[vert->index] = NOT_HASHED;
+    mesh->confidence[vert->index] = 0;
+    mesh->intensity[vert->index] = 0;
+    mesh->colors[vert->index][0] = 0;
+    mesh->colors[vert->index][1] = 0;
+    mesh->colors[vert->index][2] = 0;
+
+    vert->coord[X] = pos[X];
+    vert->coord[Y] = pos[Y];
+    vert->coord[Z] = pos[Z];
 
     vert->normal[X] = 0;
     vert->normal[Y] = 0;
     vert->normal[Z] = 0;
 
     vert->ntris = 0;
-    vert->max_tris = 8;
-    vert->index = mesh->nverts;
+    vert->max_tris = VERT_INLINE_TRIS;
     vert->moving = 0;
+    vert->mark_epoch = 0;
     vert->cinfo = NULL;
     vert->old_mesh = mesh;
-    vert->confidence = 0;
-    vert->tris = (Triangle**) malloc(sizeof(Triangle*) * vert->max_tris);
+    vert->tris = vert->tri_space;
 
     vert->nverts = 0;
-    vert->max_verts = 8;
-    vert->verts = (Vertex**) malloc(sizeof(Vertex*) * vert->max_verts);
+    vert->max_verts = VERT_INLINE_VERTS;
+    vert->verts = vert->vert_space;
 
     vert->nedges = 0;
-    vert->max_edges = 0;
-    vert->edges = NULL;
+    vert->max_edges = VERT_INLINE_EDGES;
+    vert->edges = vert->edge_space;
 
     mesh->verts[mesh->nverts] = vert;
     mesh->nverts++;
@@ -921,6 +958,132 @@ int make_vertex(Mesh* mesh, Vector vec)
     return (mesh->nverts - 1);
 }
 
+/******************************************************************************
+Move a vertex to an empty place in its mesh's list of vertices, taking its
+position, normal, hash table links and other attributes along to the same
+place in the mesh's arrays.
+
+Entry:
+  mesh  - mesh of the vertex
+  vert  - vertex to move
+  index - its new place in the list
+******************************************************************************/
+static void move_vertex(Mesh* mesh, Vertex* vert, int index)
+{
+    int old = vert->index;
+
+    if (old == index)
+        return;
+
+    vcopy(mesh->coords[old], mesh->coords[index]);
+    vcopy(mesh->normals[old], mesh->normals[index]);
+    mesh->hash_next[index] = mesh->hash_next[old];
+    mesh->hash_prev[index] = mesh->hash_prev[old];
+    mesh->confidence[index] = mesh->confidence[old];
+    mesh->intensity[index] = mesh->intensity[old];
+    memcpy(mesh->colors[index], mesh->colors[old], sizeof(Color));
+
+    mesh->verts[index] = vert;
+    vert->index = index;
+    vert->coord = mesh->coords[index];
+    vert->normal = mesh->normals[index];
+
+    renumber_in_hash(mesh, index);
+}
+
+/******************************************************************************
+Give a vertex that is leaving a mesh's list of vertices a place of its own
+to keep its position and normal, since other parts of the mesh may still
+look at them.
+
+Entry:
+  mesh - mesh the vertex is leaving
+  vert - the vertex
+******************************************************************************/
+void retire_vertex(Mesh* mesh, Vertex* vert)
+{
+    float* data;
+
+    data = arena_vertex_data(mesh);
+    vcopy(vert->coord, &data[0]);
+    vcopy(vert->normal, &data[3]);
+    vert->coord = &data[0];
+    vert->normal = &data[3];
+}
+
+/******************************************************************************
+Add a vertex from another mesh to the end of a mesh's list of vertices.  Its
+position, normal and other attributes are copied into this mesh's arrays.
+The vertex is not placed in this mesh's hash table.
+
+Entry:
+  mesh - mesh to add to
+  from - mesh the vertex comes from
+  vert - vertex to add
+******************************************************************************/
+void append_vertex(Mesh* mesh, Mesh* from, Vertex* vert)
+{
+    int index;
+
+    /* maybe make room for more vertices */
+    if (mesh->nverts == mesh->max_verts) {
+        mesh->max_verts = (int)(mesh->max_verts * 1.5);
+        mesh->verts = (Vertex**)
+                      realloc(mesh->verts, sizeof(Vertex*) * mesh->max_verts);
+    }
+    grow_vert_data(mesh, mesh->nverts + 1);
+
+    index = mesh->nverts;
+    vcopy(vert->coord, mesh->coords[index]);
+    vcopy(vert->normal, mesh->normals[index]);
+    mesh->hash_next[index] = -1;
+    mesh->hash_prev[index] = NOT_HASHED;
+    mesh->confidence[index] = from->confidence[vert->index];
+    mesh->intensity[index] = from->intensity[vert->index];
+    memcpy(mesh->colors[index], from->colors[vert->index], sizeof(Color));
+
+    vert->index = index;
+    vert->coord = mesh->coords[index];
+    vert->normal = mesh->normals[index];
+
+    /* a mark from the old mesh's epochs means nothing here */
+    vert->mark_epoch = 0;
+
+    mesh->verts[index] = vert;
+    mesh->nverts++;
+}
+
+/******************************************************************************
+Get a blank triangle record for a mesh, without adding it to the mesh.
+
+Entry:
+  mesh        - mesh the triangle will belong to
+  vt1,vt2,vt3 - vertices of the triangle
+
+Exit:
+  returns the triangle, with its geometry not yet computed
+******************************************************************************/
+static Triangle* new_triangle(Mesh* mesh, Vertex* vt1, Vertex* vt2, Vertex* vt3)
+{
+    Triangle* tri;
+
+    tri = arena_triangle(mesh);
+    tri->verts[0] = vt1;
+    tri->verts[1] = vt2;
+    tri->verts[2] = vt3;
+    tri->mark = 0;
+    tri->eat_mark = 0;
+    tri->index = mesh->ntris;
+    tri->more = NULL;
+    tri->planes = NULL;
+    tri->clips = NULL;
+    tri->dont_touch = 0;
+    tri->deleted = 0;
+    tri->mark_epoch = 0;
+
+    return (tri);
+}
+
 /******************************************************************************
 Create a new triangle and add it to the list in a mesh.
 
@@ -947,6 +1110,9 @@ Triangle* make_triangle(Mesh* mesh, Vertex* vt1, Vertex* vt2, Vertex* vt3, float
     if (vlen(v1) > max_len || vlen(v2) > max_len || vlen(v3) > max_len)
         return (NULL);
 
+    /* a triangle tree would no longer cover every triangle */
+    free_tri_tree(mesh);
+
     /* maybe make room for more triangles */
     if (mesh->ntris >= mesh->max_tris) {
         mesh->max_tris = (int)(mesh->max_tris * 1.5);
@@ -959,27 +1125,18 @@ Triangle* make_triangle(Mesh* mesh, Vertex* vt1, Vertex* vt2, Vertex* vt3, float
     vnorm(cross);
 
     /* create new triangle and add it to the list */
-    tri = (Triangle*) malloc(sizeof(Triangle));
-    tri->verts[0] = vt1;
-    tri->verts[1] = vt2;
-    tri->verts[2] = vt3;
-    tri->mark = 0;
-    tri->eat_mark = 0;
-    tri->index = mesh->ntris;
-    tri->more = NULL;
-    tri->clips = NULL;
-    tri->dont_touch = 0;
+    tri = new_triangle(mesh, vt1, vt2, vt3);
     if (set_triangle_geometry(tri) == 1) {
-        free(tri);
+        arena_free_triangle(mesh, tri);
         return NULL;
     }
     mesh->tris[mesh->ntris] = tri;
     mesh->ntris++;
 
     /* add this new triangle to each of its vertices lists */
-    add_tri_to_vert(vt1, tri);
-    add_tri_to_vert(vt2, tri);
-    add_tri_to_vert(vt3, tri);
+    add_tri_to_vert(mesh, vt1, tri);
+    add_tri_to_vert(mesh, vt2, tri);
+    add_tri_to_vert(mesh, vt3, tri);
 
     /* add vertices to other vertices' lists */
     for (i = 0; i < 3; i++) {
@@ -1000,21 +1157,15 @@ Triangle* make_triangle(Mesh* mesh, Vertex* vt1, Vertex* vt2, Vertex* vt3, float
 
         if (!found1) {
             /* maybe allocate more room for vertex list */
-            if (vert->nverts >= vert->max_verts) {
-                vert->max_verts += 4;
-                vert->verts =
-                    (Vertex**) realloc(vert->verts, sizeof(Vertex*) * vert->max_verts);
-            }
+            if (vert->nverts >= vert->max_verts)
+                grow_vertex_verts(mesh, vert);
             vert->verts[vert->nverts++] = tri->verts[(i + 1) % 3];
         }
 
         if (!found2) {
             /* maybe allocate more room for vertex list */
-            if (vert->nverts >= vert->max_verts) {
-                vert->max_verts += 4;
-                vert->verts =
-                    (Vertex**) realloc(vert->verts, sizeof(Vertex*) * vert->max_verts);
-            }
+            if (vert->nverts >= vert->max_verts)
+                grow_vertex_verts(mesh, vert);
             vert->verts[vert->nverts++] = tri->verts[(i + 2) % 3];
         }
     }
@@ -1024,6 +1175,264 @@ Triangle* make_triangle(Mesh* mesh, Vertex* vt1, Vertex* vt2, Vertex* vt3, float
 }
 
 
+/* what the threads of build_mesh_from_arrays() share */
+typedef struct Build_Info {
+    Mesh* mesh;           /* mesh being built */
+    float* coords;        /* vertex positions (3 per vertex) */
+    int* tri_verts;       /* vertex indices (3 per triangle) */
+    float max_len;        /* longest edge a triangle may have */
+    float* planes;        /* plane of each given triangle (4 per triangle) */
+    unsigned char* keep;  /* whether each given triangle goes into the mesh */
+    int* first;           /* start of each vertex's run in adj_vert, adj_tri */
+    int* adj_vert;        /* vertices across the corners' edges, by vertex */
+    int* adj_tri;         /* triangle of each corner, by vertex */
+    int* adj_count;       /* how many triangles share each edge of a vertex */
+    int* nadj;            /* number of different neighbors of each vertex */
+} Build_Info;
+
+/******************************************************************************
+Check the edge lengths and find the planes of a range of the triangles given
+to build_mesh_from_arrays().
+******************************************************************************/
+static void build_tri_planes(int first, int last, int thread, void* data)
+{
+    int i, j;
+    int* tv;
+    float* v[3];
+    Vector d;
+    Build_Info* info = (Build_Info*) data;
+
+    for (i = first; i < last; i++) {
+
+        tv = &info->tri_verts[3 * i];
+        for (j = 0; j < 3; j++)
+            v[j] = &info->coords[3 * tv[j]];
+
+        /* leave out triangles with an edge that is too long */
+        info->keep[i] = 0;
+        for (j = 0; j < 3; j++) {
+            vsub(v[(j + 1) % 3], v[j], d);
+            if (vlen(d) > info->max_len)
+                break;
+        }
+        if (j < 3)
+            continue;
+
+        /* leave out degenerate triangles */
+        if (plane_thru_vectors(v[0], v[1], v[2],
+                               &info->planes[4 * i], &info->planes[4 * i + 1],
+                               &info->planes[4 * i + 2], &info->planes[4 * i + 3]) == 1)
+            continue;
+
+        info->keep[i] = 1;
+    }
+}
+
+/******************************************************************************
+Find the different neighbors of a range of vertices of build_mesh_from_arrays(),
+in the order that make_triangle() would have added them, and whether each
+vertex is on the edge of the mesh.  The neighbors are packed at the start of
+each vertex's run in adj_vert.
+******************************************************************************/
+static void build_vert_neighbors(int first, int last, int thread, void* data)
+{
+    int i, j, k;
+    int start, nadj;
+    int w;
+    unsigned char on_edge;
+    Build_Info* info = (Build_Info*) data;
+
+    for (i = first; i < last; i++) {
+
+        start = info->first[i];
+        nadj = 0;
+
+        for (j = start; j < info->first[i + 1]; j++) {
+            w = info->adj_vert[j];
+            for (k = 0; k < nadj; k++)
+                if (info->adj_vert[start + k] == w)
+                    break;
+            if (k < nadj)
+                info->adj_count[start + k]++;
+            else {
+                info->adj_vert[start + nadj] = w;
+                info->adj_count[start + nadj] = 1;
+                nadj++;
+            }
+        }
+
+        /* an edge with just one triangle puts the vertex on the mesh edge */
+        on_edge = 0;
+        for (k = 0; k < nadj; k++)
+            if (info->adj_count[start + k] == 1)
+                on_edge = 1;
+
+        info->nadj[i] = nadj;
+        info->mesh->verts[i]->on_edge = on_edge;
+    }
+}
+
+/******************************************************************************
+Fill in the triangle and vertex lists and the surface normals of a range of
+vertices of build_mesh_from_arrays().
+******************************************************************************/
+static void build_vert_lists(int first, int last, int thread, void* data)
+{
+    int i, j;
+    int start;
+    Vertex* vert;
+    Build_Info* info = (Build_Info*) data;
+    Mesh* mesh = info->mesh;
+
+    for (i = first; i < last; i++) {
+
+        vert = mesh->verts[i];
+        start = info->first[i];
+
+        /* each corner of a triangle put two entries in the vertex's run */
+        vert->ntris = (info->first[i + 1] - start) / 2;
+        for (j = 0; j < vert->ntris; j++)
+            vert->tris[j] = mesh->tris[info->adj_tri[start + 2 * j]];
+
+        vert->nverts = info->nadj[i];
+        for (j = 0; j < vert->nverts; j++)
+            vert->verts[j] = mesh->verts[info->adj_vert[start + j]];
+
+        find_vertex_normal(vert);
+    }
+}
+
+/******************************************************************************
+Build a mesh all at once from arrays of positions and triangles.  This gives
+the same mesh as calling make_vertex() for each position and make_triangle()
+for each triangle, including the order of each vertex's lists of triangles
+and neighbors.  It also finds the vertex normals and which vertices are on
+the edge of the mesh.  Instead of searching each vertex's list of neighbors
+as every triangle is added, the corners of the triangles are sorted by
+vertex, and the vertices' lists are then made in several threads.
+
+Entry:
+  mesh      - empty mesh to build
+  nverts    - number of vertices
+  coords    - vertex positions (3 per vertex)
+  ntris     - number of triangles
+  tri_verts - indices of the vertices of each triangle (3 per triangle)
+  max_len   - maximum allowed length of a triangle edge
+******************************************************************************/
+void build_mesh_from_arrays(
+    Mesh* mesh, int nverts, float* coords, int ntris, int* tri_verts, float max_len
+) {
+    int i, j, k;
+    int num;
+    int* tv;
+    Triangle* tri;
+    Vertex* vert;
+    Build_Info info;
+
+    /* make the vertices */
+    grow_vert_data(mesh, mesh->nverts + nverts);
+    for (i = 0; i < nverts; i++)
+        make_vertex(mesh, &coords[3 * i]);
+
+    /* decide which triangles to keep, and find their planes */
+    info.mesh = mesh;
+    info.coords = coords;
+    info.tri_verts = tri_verts;
+    info.max_len = max_len;
+    info.planes = (float*) malloc(sizeof(float) * 4 * (ntris + 1));
+    info.keep = (unsigned char*) malloc(sizeof(unsigned char) * (ntris + 1));
+    info.first = (int*) malloc(sizeof(int) * (nverts + 1));
+    info.nadj = (int*) malloc(sizeof(int) * (nverts + 1));
+    if (info.planes == NULL || info.keep == NULL || info.first == NULL ||
+            info.nadj == NULL) {
+        fprintf(stderr, "build_mesh_from_arrays: out of memory\n");
+        exit(-1);
+    }
+
+    parallel_for(ntris, 4096, build_tri_planes, &info);
+
+    /* make the triangles that are kept */
+    free_tri_tree(mesh);
+    if (mesh->max_tris < ntris) {
+        mesh->max_tris = ntris;
+        mesh->tris = (Triangle**)
+                     realloc(mesh->tris, sizeof(Triangle*) * mesh->max_tris);
+    }
+
+    for (i = 0; i < ntris; i++) {
+        if (!info.keep[i])
+            continue;
+        tv = &tri_verts[3 * i];
+        tri = new_triangle(mesh, mesh->verts[tv[0]], mesh->verts[tv[1]],
+                           mesh->verts[tv[2]]);
+        tri->aa = info.planes[4 * i];
+        tri->bb = info.planes[4 * i + 1];
+        tri->cc = info.planes[4 * i + 2];
+        tri->dd = info.planes[4 * i + 3];
+        mesh->tris[mesh->ntris++] = tri;
+    }
+
+    /* sort the corners of the triangles by vertex (a counting sort, which */
+    /* keeps them in triangle order), two entries for each corner: the */
+    /* next vertex around the triangle and then the one after that */
+    for (i = 0; i <= nverts; i++)
+        info.first[i] = 0;
+    for (i = 0; i < mesh->ntris; i++)
+        for (j = 0; j < 3; j++)
+            info.first[mesh->tris[i]->verts[j]->index + 1] += 2;
+    for (i = 0; i < nverts; i++)
+        info.first[i + 1] += info.first[i];
+
+    num = info.first[nverts];
+    info.adj_vert = (int*) malloc(sizeof(int) * (num + 1));
+    info.adj_tri = (int*) malloc(sizeof(int) * (num + 1));
+    info.adj_count = (int*) malloc(sizeof(int) * (num + 1));
+    if (info.adj_vert == NULL || info.adj_tri == NULL || info.adj_count == NULL) {
+        fprintf(stderr, "build_mesh_from_arrays: out of memory\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < mesh->ntris; i++) {
+        tri = mesh->tris[i];
+        for (j = 0; j < 3; j++) {
+            k = info.first[tri->verts[j]->index]++;
+            info.adj_vert[k] = tri->verts[(j + 1) % 3]->index;
+            info.adj_tri[k] = i;
+            info.adj_vert[k + 1] = tri->verts[(j + 2) % 3]->index;
+            info.adj_tri[k + 1] = i;
+            info.first[tri->verts[j]->index]++;
+        }
+    }
+
+    /* the scatter moved each start up to the next vertex's start */
+    for (i = nverts; i > 0; i--)
+        info.first[i] = info.first[i - 1];
+    info.first[0] = 0;
+
+    /* find each vertex's neighbors */
+    parallel_for(nverts, 4096, build_vert_neighbors, &info);
+
+    /* give room outside the vertex to lists that won't fit inside it */
+    for (i = 0; i < nverts; i++) {
+        vert = mesh->verts[i];
+        while (vert->max_tris < (info.first[i + 1] - info.first[i]) / 2)
+            grow_vertex_tris(mesh, vert);
+        while (vert->max_verts < info.nadj[i])
+            grow_vertex_verts(mesh, vert);
+    }
+
+    /* fill in the lists and find the vertex normals */
+    parallel_for(nverts, 4096, build_vert_lists, &info);
+
+    free(info.planes);
+    free(info.keep);
+    free(info.first);
+    free(info.nadj);
+    free(info.adj_vert);
+    free(info.adj_tri);
+    free(info.adj_count);
+}
+
 /******************************************************************************
 Remove a triangle from a mesh.
 
@@ -1042,6 +1451,9 @@ void delete_triangle(Triangle* tri, Mesh* mesh, int dverts)
     int i;
     int index;
 
+    /* the triangle tree would point to the deleted triangle */
+    free_tri_tree(mesh);
+
     /* remove mention of this triangle from its vertices */
     /* (deleting the vertices if they belong to no other triangles) */
     for (i = 0; i < 3; i++)
@@ -1061,7 +1473,201 @@ void delete_triangle(Triangle* tri, Mesh* mesh, int dverts)
     /* free up triangle's memory */
     if (tri->more)
         free(tri->more);
-    free(tri);
+    if (tri->planes)
+        arena_free_edge_planes(mesh, tri->planes);
+    arena_free_triangle(mesh, tri);
+}
+
+/******************************************************************************
+Set up an empty batch of triangles to delete.
+
+Entry:
+  batch - the batch
+******************************************************************************/
+void init_tri_batch(Tri_Batch* batch)
+{
+    batch->tris = NULL;
+    batch->num = 0;
+    batch->max = 0;
+}
+
+/******************************************************************************
+Free the room of a batch of triangles to delete.
+
+Entry:
+  batch - the batch
+******************************************************************************/
+void free_tri_batch(Tri_Batch* batch)
+{
+    free(batch->tris);
+    init_tri_batch(batch);
+}
+
+/******************************************************************************
+Say that a triangle is to be deleted when the batch is deleted.  The
+triangle stays in the mesh until then, but is marked as deleted.
+
+Entry:
+  batch  - the batch
+  tri    - the triangle
+  dverts - flag saying whether to delete vertices that are left without
+           triangles (1 = delete them, 0 = leave them alone)
+******************************************************************************/
+void add_to_tri_batch(Tri_Batch* batch, Triangle* tri, int dverts)
+{
+    /* a triangle is only listed once, deleting vertices if ever asked to */
+    if (tri->deleted) {
+        if (dverts)
+            tri->deleted = 2;
+        return;
+    }
+
+    if (batch->num == batch->max) {
+        batch->max = batch->max * 2 + 64;
+        batch->tris = (Triangle**)
+                      realloc(batch->tris, sizeof(Triangle*) * batch->max);
+        if (batch->tris == NULL) {
+            fprintf(stderr, "add_to_tri_batch: out of memory\n");
+            exit(-1);
+        }
+    }
+
+    tri->deleted = dverts ? 2 : 1;
+    batch->tris[batch->num++] = tri;
+}
+
+/******************************************************************************
+Delete all the triangles of a batch from a mesh.  This leaves the mesh as
+delete_triangle() would for each triangle, except for the order of the
+lists.  Each vertex of the triangles has its lists swept once, and the
+mesh's lists of triangles and vertices are closed up once, keeping the
+index of each triangle and vertex right.  The batch is left empty.
+
+Entry:
+  batch - the triangles to delete
+  mesh  - mesh they belong to
+******************************************************************************/
+void delete_tri_batch(Tri_Batch* batch, Mesh* mesh)
+{
+    int i, j, k;
+    int n;
+    int nvlist;
+    int in_dead, in_live;
+    unsigned char* vflags;
+    Vertex** vlist;
+    Vertex* vert;
+    Vertex* vert2;
+    Triangle* tri;
+
+    if (batch->num == 0)
+        return;
+
+    /* the triangle tree would point to the deleted triangles */
+    free_tri_tree(mesh);
+
+    /* find the vertices of the deleted triangles (flag 1), and which of */
+    /* them may be deleted themselves (flag 2) */
+    vflags = (unsigned char*) calloc(mesh->nverts + 1, sizeof(unsigned char));
+    vlist = (Vertex**) malloc(sizeof(Vertex*) * (3 * batch->num + 1));
+    if (vflags == NULL || vlist == NULL) {
+        fprintf(stderr, "delete_tri_batch: out of memory\n");
+        exit(-1);
+    }
+
+    nvlist = 0;
+    for (i = 0; i < batch->num; i++) {
+        tri = batch->tris[i];
+        for (j = 0; j < 3; j++) {
+            vert = tri->verts[j];
+            if (!vflags[vert->index])
+                vlist[nvlist++] = vert;
+            vflags[vert->index] |= 1;
+            if (tri->deleted == 2)
+                vflags[vert->index] |= 2;
+        }
+    }
+
+    /* sweep the lists of each of these vertices */
+    for (i = 0; i < nvlist; i++) {
+        vert = vlist[i];
+
+        /* drop the neighbors that only shared deleted triangles */
+        for (k = vert->nverts - 1; k >= 0; k--) {
+            vert2 = vert->verts[k];
+            in_dead = 0;
+            in_live = 0;
+            for (j = 0; j < vert->ntris; j++) {
+                tri = vert->tris[j];
+                if (tri->verts[0] != vert2 && tri->verts[1] != vert2 &&
+                        tri->verts[2] != vert2)
+                    continue;
+                if (tri->deleted)
+                    in_dead = 1;
+                else {
+                    in_live = 1;
+                    break;
+                }
+            }
+            if (in_dead && !in_live)
+                vert->verts[k] = vert->verts[--vert->nverts];
+        }
+
+        /* drop the deleted triangles */
+        n = 0;
+        for (j = 0; j < vert->ntris; j++)
+            if (!vert->tris[j]->deleted)
+                vert->tris[n++] = vert->tris[j];
+        vert->ntris = n;
+
+        /* mark this vertex as being on the edge of the mesh */
+        vert->on_edge = 1;
+    }
+
+    /* close up the mesh's list of triangles */
+    n = 0;
+    for (i = 0; i < mesh->ntris; i++) {
+        tri = mesh->tris[i];
+        if (tri->deleted)
+            continue;
+        tri->index = n;
+        mesh->tris[n++] = tri;
+    }
+    mesh->ntris = n;
+
+    /* free up the triangles' memory */
+    for (i = 0; i < batch->num; i++) {
+        tri = batch->tris[i];
+        if (tri->more)
+            free(tri->more);
+        if (tri->planes)
+            arena_free_edge_planes(mesh, tri->planes);
+        arena_free_triangle(mesh, tri);
+    }
+    batch->num = 0;
+
+    /* delete the vertices that are left without triangles (flag 4) */
+    for (i = 0; i < nvlist; i++) {
+        vert = vlist[i];
+        if ((vflags[vert->index] & 2) && vert->ntris == 0) {
+            vflags[vert->index] |= 4;
+            free_vertex_lists(mesh, vert);
+            remove_from_hash(vert, mesh);
+            retire_vertex(mesh, vert);
+        }
+    }
+
+    /* close up the mesh's list of vertices */
+    n = 0;
+    for (i = 0; i < mesh->nverts; i++) {
+        vert = mesh->verts[i];
+        if (vflags[i] & 4)
+            continue;
+        move_vertex(mesh, vert, n++);
+    }
+    mesh->nverts = n;
+
+    free(vflags);
+    free(vlist);
 }
 
 /******************************************************************************
@@ -1197,17 +1803,25 @@ void delete_vertex(Vertex* vert, Mesh* mesh)
 {
     int index;
 
-    /* free up triangle and vertex list */
-    free(vert->tris);
-    free(vert->verts);
+    /* error check */
+    index = vert->index;
+    if (index >= mesh->nverts || mesh->verts[index] != vert) {
+        fprintf(stderr, "delete_vertex: vertex %d isn't in the mesh\n", index);
+        return;
+    }
+
+    /* free up triangle, vertex and edge lists (the vertex itself is kept */
+    /* until the mesh is cleared, since others may still point to it) */
+    free_vertex_lists(mesh, vert);
 
     /* remove this vertex from the hash table */
     remove_from_hash(vert, mesh);
 
     /* overwrite vertex with the last vertex in the list */
-    index = vert->index;
-    mesh->verts[index] = mesh->verts[--mesh->nverts];
-    mesh->verts[index]->index = index;
+    retire_vertex(mesh, vert);
+    mesh->nverts--;
+    if (index != mesh->nverts)
+        move_vertex(mesh, mesh->verts[mesh->nverts], index);
 }
 
 /******************************************************************************
@@ -1365,24 +1979,476 @@ int check_proposed_edge(Vertex* v1, Vertex* v2)
 Add a triangle to the list of triangles of a given vertex.
 
 Entry:
+  mesh - mesh the vertex belongs to
   vert - the vertex whose list is to be expanded
   tri  - the triangle to add to the list
 ******************************************************************************/
-void add_tri_to_vert(Vertex* vert, Triangle* tri)
+void add_tri_to_vert(Mesh* mesh, Vertex* vert, Triangle* tri)
 {
     /* maybe allocate more room for triangle list */
-    if (vert->ntris >= vert->max_tris) {
-        vert->max_tris += 4;
-        vert->tris =
-            (Triangle**) realloc(vert->tris, sizeof(Triangle*) * vert->max_tris);
-    }
+    if (vert->ntris >= vert->max_tris)
+        grow_vertex_tris(mesh, vert);
 
     /* add the triangle to the list */
     vert->tris[vert->ntris++] = tri;
 }
 
 /******************************************************************************
-Compute the geometric information of a triangle from its vertices.
+Move one of a vertex's lists to a larger list.  A list still kept inside the
+vertex is copied out to the arena the first time it fills.
+
+Entry:
+  mesh  - mesh the vertex belongs to
+  list  - the list
+  space - the room for this list inside the vertex
+  num   - number of entries in the list
+  max   - room in the list
+
+Exit:
+  max     - room in the new list
+  returns the new list
+******************************************************************************/
+static void** grow_vertex_list(Mesh* mesh, void** list, void** space, int num, int* max)
+{
+    int i;
+    int room;
+    void** new_list;
+
+    room = list_room(*max + 1);
+
+    if (list == space) {
+        new_list = arena_resize_list(mesh, NULL, 0, 0, room);
+        for (i = 0; i < num; i++)
+            new_list[i] = list[i];
+    }
+    else
+        new_list = arena_resize_list(mesh, list, num, *max, room);
+
+    *max = room;
+    return (new_list);
+}
+
+/******************************************************************************
+Give a vertex's list of triangles more room.
+
+Entry:
+  mesh - mesh the vertex belongs to
+  vert - the vertex
+******************************************************************************/
+void grow_vertex_tris(Mesh* mesh, Vertex* vert)
+{
+    vert->tris = (Triangle**)
+                 grow_vertex_list(mesh, (void**) vert->tris,
+                                  (void**) vert->tri_space, vert->ntris,
+                                  &vert->max_tris);
+}
+
+/******************************************************************************
+Give a vertex's list of neighboring vertices more room.
+
+Entry:
+  mesh - mesh the vertex belongs to
+  vert - the vertex
+******************************************************************************/
+void grow_vertex_verts(Mesh* mesh, Vertex* vert)
+{
+    vert->verts = (Vertex**)
+                  grow_vertex_list(mesh, (void**) vert->verts,
+                                   (void**) vert->vert_space, vert->nverts,
+                                   &vert->max_verts);
+}
+
+/******************************************************************************
+Give a vertex's list of edges more room.
+
+Entry:
+  mesh - mesh the vertex belongs to
+  vert - the vertex
+******************************************************************************/
+void grow_vertex_edges(Mesh* mesh, Vertex* vert)
+{
+    vert->edges = (Edge**)
+                  grow_vertex_list(mesh, (void**) vert->edges,
+                                   (void**) vert->edge_space, vert->nedges,
+                                   &vert->max_edges);
+}
+
+/******************************************************************************
+Give back the lists of a vertex that have outgrown the room inside the
+vertex, and go back to using that room.
+
+Entry:
+  mesh - mesh the vertex belongs to
+  vert - the vertex
+******************************************************************************/
+void free_vertex_lists(Mesh* mesh, Vertex* vert)
+{
+    if (vert->tris != vert->tri_space)
+        arena_free_list(mesh, (void**) vert->tris, vert->max_tris);
+    if (vert->verts != vert->vert_space)
+        arena_free_list(mesh, (void**) vert->verts, vert->max_verts);
+    if (vert->edges != vert->edge_space)
+        arena_free_list(mesh, (void**) vert->edges, vert->max_edges);
+
+    vert->tris = vert->tri_space;
+    vert->verts = vert->vert_space;
+    vert->edges = vert->edge_space;
+    vert->max_tris = VERT_INLINE_TRIS;
+    vert->max_verts = VERT_INLINE_VERTS;
+    vert->max_edges = VERT_INLINE_EDGES;
+}
+
+/******************************************************************************
+Start a new marking epoch for a mesh.  Marks that were stamped with an
+earlier epoch (see TRI_EAT_MARK and friends in zipper.h) are then treated as
+clear, so no loop over the whole mesh is needed to reset them.  Each mesh
+counts its own epochs; vertices and triangles moved in from another mesh
+have their stamps cleared as they are added.
+
+Entry:
+  mesh - the mesh
+
+Exit:
+  returns the new epoch
+******************************************************************************/
+unsigned int new_mark_epoch(Mesh* mesh)
+{
+    int i;
+
+    mesh->mark_epoch++;
+
+    /* on the (very rare) wrap-around, really clear the old stamps */
+    if (mesh->mark_epoch == 0) {
+        mesh->mark_epoch = 1;
+        for (i = 0; i < mesh->ntris; i++)
+            mesh->tris[i]->mark_epoch = 0;
+        for (i = 0; i < mesh->nverts; i++)
+            mesh->verts[i]->mark_epoch = 0;
+    }
+
+    return (mesh->mark_epoch);
+}
+
+/* number of cells along each axis of the box used for reordering a mesh */
+#define ORDER_CELLS (1 << 20)
+
+/* cells of the reordering box along the zipper resolution */
+#define ORDER_CELLS_PER_RESOLUTION 4
+
+/* a vertex or triangle with its place along a Morton curve */
+typedef struct Order_Key {
+    unsigned long long key;   /* position along the curve */
+    int index;                /* position in the mesh's list before sorting */
+} Order_Key;
+
+/******************************************************************************
+Compare two vertices or triangles by their place along the Morton curve,
+for qsort().
+******************************************************************************/
+static int compare_order_keys(const void* p1, const void* p2)
+{
+    const Order_Key* k1 = (const Order_Key*) p1;
+    const Order_Key* k2 = (const Order_Key*) p2;
+
+    if (k1->key < k2->key)
+        return (-1);
+    if (k1->key > k2->key)
+        return (1);
+    return (k1->index - k2->index);
+}
+
+/******************************************************************************
+Find where a position lies along a Morton curve through a box.
+
+Entry:
+  pos    - the position
+  corner - lowest corner of the box
+  scale  - cells per unit length
+
+Exit:
+  returns the position along the curve
+******************************************************************************/
+static unsigned long long order_key(Vector pos, Vector corner, float scale)
+{
+    int i;
+    int cell[3];
+
+    for (i = 0; i < 3; i++) {
+        cell[i] = (int) ((pos[i] - corner[i]) * scale);
+        cell[i] = MAX(0, MIN(ORDER_CELLS - 1, cell[i]));
+    }
+
+    return (morton_key(cell[X], cell[Y], cell[Z]));
+}
+
+/******************************************************************************
+Find the order of a mesh's vertices and triangles along a Morton (Z-order)
+curve.  Triangles are placed by their centers.  Vertices or triangles in the
+same cell of the curve keep their order.
+
+Every mesh uses the same box, centered on the origin and made of cells a
+fraction of the zipper resolution across, rather than a box around its own
+vertices.  Then meshes that were sorted on their own and later gathered
+together agree on the order, and sorting the gathered mesh only merges them
+instead of scattering the records each one had laid out in its arena.
+
+Entry:
+  nverts    - number of vertices
+  coords    - vertex positions (3 per vertex)
+  ntris     - number of triangles
+  tri_verts - indices of the vertices of each triangle (3 per triangle)
+
+Exit:
+  vert_order - which vertex goes in each place (nverts of them)
+  tri_order  - which triangle goes in each place (ntris of them)
+******************************************************************************/
+static void find_curve_order(
+    int nverts, float* coords, int ntris, int* tri_verts, int* vert_order, int* tri_order
+) {
+    int i, j;
+    Vector corner, center;
+    float scale;
+    Order_Key* keys;
+
+    /* the same box for every mesh (positions outside it go in its edge cells) */
+    scale = ORDER_CELLS_PER_RESOLUTION / get_zipper_resolution();
+    for (j = 0; j < 3; j++)
+        corner[j] = -0.5f * ORDER_CELLS / scale;
+
+    keys = (Order_Key*) malloc(sizeof(Order_Key) * (MAX(nverts, ntris) + 1));
+
+    /* sort the vertices along the curve */
+
+    for (i = 0; i < nverts; i++) {
+        keys[i].key = order_key(&coords[3 * i], corner, scale);
+        keys[i].index = i;
+    }
+    qsort(keys, nverts, sizeof(Order_Key), compare_order_keys);
+    for (i = 0; i < nverts; i++)
+        vert_order[i] = keys[i].index;
+
+    /* sort the triangles by their centers */
+
+    for (i = 0; i < ntris; i++) {
+        for (j = 0; j < 3; j++)
+            center[j] = (coords[3 * tri_verts[3 * i] + j] +
+                         coords[3 * tri_verts[3 * i + 1] + j] +
+                         coords[3 * tri_verts[3 * i + 2] + j]) / 3;
+        keys[i].key = order_key(center, corner, scale);
+        keys[i].index = i;
+    }
+    qsort(keys, ntris, sizeof(Order_Key), compare_order_keys);
+    for (i = 0; i < ntris; i++)
+        tri_order[i] = keys[i].index;
+
+    free(keys);
+}
+
+/******************************************************************************
+Sort the positions and triangles that a mesh is about to be built from along
+a Morton (Z-order) curve.  Building the mesh from the sorted arrays then puts
+vertices and triangles that are near each other in space near each other in
+memory, both in the mesh's lists and in the mesh's arena.  Does nothing unless
+turned on with set_spatial_reorder().
+
+Entry:
+  nverts    - number of vertices
+  coords    - vertex positions (3 per vertex), to be sorted
+  ntris     - number of triangles
+  tri_verts - indices of the vertices of each triangle (3 per triangle),
+              to be sorted and given the new vertex indices
+******************************************************************************/
+void order_mesh_arrays(int nverts, float* coords, int ntris, int* tri_verts)
+{
+    int i, j;
+    int* vert_order;
+    int* tri_order;
+    int* new_index;
+    float* new_coords;
+    int* new_tri_verts;
+
+    if (!SPATIAL_REORDER || nverts == 0)
+        return;
+
+    vert_order = (int*) malloc(sizeof(int) * (nverts + 1));
+    tri_order = (int*) malloc(sizeof(int) * (ntris + 1));
+    find_curve_order(nverts, coords, ntris, tri_verts, vert_order, tri_order);
+
+    /* put the vertices in order */
+
+    new_index = (int*) malloc(sizeof(int) * nverts);
+    new_coords = (float*) malloc(sizeof(float) * 3 * nverts);
+    for (i = 0; i < nverts; i++) {
+        new_index[vert_order[i]] = i;
+        vcopy(&coords[3 * vert_order[i]], &new_coords[3 * i]);
+    }
+    memcpy(coords, new_coords, sizeof(float) * 3 * nverts);
+
+    /* put the triangles in order, with the new vertex indices */
+
+    new_tri_verts = (int*) malloc(sizeof(int) * (3 * ntris + 1));
+    for (i = 0; i < ntris; i++)
+        for (j = 0; j < 3; j++)
+            new_tri_verts[3 * i + j] = new_index[tri_verts[3 * tri_order[i] + j]];
+    memcpy(tri_verts, new_tri_verts, sizeof(int) * 3 * ntris);
+
+    free(new_tri_verts);
+    free(new_coords);
+    free(new_index);
+    free(tri_order);
+    free(vert_order);
+}
+
+/******************************************************************************
+Sort the lists of vertices and triangles of a mesh that has already been
+built along a Morton (Z-order) curve, the way order_mesh_arrays() does
+before a mesh is built.  This is for meshes that have been put together
+from others, such as by gather_triangles().
+
+The vertex and triangle records stay where they are, but the positions,
+normals, hash table links and other attributes of the vertices move along
+with them, so the neighbor searches and the loops over the mesh's lists
+read memory in curve order.  The points of each hash cell keep their order,
+so searches give the same answers as before.
+
+Entry:
+  mesh - mesh to sort
+******************************************************************************/
+void order_mesh(Mesh* mesh)
+{
+    int i, j;
+    int k;
+    int nverts = mesh->nverts;
+    int ntris = mesh->ntris;
+    int* vert_order;
+    int* tri_order;
+    int* tri_verts;
+    int* new_index;
+    Vertex** new_verts;
+    Triangle** new_tris;
+    Vector* new_coords;
+    Vector* new_normals;
+    int* new_next;
+    int* new_prev;
+    float* new_conf;
+    float* new_intensity;
+    Color* new_colors;
+    Hash_Table* table = mesh->table;
+    Vertex* vert;
+
+    if (nverts == 0)
+        return;
+
+    /* the frozen table and triangle tree would be out of date */
+    thaw_table(mesh);
+    free_tri_tree(mesh);
+
+    /* find the new order */
+
+    tri_verts = (int*) malloc(sizeof(int) * (3 * ntris + 1));
+    for (i = 0; i < ntris; i++)
+        for (j = 0; j < 3; j++)
+            tri_verts[3 * i + j] = mesh->tris[i]->verts[j]->index;
+
+    vert_order = (int*) malloc(sizeof(int) * (nverts + 1));
+    tri_order = (int*) malloc(sizeof(int) * (ntris + 1));
+    find_curve_order(nverts, (float*) mesh->coords, ntris, tri_verts,
+                     vert_order, tri_order);
+    free(tri_verts);
+
+    /* move the vertices and what is kept for them by index */
+
+    new_index = (int*) malloc(sizeof(int) * nverts);
+    new_verts = (Vertex**) malloc(sizeof(Vertex*) * mesh->max_verts);
+    new_coords = (Vector*) malloc(sizeof(Vector) * mesh->max_vert_data);
+    new_normals = (Vector*) malloc(sizeof(Vector) * mesh->max_vert_data);
+    new_next = (int*) malloc(sizeof(int) * mesh->max_vert_data);
+    new_prev = (int*) malloc(sizeof(int) * mesh->max_vert_data);
+    new_conf = (float*) malloc(sizeof(float) * mesh->max_vert_data);
+    new_intensity = (float*) malloc(sizeof(float) * mesh->max_vert_data);
+    new_colors = (Color*) malloc(sizeof(Color) * mesh->max_vert_data);
+    if (new_index == NULL || new_verts == NULL || new_coords == NULL ||
+            new_normals == NULL || new_next == NULL || new_prev == NULL ||
+            new_conf == NULL || new_intensity == NULL || new_colors == NULL) {
+        fprintf(stderr, "order_mesh: can't allocate room for %d vertices\n", nverts);
+        exit(-1);
+    }
+
+    for (i = 0; i < nverts; i++)
+        new_index[vert_order[i]] = i;
+
+    for (i = 0; i < nverts; i++) {
+        k = vert_order[i];
+        new_verts[i] = mesh->verts[k];
+        vcopy(mesh->coords[k], new_coords[i]);
+        vcopy(mesh->normals[k], new_normals[i]);
+        new_conf[i] = mesh->confidence[k];
+        new_intensity[i] = mesh->intensity[k];
+        memcpy(new_colors[i], mesh->colors[k], sizeof(Color));
+
+        /* hash links to other vertices get their new indices (HASH_HEAD */
+        /* and NOT_HASHED are negative and stay as they are) */
+        new_next[i] = mesh->hash_next[k];
+        if (new_next[i] >= 0)
+            new_next[i] = new_index[new_next[i]];
+        new_prev[i] = mesh->hash_prev[k];
+        if (new_prev[i] >= 0)
+            new_prev[i] = new_index[new_prev[i]];
+    }
+
+    if (table != NULL && table->cells != NULL)
+        for (i = 0; i < table->num_entries; i++)
+            if (table->cells[i] >= 0)
+                table->cells[i] = new_index[table->cells[i]];
+
+    free(mesh->verts);
+    free(mesh->coords);
+    free(mesh->normals);
+    free(mesh->hash_next);
+    free(mesh->hash_prev);
+    free(mesh->confidence);
+    free(mesh->intensity);
+    free(mesh->colors);
+    mesh->verts = new_verts;
+    mesh->coords = new_coords;
+    mesh->normals = new_normals;
+    mesh->hash_next = new_next;
+    mesh->hash_prev = new_prev;
+    mesh->confidence = new_conf;
+    mesh->intensity = new_intensity;
+    mesh->colors = new_colors;
+
+    for (i = 0; i < nverts; i++) {
+        vert = mesh->verts[i];
+        vert->index = i;
+        vert->coord = mesh->coords[i];
+        vert->normal = mesh->normals[i];
+    }
+
+    /* put the triangles in order */
+
+    new_tris = (Triangle**) malloc(sizeof(Triangle*) * mesh->max_tris);
+    if (new_tris == NULL) {
+        fprintf(stderr, "order_mesh: can't allocate room for %d triangles\n", ntris);
+        exit(-1);
+    }
+    for (i = 0; i < ntris; i++) {
+        new_tris[i] = mesh->tris[tri_order[i]];
+        new_tris[i]->index = i;
+    }
+    free(mesh->tris);
+    mesh->tris = new_tris;
+
+    free(new_index);
+    free(tri_order);
+    free(vert_order);
+}
+
+/******************************************************************************
+Compute the geometric information of a triangle from its vertices.  Only the
+plane of the triangle is found here.  The edge planes are found when first
+asked for (see tri_edge_planes), or right away if the triangle already had
+them.
 ******************************************************************************/
 int set_triangle_geometry(Triangle* tri)
 {
@@ -1400,10 +2466,92 @@ int set_triangle_geometry(Triangle* tri)
       tri->normal[Z] = -tri->cc;
     */
 
-    result = compute_edge_planes(tri);
+    if (tri->planes != NULL)
+        result = compute_edge_planes(tri, tri->planes);
     return result;
 }
 
+/******************************************************************************
+Get the planes through the edges of a triangle, finding them if this is the
+first time they are asked for.  Most triangles never are, except during the
+searches that make them all first (see make_edge_planes).
+
+Entry:
+  mesh - mesh the triangle belongs to (whose arena holds the planes)
+  tri  - the triangle
+
+Exit:
+  returns the edge planes
+******************************************************************************/
+Edge_Planes* tri_edge_planes(Mesh* mesh, Triangle* tri)
+{
+    Edge_Planes* planes;
+
+    if (tri->planes != NULL)
+        return (tri->planes);
+
+    /* the arena isn't safe to use from several threads at once */
+    parallel_lock();
+    planes = tri->planes;
+    if (planes == NULL) {
+        planes = arena_edge_planes(mesh);
+        compute_edge_planes(tri, planes);
+        tri->planes = planes;
+    }
+    parallel_unlock();
+
+    return (planes);
+}
+
+/******************************************************************************
+Find the edge planes of a range of the triangles that make_edge_planes() has
+just given room for.
+******************************************************************************/
+static void make_tri_edge_planes(int first, int last, int thread, void* data)
+{
+    int i;
+    Triangle** tris = (Triangle**) data;
+
+    for (i = first; i < last; i++)
+        compute_edge_planes(tris[i], tris[i]->planes);
+}
+
+/******************************************************************************
+Make sure every triangle of a mesh has its edge planes, so that searches
+running in several threads at once only read them.  The room for the planes
+is taken from the mesh's arena first, and then the planes are found in
+several threads.
+
+Entry:
+  mesh - the mesh
+******************************************************************************/
+void make_edge_planes(Mesh* mesh)
+{
+    int i;
+    int num;
+    Triangle** tris;
+    Triangle* tri;
+
+    tris = (Triangle**) malloc(sizeof(Triangle*) * (mesh->ntris + 1));
+    if (tris == NULL) {
+        fprintf(stderr, "make_edge_planes: out of memory\n");
+        exit(-1);
+    }
+
+    num = 0;
+    for (i = 0; i < mesh->ntris; i++) {
+        tri = mesh->tris[i];
+        if (tri->planes == NULL) {
+            tri->planes = arena_edge_planes(mesh);
+            tris[num++] = tri;
+        }
+    }
+
+    parallel_for(num, 4096, make_tri_edge_planes, tris);
+
+    free(tris);
+}
+
 /******************************************************************************
 Determine equation of the plane containing three vectors.
 
@@ -1455,8 +2603,12 @@ to the plane containing the triangle.
 
 Entry:
   tri - triangle to compute edge planes for
+
+Exit:
+  planes  - the edge planes
+  returns 1 if an edge is degenerate, 0 otherwise
 ******************************************************************************/
-int compute_edge_planes(Triangle* tri)
+int compute_edge_planes(Triangle* tri, Edge_Planes* planes)
 {
     int i;
     Vector v;
@@ -1482,51 +2634,37 @@ int compute_edge_planes(Triangle* tri)
 
         /* points in polygon are positive when plugged into plane equation */
         if (v2[X] * a + v2[Y] * b + v2[Z] * c + d > 0) {
-            tri->a[i] = a;
-            tri->b[i] = b;
-            tri->c[i] = c;
-            tri->d[i] = d;
+            planes->a[i] = a;
+            planes->b[i] = b;
+            planes->c[i] = c;
+            planes->d[i] = d;
         } else {
-            tri->a[i] = -a;
-            tri->b[i] = -b;
-            tri->c[i] = -c;
-            tri->d[i] = -d;
+            planes->a[i] = -a;
+            planes->b[i] = -b;
+            planes->c[i] = -c;
+            planes->d[i] = -d;
         }
     }
     return 0;
 }
 
 /******************************************************************************
-Calculate vertex normals by averaging the normals of the vertice's triangles.
-
-Entry:
-  mesh - mesh to find vertex normals for
-******************************************************************************/
-void find_vertex_normals(Mesh* mesh)
-{
-    int i;
-
-    /* go through all vertices of the mesh */
-    for (i = 0; i < mesh->nverts; i++)
-        find_vertex_normal(mesh->verts[i]);
-}
-
-/******************************************************************************
-Find normal at a vertex.
+Find the normal at a vertex from the planes of its triangles.
 
 Entry:
-  vert - vertex at which to find surface normal
+  vert   - vertex at which to find surface normal
+  normal - where to put the normal
 ******************************************************************************/
-void find_vertex_normal(Vertex* vert)
+static void sum_triangle_normals(Vertex* vert, float* normal)
 {
     int j;
     Vector sum;
 
     /* special case for vertices with NO triangles */
     if (vert->ntris == 0) {
-        vert->normal[X] = 0;
-        vert->normal[Y] = 0;
-        vert->normal[Z] = 0;
+        normal[X] = 0;
+        normal[Y] = 0;
+        normal[Z] = 0;
         return;
     }
 
@@ -1544,7 +2682,111 @@ void find_vertex_normal(Vertex* vert)
 
     /* normalize this sum of normals and save it away */
     vnorm(sum);
-    vcopy(sum, vert->normal);
+    vcopy(sum, normal);
+}
+
+/******************************************************************************
+Find normal at a vertex.
+
+Entry:
+  vert - vertex at which to find surface normal
+******************************************************************************/
+void find_vertex_normal(Vertex* vert)
+{
+    sum_triangle_normals(vert, vert->normal);
+}
+
+/* the triangles and vertices given to refresh_geometry() */
+typedef struct Refresh_Info {
+    Triangle** tris;
+    Vertex** verts;
+} Refresh_Info;
+
+/******************************************************************************
+Find the geometry of a range of the triangles given to refresh_geometry().
+******************************************************************************/
+static void refresh_tri_range(int first, int last, int thread, void* data)
+{
+    int i;
+    Refresh_Info* info = (Refresh_Info*) data;
+
+    for (i = first; i < last; i++)
+        set_triangle_geometry(info->tris[i]);
+}
+
+/******************************************************************************
+Find the normals of a range of the vertices given to refresh_geometry().
+******************************************************************************/
+static void refresh_vert_range(int first, int last, int thread, void* data)
+{
+    int i;
+    Refresh_Info* info = (Refresh_Info*) data;
+
+    for (i = first; i < last; i++)
+        find_vertex_normal(info->verts[i]);
+}
+
+/******************************************************************************
+Bring the geometry of some triangles and vertices up to date after vertices
+have moved: first the planes (and edge planes, if any) of the triangles,
+then the normals of the vertices.  Each is done in several threads.
+
+Only the triangles and vertices given are changed, so a caller that knows
+which ones moved can pass just those: the triangles that use a moved
+vertex, and the vertices of those triangles.
+
+Entry:
+  tris   - triangles to find the geometry of
+  ntris  - number of triangles
+  verts  - vertices to find the normals of
+  nverts - number of vertices
+******************************************************************************/
+void refresh_geometry(Triangle** tris, int ntris, Vertex** verts, int nverts)
+{
+    Refresh_Info info;
+
+    info.tris = tris;
+    info.verts = verts;
+
+    /* the normals are found from the triangles' planes, so these go first */
+    parallel_for(ntris, 4096, refresh_tri_range, &info);
+    parallel_for(nverts, 4096, refresh_vert_range, &info);
+}
+
+/******************************************************************************
+Bring the geometry of all the triangles and vertices of a mesh up to date.
+
+Entry:
+  mesh - the mesh
+******************************************************************************/
+void refresh_mesh_geometry(Mesh* mesh)
+{
+    refresh_geometry(mesh->tris, mesh->ntris, mesh->verts, mesh->nverts);
+}
+
+/******************************************************************************
+Find the normals of a range of a mesh's vertices, straight into the mesh's
+array of normals.
+******************************************************************************/
+static void mesh_normal_range(int first, int last, int thread, void* data)
+{
+    int i;
+    Mesh* mesh = (Mesh*) data;
+
+    for (i = first; i < last; i++)
+        sum_triangle_normals(mesh->verts[i], mesh->normals[i]);
+}
+
+/******************************************************************************
+Calculate vertex normals by averaging the normals of the vertice's triangles.
+
+Entry:
+  mesh - mesh to find vertex normals for
+******************************************************************************/
+void find_vertex_normals(Mesh* mesh)
+{
+    /* go through all vertices of the mesh */
+    parallel_for(mesh->nverts, 4096, mesh_normal_range, mesh);
 }
 
 /******************************************************************************
@@ -1645,7 +2887,8 @@ void clean_up_mesh(Scan* scan)
     int abnormal, num_adj;
     int nverts;
     int num;
-    static Vertex* near_verts[100];
+    static Vertex** near_verts = NULL;
+    static int max_near = 0;
     static Triangle* near_tris[3];
 
     mesh = scan->meshes[mesh_level];
@@ -1712,6 +2955,11 @@ void clean_up_mesh(Scan* scan)
 
             /* save a list of adjacent vertices */
             nverts = vert->nverts;
+            if (nverts > max_near) {
+                max_near = nverts;
+                near_verts = (Vertex**)
+                             realloc(near_verts, sizeof(Vertex*) * max_near);
+            }
             for (j = 0; j < nverts; j++)
                 near_verts[j] = vert->verts[j];
 
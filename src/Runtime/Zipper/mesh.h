@@ -31,6 +31,7 @@
 // Internal
 #include "zipper.h"
 #include "matrix.h"
+#include "arena.h"
 
 // Parameters
 void set_conf_edge_count_factor(float factor);
@@ -41,6 +42,17 @@ void set_conf_exponent(float factor);
 float get_conf_edge_count_factor();
 void set_conf_edge_zero(int set);
 int get_conf_edge_zero();
+void set_spatial_reorder(int set);
+int get_spatial_reorder();
+void set_gather_reorder(int set);
+int get_gather_reorder();
+
+// Triangles to be deleted from a mesh all at once, owned by the caller
+typedef struct Tri_Batch {
+    Triangle** tris;      /* the triangles */
+    int num;              /* number of triangles */
+    int max;              /* room in tris */
+} Tri_Batch;
 
 // Declarations
 void create_scan_mesh(Scan* sc, int level);
@@ -50,17 +62,37 @@ void vertex_errors(Mesh* mesh, Scan* scan, int rot_flag, int mult);
 void lower_edge_confidence(Mesh* mesh, int level);
 void clear_mesh(Mesh* mesh);
 int make_vertex(Mesh* mesh, Vector vec);
+void retire_vertex(Mesh* mesh, Vertex* vert);
+void append_vertex(Mesh* mesh, Mesh* from, Vertex* vert);
 Triangle* make_triangle(Mesh* mesh, Vertex* vt1, Vertex* vt2, Vertex* vt3, float max_len);
+void build_mesh_from_arrays(
+    Mesh* mesh, int nverts, float* coords, int ntris, int* tri_verts, float max_len
+);
 void delete_triangle(Triangle* tri, Mesh* mesh, int dverts);
+void init_tri_batch(Tri_Batch* batch);
+void free_tri_batch(Tri_Batch* batch);
+void add_to_tri_batch(Tri_Batch* batch, Triangle* tri, int dverts);
+void delete_tri_batch(Tri_Batch* batch, Mesh* mesh);
 void remove_tri_from_vert(Vertex* vert, Triangle* tri, int num, Mesh* mesh, int dverts);
 void delete_vertex(Vertex* vert, Mesh* mesh);
 void remove_unused_verts(Mesh* mesh);
 int check_proposed_tri(Vertex* v1, Vertex* v2, Vertex* v3);
 int check_proposed_edge(Vertex* v1, Vertex* v2);
-void add_tri_to_vert(Vertex* vert, Triangle* tri);
+void add_tri_to_vert(Mesh* mesh, Vertex* vert, Triangle* tri);
+void grow_vertex_tris(Mesh* mesh, Vertex* vert);
+void grow_vertex_verts(Mesh* mesh, Vertex* vert);
+void grow_vertex_edges(Mesh* mesh, Vertex* vert);
+void free_vertex_lists(Mesh* mesh, Vertex* vert);
+unsigned int new_mark_epoch(Mesh* mesh);
+void order_mesh_arrays(int nverts, float* coords, int ntris, int* tri_verts);
+void order_mesh(Mesh* mesh);
 int set_triangle_geometry(Triangle* tri);
 int plane_thru_vectors(Vector v0, Vector v1, Vector v2, float* aa, float* bb, float* cc, float* dd);
-int compute_edge_planes(Triangle* tri);
+int compute_edge_planes(Triangle* tri, Edge_Planes* planes);
+Edge_Planes* tri_edge_planes(Mesh* mesh, Triangle* tri);
+void make_edge_planes(Mesh* mesh);
+void refresh_geometry(Triangle** tris, int ntris, Vertex** verts, int nverts);
+void refresh_mesh_geometry(Mesh* mesh);
 void find_vertex_normals(Mesh* mesh);
 void find_vertex_normal(Vertex* vert);
 void find_mesh_edges(Mesh* mesh);
@@ -889,6 +889,7 @@ void remove_sliver_tris(Scan* scan, float fract)
     float edge_length_max(int level);
     float min;
     Triangle* tri;
+    Edge_Planes* planes;
     int removed;
 
     mesh = scan->meshes[mesh_level];
@@ -906,9 +907,10 @@ void remove_sliver_tris(Scan* scan, float fract)
         v3 = tri->verts[2]->coord;
 
         /* find altitudes of the triangle */
-        d1 = v1[X] * tri->a[1] + v1[Y] * tri->b[1] + v1[Z] * tri->c[1] + tri->d[1];
-        d2 = v2[X] * tri->a[2] + v2[Y] * tri->b[2] + v2[Z] * tri->c[2] + tri->d[2];
-        d3 = v3[X] * tri->a[0] + v3[Y] * tri->b[0] + v3[Z] * tri->c[0] + tri->d[0];
+        planes = tri_edge_planes(mesh, tri);
+        d1 = v1[X] * planes->a[1] + v1[Y] * planes->b[1] + v1[Z] * planes->c[1] + planes->d[1];
+        d2 = v2[X] * planes->a[2] + v2[Y] * planes->b[2] + v2[Z] * planes->c[2] + planes->d[2];
+        d3 = v3[X] * planes->a[0] + v3[Y] * planes->b[0] + v3[Z] * planes->c[0] + planes->d[0];
 
         /* see if any altitude is too small */
 
@@ -1676,17 +1678,11 @@ void smooth_vertices(Scan* sc)
     /* change the positions */
     for (i = 0; i < mesh->nverts; i++) {
         v = mesh->verts[i];
-        remove_from_hash(v, mesh);
         vcopy(v->normal, v->coord);
-        add_to_hash(v, mesh);
     }
+    rehash_table(mesh);
 
-    /* fix the triangle geometry */
-    for (i = 0; i < mesh->ntris; i++)
-        set_triangle_geometry(mesh->tris[i]);
-
-    /* find the correct normals */
-    for (i = 0; i < mesh->nverts; i++)
-        find_vertex_normal(mesh->verts[i]);
+    /* fix the triangle geometry, then find the correct normals */
+    refresh_mesh_geometry(mesh);
 }
 
@@ -32,14 +32,137 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/* vector unit used to scan the points of hash cells */
+#if defined(__AVX2__) && (defined(__x86_64__) || defined(_M_X64))
+#define NEAR_AVX2
+#define NEAR_LANES 8
+#elif defined(__SSE4_1__) && defined(__x86_64__)
+#define NEAR_SSE4
+#define NEAR_LANES 4
+#endif
+
+#if defined(NEAR_AVX2) || defined(NEAR_SSE4)
+#include <immintrin.h>
+#endif
+
 // Internal
 #include "near.h"
 #include "draw.h"
+#include "mesh.h"
+#include "tritree.h"
+#include "parallel.h"
+
+/******************************************************************************
+Pick the number of cells for a hash table that will hold a given number of
+points.  The size is a prime so that the cell hash spreads well.
+
+Entry:
+  npoints - number of points the table should hold
+
+Exit:
+  returns number of hash cells
+******************************************************************************/
+static int table_size(int npoints)
+{
+    int size;
+    int i;
+
+    size = npoints / TABLE_LOAD;
+    if (size < TABLE_MIN_SIZE)
+        size = TABLE_MIN_SIZE;
+
+    /* look for the next prime */
+    size |= 1;
+    for (;;) {
+        for (i = 3; i * i <= size; i += 2)
+            if (size % i == 0)
+                break;
+        if (i * i > size)
+            return (size);
+        size += 2;
+    }
+}
+
+/******************************************************************************
+Put a vertex at the front of a hash cell's list.  The lists are kept by
+vertex index in the mesh's hash_next and hash_prev arrays, and each vertex
+remembers the one before it (or its cell, if it is first) so that it can be
+taken out without a search.
+
+Entry:
+  mesh  - mesh of the vertex
+  cells - the hash cells
+  cell  - cell to put the vertex in
+  index - index of vertex to add
+******************************************************************************/
+static void link_vertex(Mesh* mesh, int* cells, int cell, int index)
+{
+    int next = cells[cell];
+
+    mesh->hash_next[index] = next;
+    mesh->hash_prev[index] = HASH_HEAD(cell);
+    if (next != -1)
+        mesh->hash_prev[next] = index;
+    cells[cell] = index;
+}
+
+/******************************************************************************
+Find which hash cell a position falls in.
+******************************************************************************/
+static int cell_of(Hash_Table* table, float* pos, int size)
+{
+    int a, b, c;
+    float scale = table->scale;
+
+    a = floor(pos[X] * scale);
+    b = floor(pos[Y] * scale);
+    c = floor(pos[Z] * scale);
+    return (CELL_INDEX(a, b, c, size));
+}
+
+/******************************************************************************
+Re-distribute the points of a hash table into a different number of cells.
+
+Entry:
+  mesh - mesh whose hash table to resize
+  size - new number of cells
+******************************************************************************/
+static void resize_table(Mesh* mesh, int size)
+{
+    int i;
+    int ptr, next;
+    int* cells;
+    Hash_Table* table = mesh->table;
+
+    cells = (int*) malloc(sizeof(int) * size);
+    if (cells == NULL) {
+        fprintf(stderr, "resize_table: can't allocate %d hash cells\n", size);
+        return;
+    }
+
+    for (i = 0; i < size; i++)
+        cells[i] = -1;
+
+    /* move each point from the old cells to the new ones */
+
+    for (i = 0; i < table->num_entries; i++)
+        for (ptr = table->cells[i]; ptr != -1; ptr = next) {
+            next = mesh->hash_next[ptr];
+            link_vertex(mesh, cells, cell_of(table, mesh->coords[ptr], size), ptr);
+        }
+
+    free(table->cells);
+    table->cells = cells;
+    table->num_entries = size;
+    table->max_points = size * TABLE_MAX_LOAD;
+}
 
 /******************************************************************************
 Initialize a uniform spatial subdivision table.  This structure divides
 3-space into cubical cells and deposits points into their appropriate
 cells.  It uses hashing to make the table a one-dimensional array.
+The number of hash cells follows the number of points, and grows as
+points are added (see add_to_hash).
 
 Entry:
   mesh - mesh that contains points to place in table
@@ -48,48 +171,36 @@ Entry:
 void init_table(Mesh* mesh, float size)
 {
     int i;
-    int index;
-    int a, b, c;
     Hash_Table* table;
-    float scale;
 
     /* allocate new hash table */
 
     table = (Hash_Table*) malloc(sizeof(Hash_Table));
 
-    if (mesh->nverts < TABLE_SIZE1)
-        table->num_entries = TABLE_SIZE1;
-    else if (mesh->nverts < TABLE_SIZE2)
-        table->num_entries = TABLE_SIZE2;
-    else
-        table->num_entries = TABLE_SIZE3;
+    table->num_entries = table_size(mesh->nverts);
+    table->max_points = table->num_entries * TABLE_MAX_LOAD;
+    table->npoints = mesh->nverts;
+    table->sorted = NULL;
 
-    table->verts = (Vertex**) malloc(sizeof(Vertex*) * table->num_entries);
+    table->cells = (int*) malloc(sizeof(int) * table->num_entries);
     mesh->table = table;
 
-    /* set all table elements to NULL */
+    /* set all table elements to empty */
     for (i = 0; i < table->num_entries; i++)
-        table->verts[i] = NULL;
+        table->cells[i] = -1;
 
     /* place each point in table */
 
-    scale = 1 / size;
-    table->scale = scale;
+    table->scale = 1 / size;
 
-    for (i = 0; i < mesh->nverts; i++) {
-        a = floor(mesh->verts[i]->coord[X] * scale);
-        b = floor(mesh->verts[i]->coord[Y] * scale);
-        c = floor(mesh->verts[i]->coord[Z] * scale);
-        index = (a * PR1 + b * PR2 + c) % table->num_entries;
-        if (index < 0)
-            index += table->num_entries;
-        mesh->verts[i]->next = table->verts[index];
-        table->verts[index] = mesh->verts[i];
-    }
+    for (i = 0; i < mesh->nverts; i++)
+        link_vertex(mesh, table->cells,
+                    cell_of(table, mesh->coords[i], table->num_entries), i);
 }
 
 /******************************************************************************
-Add a vertex to it's hash table.
+Add a vertex to it's hash table.  The table is given more cells if it
+has become too full.
 
 Entry:
   vert - vertex to add
@@ -97,26 +208,26 @@ Entry:
 ******************************************************************************/
 void add_to_hash(Vertex* vert, Mesh* mesh)
 {
-    int index;
-    int a, b, c;
     Hash_Table* table;
-    float scale;
 
     table = mesh->table;
-    scale = table->scale;
 
-    a = floor(vert->coord[X] * scale);
-    b = floor(vert->coord[Y] * scale);
-    c = floor(vert->coord[Z] * scale);
-    index = (a * PR1 + b * PR2 + c) % table->num_entries;
-    if (index < 0)
-        index += table->num_entries;
-    vert->next = table->verts[index];
-    table->verts[index] = vert;
+    /* a frozen copy of the table would now be out of date */
+    if (table->sorted != NULL)
+        thaw_table(mesh);
+
+    /* grow the table if the cells are getting crowded */
+    table->npoints++;
+    if (table->npoints > table->max_points)
+        resize_table(mesh, table_size(table->npoints));
+
+    link_vertex(mesh, table->cells,
+                cell_of(table, vert->coord, table->num_entries), vert->index);
 }
 
 /******************************************************************************
-Remove a vertex from the hash table.
+Remove a vertex from the hash table.  The vertex need not be at the position
+it was added at.
 
 Entry:
   vert - vertex to remove from hash table
@@ -124,53 +235,671 @@ Entry:
 ******************************************************************************/
 void remove_from_hash(Vertex* vert, Mesh* mesh)
 {
-    int index;
-    int a, b, c;
+    int index = vert->index;
+    int prev, next;
     Hash_Table* table;
-    float scale;
-    int found;
-    Vertex* ptr;
 
     table = mesh->table;
-    scale = table->scale;
-
-    /* determine which hash cell vertex is in */
-    a = floor(vert->coord[X] * scale);
-    b = floor(vert->coord[Y] * scale);
-    c = floor(vert->coord[Z] * scale);
-    index = (a * PR1 + b * PR2 + c) % table->num_entries;
-    if (index < 0)
-        index += table->num_entries;
-
-    /* see if this vertex is the first one in the hash cell */
-    if (table->verts[index] == vert) {
-        table->verts[index] = vert->next;
+
+    /* error check */
+    if (index < 0 || index >= mesh->nverts || mesh->verts[index] != vert ||
+        mesh->hash_prev[index] == NOT_HASHED) {
+        fprintf(stderr, "remove_from_hash: vertex isn't in the table\n");
+        printf("index = %d, x y z = %f %f %f\n", vert->index,
+               vert->coord[X], vert->coord[Y], vert->coord[Z]);
         return;
     }
 
-    /* look for pointer to this vertex */
-    found = 0;
-    for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
-        if (ptr->next == vert) {
-            found = 1;
-            break;
+    /* a frozen copy of the table would now be out of date */
+    if (table->sorted != NULL)
+        thaw_table(mesh);
+
+    /* unlink the vertex from its hash cell */
+    prev = mesh->hash_prev[index];
+    next = mesh->hash_next[index];
+    if (prev < -1)
+        table->cells[HASH_HEAD(prev)] = next;
+    else
+        mesh->hash_next[prev] = next;
+    if (next != -1)
+        mesh->hash_prev[next] = prev;
+    mesh->hash_next[index] = -1;
+    mesh->hash_prev[index] = NOT_HASHED;
+    table->npoints--;
+}
+
+/******************************************************************************
+Point a vertex's neighbors in its hash cell at the vertex's new index.  The
+vertex's own hash_next and hash_prev must already have been copied to the
+new index.
+
+Entry:
+  mesh  - mesh of the vertex
+  index - new index of the vertex
+******************************************************************************/
+void renumber_in_hash(Mesh* mesh, int index)
+{
+    int prev = mesh->hash_prev[index];
+    int next = mesh->hash_next[index];
+
+    if (prev == NOT_HASHED)
+        return;
+
+    if (prev < -1)
+        mesh->table->cells[HASH_HEAD(prev)] = index;
+    else
+        mesh->hash_next[prev] = index;
+    if (next != -1)
+        mesh->hash_prev[next] = index;
+
+    /* a frozen copy of the table would now be out of date */
+    if (mesh->table->sorted != NULL)
+        thaw_table(mesh);
+}
+
+/******************************************************************************
+Put each vertex of a mesh into the hash cell for its current position.  This
+is for after many vertices have been moved at once, and costs the same as
+building the table anew.  The points end up in the same order as with
+init_table.
+
+Entry:
+  mesh - mesh whose vertices have moved
+******************************************************************************/
+void rehash_table(Mesh* mesh)
+{
+    int i;
+    Hash_Table* table;
+
+    table = mesh->table;
+
+    /* a frozen copy of the table would now be out of date */
+    if (table->sorted != NULL)
+        thaw_table(mesh);
+
+    /* grow the table if the mesh has more points than it was built for */
+    table->npoints = mesh->nverts;
+    if (table->npoints > table->max_points)
+        resize_table(mesh, table_size(table->npoints));
+
+    for (i = 0; i < table->num_entries; i++)
+        table->cells[i] = -1;
+
+    for (i = 0; i < mesh->nverts; i++)
+        link_vertex(mesh, table->cells,
+                    cell_of(table, mesh->coords[i], table->num_entries), i);
+}
+
+/******************************************************************************
+Freeze a mesh's hash table for a phase that only searches the mesh.  The
+points of each hash cell are copied, along with their positions and
+normals, into arrays in cell order so that a search reads memory in
+sequence instead of following the hash_next links.  Positions and normals
+are kept one array per axis so that a search can compare several points
+at once.  The copy is built
+from the hash cells themselves, so points are visited in the same order
+as before and searches give the same answers.
+
+Adding or removing a vertex throws the frozen copy away.
+
+Entry:
+  mesh - mesh whose table to freeze
+******************************************************************************/
+void freeze_table(Mesh* mesh)
+{
+    int i, j, k;
+    int n;
+    int ok;
+    int ptr;
+    Hash_Table* table;
+    Cell_Table* sorted;
+
+    table = mesh->table;
+    if (table->sorted != NULL)
+        return;
+
+    /* count the points in the table */
+    n = 0;
+    for (i = 0; i < table->num_entries; i++)
+        for (ptr = table->cells[i]; ptr != -1; ptr = mesh->hash_next[ptr])
+            n++;
+
+    sorted = (Cell_Table*) malloc(sizeof(Cell_Table));
+    sorted->first = (int*) malloc(sizeof(int) * (table->num_entries + 1));
+    sorted->verts = (Vertex**) malloc(sizeof(Vertex*) * (n + 1));
+    sorted->old_mesh = (Mesh**) malloc(sizeof(Mesh*) * (n + 1));
+    ok = (sorted->first != NULL && sorted->verts != NULL && sorted->old_mesh != NULL);
+    for (j = 0; j < 3; j++) {
+        sorted->coords[j] = (float*) malloc(sizeof(float) * (n + 1));
+        sorted->normals[j] = (float*) malloc(sizeof(float) * (n + 1));
+        if (sorted->coords[j] == NULL || sorted->normals[j] == NULL)
+            ok = 0;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "freeze_table: can't allocate room for %d points\n", n);
+        free(sorted->first);
+        free(sorted->verts);
+        for (j = 0; j < 3; j++) {
+            free(sorted->coords[j]);
+            free(sorted->normals[j]);
         }
+        free(sorted->old_mesh);
+        free(sorted);
+        return;
     }
 
-    /* error check */
-    if (!found) {
-        fprintf(stderr, "remove_from_hash: can't find vertex\n");
-        printf("index = %d, x y z = %f %f %f\n", vert->index,
-               vert->coord[X], vert->coord[Y], vert->coord[Z]);
-        printf("hash index: %d\n", index);
+    /* copy the points out, one cell after another */
+    k = 0;
+    for (i = 0; i < table->num_entries; i++) {
+        sorted->first[i] = k;
+        for (ptr = table->cells[i]; ptr != -1; ptr = mesh->hash_next[ptr]) {
+            sorted->verts[k] = mesh->verts[ptr];
+            for (j = 0; j < 3; j++) {
+                sorted->coords[j][k] = mesh->coords[ptr][j];
+                sorted->normals[j][k] = mesh->normals[ptr][j];
+            }
+            sorted->old_mesh[k] = mesh->verts[ptr]->old_mesh;
+            k++;
+        }
+    }
+    sorted->first[table->num_entries] = k;
+
+    table->sorted = sorted;
+}
+
+/******************************************************************************
+Throw away the frozen copy of a mesh's hash table, if there is one.
+
+Entry:
+  mesh - mesh whose table to thaw
+******************************************************************************/
+void thaw_table(Mesh* mesh)
+{
+    int j;
+    Cell_Table* sorted;
+
+    if (mesh->table == NULL || mesh->table->sorted == NULL)
         return;
-        /*
-        exit (-1);
-        */
+
+    sorted = mesh->table->sorted;
+    free(sorted->first);
+    free(sorted->verts);
+    for (j = 0; j < 3; j++) {
+        free(sorted->coords[j]);
+        free(sorted->normals[j]);
     }
+    free(sorted->old_mesh);
+    free(sorted);
 
-    /* remove the vertex from the hash table */
-    ptr->next = vert->next;
+    mesh->table->sorted = NULL;
+}
+
+/* cells already looked at by the current search are stamped with its number */
+static unsigned int* bucket_stamps = NULL;
+static int bucket_stamps_max = 0;
+static unsigned int bucket_stamp = 0;
+
+/* totals for judging how well the hash table spreads out the points */
+static double stat_searches = 0;
+static double stat_buckets = 0;
+static double stat_verts = 0;
+
+/******************************************************************************
+Begin a search of a hash table.  Neighboring cells can hash to the same
+table entry, and visit_bucket() lets a search skip over an entry that it
+has already looked at.
+
+Entry:
+  table - table to be searched
+******************************************************************************/
+void start_bucket_search(Hash_Table* table)
+{
+    int i;
+
+    /* make room to mark every entry of the table */
+    if (table->num_entries > bucket_stamps_max) {
+        bucket_stamps_max = table->num_entries;
+        free(bucket_stamps);
+        bucket_stamps = (unsigned int*) malloc(sizeof(unsigned int) * bucket_stamps_max);
+        for (i = 0; i < bucket_stamps_max; i++)
+            bucket_stamps[i] = 0;
+        bucket_stamp = 0;
+    }
+
+    /* new stamp for this search, starting over if the stamps run out */
+    bucket_stamp++;
+    if (bucket_stamp == 0) {
+        for (i = 0; i < bucket_stamps_max; i++)
+            bucket_stamps[i] = 0;
+        bucket_stamp = 1;
+    }
+
+    stat_searches++;
+}
+
+/******************************************************************************
+Mark a hash table entry as looked at by the current search.
+
+Entry:
+  index - the table entry
+
+Exit:
+  returns 1 if the entry is new to this search, 0 if it was already seen
+******************************************************************************/
+int visit_bucket(int index)
+{
+    if (bucket_stamps[index] == bucket_stamp)
+        return (0);
+
+    bucket_stamps[index] = bucket_stamp;
+    stat_buckets++;
+    return (1);
+}
+
+/******************************************************************************
+Finish a search of a hash table.
+
+Entry:
+  nverts - number of vertices the search looked at
+******************************************************************************/
+void end_bucket_search(int nverts)
+{
+    stat_verts += nverts;
+}
+
+/******************************************************************************
+Add the statistics of some searches, which may have been done in another
+thread, to the totals.
+
+Entry:
+  searches - number of searches
+  buckets  - number of table entries they looked at
+  nverts   - number of vertices they looked at
+******************************************************************************/
+static void add_search_stats(double searches, double buckets, double nverts)
+{
+    parallel_lock();
+    stat_searches += searches;
+    stat_buckets += buckets;
+    stat_verts += nverts;
+    parallel_unlock();
+}
+
+/******************************************************************************
+Print how many cells and vertices each search has looked at since the last
+time the statistics were printed.
+******************************************************************************/
+void print_search_stats()
+{
+    if (stat_searches == 0)
+        return;
+
+    printf("%.0f hash searches, %.2f cells and %.2f vertices per search\n",
+           stat_searches, stat_buckets / stat_searches, stat_verts / stat_searches);
+
+    stat_searches = 0;
+    stat_buckets = 0;
+    stat_verts = 0;
+}
+
+/******************************************************************************
+Find the closest of a run of points to a given position using the plain
+loop, one point at a time.  This is what nearest_in_run() does when it is
+not compiled for a vector unit.
+
+Entry:
+  same as for nearest_in_run()
+
+Exit:
+  same as for nearest_in_run()
+******************************************************************************/
+int nearest_in_run_scalar(
+    float** coords, float** normals, Mesh** old_mesh, int first, int last,
+    Mesh* not_mesh, Vector pnt, Vector norm, float min_dot, float* min_dist
+) {
+    int k;
+    int min_k = -1;
+    float dx, dy, dz;
+    float dist;
+    float dot;
+
+    for (k = first; k < last; k++) {
+
+        /* don't examine point if it's old mesh is not_mesh */
+        if (old_mesh != NULL && old_mesh[k] == not_mesh)
+            continue;
+
+        /* distance (squared) to this point */
+        dx = coords[X][k] - pnt[X];
+        dy = coords[Y][k] - pnt[Y];
+        dz = coords[Z][k] - pnt[Z];
+        dist = dx * dx + dy * dy + dz * dz;
+
+        /* maybe we've found new closest point */
+        if (dist < *min_dist) {
+
+            /* make sure the surface normals are roughly in the same direction */
+            dot = norm[X] * normals[X][k] + norm[Y] * normals[Y][k] +
+                  norm[Z] * normals[Z][k];
+            if (dot < min_dot)
+                continue;
+
+            *min_dist = dist;
+            min_k = k;
+        }
+    }
+
+    return (min_k);
+}
+
+/******************************************************************************
+Find the closest of a run of points to a given position, skipping points
+from not_mesh and points whose normal disagrees with the given normal.
+When compiled for AVX2 (or SSE4.1) the points are examined eight (or four)
+at a time without branching, each lane keeping its own best point.  The
+answer is the same as that of nearest_in_run_scalar(): the earliest point
+with the smallest distance.
+
+Entry:
+  coords   - point positions, one array per axis
+  normals  - point normals, one array per axis
+  old_mesh - old_mesh field of each point, or NULL to reject none of them
+  first    - index of the first point of the run
+  last     - one past the index of the last point of the run
+  not_mesh - mesh to reject points from
+  pnt      - position to find the nearest point to
+  norm     - surface normal at pnt
+  min_dot  - minimum allowed dot product between norm and a point's normal
+  min_dist - squared distance that a point must beat
+
+Exit:
+  min_dist - squared distance to the nearest point, if one was found
+  returns index of the nearest point, or -1 if none was closer than min_dist
+******************************************************************************/
+int nearest_in_run(
+    float** coords, float** normals, Mesh** old_mesh, int first, int last,
+    Mesh* not_mesh, Vector pnt, Vector norm, float min_dot, float* min_dist
+) {
+#if defined(NEAR_AVX2) || defined(NEAR_SSE4)
+    int i, k;
+    int min_k = -1;
+    float lane_dist[NEAR_LANES];
+    int lane_k[NEAR_LANES];
+#endif
+
+#if defined(NEAR_AVX2)
+
+    __m256 px = _mm256_set1_ps(pnt[X]);
+    __m256 py = _mm256_set1_ps(pnt[Y]);
+    __m256 pz = _mm256_set1_ps(pnt[Z]);
+    __m256 nx = _mm256_set1_ps(norm[X]);
+    __m256 ny = _mm256_set1_ps(norm[Y]);
+    __m256 nz = _mm256_set1_ps(norm[Z]);
+    __m256 mdot = _mm256_set1_ps(min_dot);
+    __m256 best = _mm256_set1_ps(*min_dist);
+    __m256i best_k = _mm256_set1_epi32(-1);
+    __m256i kk = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i step = _mm256_set1_epi32(8);
+    __m256i bad = _mm256_set1_epi64x((long long) not_mesh);
+    __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256 dx, dy, dz, dist, dot, ok;
+    __m256i lo, hi;
+
+    kk = _mm256_add_epi32(kk, _mm256_set1_epi32(first));
+
+    for (k = first; k + 8 <= last; k += 8) {
+
+        /* distances (squared) to these points */
+        dx = _mm256_sub_ps(_mm256_loadu_ps(coords[X] + k), px);
+        dy = _mm256_sub_ps(_mm256_loadu_ps(coords[Y] + k), py);
+        dz = _mm256_sub_ps(_mm256_loadu_ps(coords[Z] + k), pz);
+        dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                             _mm256_mul_ps(dz, dz));
+
+        /* agreement between the surface normals */
+        dot = _mm256_add_ps(
+                  _mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(normals[X] + k)),
+                                _mm256_mul_ps(ny, _mm256_loadu_ps(normals[Y] + k))),
+                  _mm256_mul_ps(nz, _mm256_loadu_ps(normals[Z] + k)));
+
+        /* closer than this lane's best, and normals roughly the same direction */
+        ok = _mm256_and_ps(_mm256_cmp_ps(dist, best, _CMP_LT_OQ),
+                           _mm256_cmp_ps(dot, mdot, _CMP_NLT_UQ));
+
+        /* don't take points whose old mesh is not_mesh */
+        if (old_mesh != NULL) {
+            lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) (old_mesh + k)), bad);
+            hi = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i*) (old_mesh + k + 4)), bad);
+            lo = _mm256_permutevar8x32_epi32(lo, pack);
+            hi = _mm256_permutevar8x32_epi32(hi, pack);
+            ok = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_permute2x128_si256(lo, hi, 0x20)),
+                                  ok);
+        }
+
+        best = _mm256_blendv_ps(best, dist, ok);
+        best_k = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best_k),
+                                                      _mm256_castsi256_ps(kk), ok));
+        kk = _mm256_add_epi32(kk, step);
+    }
+
+    _mm256_storeu_ps(lane_dist, best);
+    _mm256_storeu_si256((__m256i*) lane_k, best_k);
+
+#elif defined(NEAR_SSE4)
+
+    __m128 px = _mm_set1_ps(pnt[X]);
+    __m128 py = _mm_set1_ps(pnt[Y]);
+    __m128 pz = _mm_set1_ps(pnt[Z]);
+    __m128 nx = _mm_set1_ps(norm[X]);
+    __m128 ny = _mm_set1_ps(norm[Y]);
+    __m128 nz = _mm_set1_ps(norm[Z]);
+    __m128 mdot = _mm_set1_ps(min_dot);
+    __m128 best = _mm_set1_ps(*min_dist);
+    __m128i best_k = _mm_set1_epi32(-1);
+    __m128i kk = _mm_setr_epi32(first, first + 1, first + 2, first + 3);
+    __m128i step = _mm_set1_epi32(4);
+    __m128i bad = _mm_set1_epi64x((long long) not_mesh);
+    __m128 dx, dy, dz, dist, dot, ok;
+    __m128i lo, hi;
+
+    for (k = first; k + 4 <= last; k += 4) {
+
+        /* distances (squared) to these points */
+        dx = _mm_sub_ps(_mm_loadu_ps(coords[X] + k), px);
+        dy = _mm_sub_ps(_mm_loadu_ps(coords[Y] + k), py);
+        dz = _mm_sub_ps(_mm_loadu_ps(coords[Z] + k), pz);
+        dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                          _mm_mul_ps(dz, dz));
+
+        /* agreement between the surface normals */
+        dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(normals[X] + k)),
+                                    _mm_mul_ps(ny, _mm_loadu_ps(normals[Y] + k))),
+                         _mm_mul_ps(nz, _mm_loadu_ps(normals[Z] + k)));
+
+        /* closer than this lane's best, and normals roughly the same direction */
+        ok = _mm_and_ps(_mm_cmplt_ps(dist, best), _mm_cmpnlt_ps(dot, mdot));
+
+        /* don't take points whose old mesh is not_mesh */
+        if (old_mesh != NULL) {
+            lo = _mm_cmpeq_epi64(_mm_loadu_si128((__m128i*) (old_mesh + k)), bad);
+            hi = _mm_cmpeq_epi64(_mm_loadu_si128((__m128i*) (old_mesh + k + 2)), bad);
+            ok = _mm_andnot_ps(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi),
+                                              _MM_SHUFFLE(2, 0, 2, 0)),
+                               ok);
+        }
+
+        best = _mm_blendv_ps(best, dist, ok);
+        best_k = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(best_k),
+                                                _mm_castsi128_ps(kk), ok));
+        kk = _mm_add_epi32(kk, step);
+    }
+
+    _mm_storeu_ps(lane_dist, best);
+    _mm_storeu_si128((__m128i*) lane_k, best_k);
+
+#endif
+
+#if defined(NEAR_AVX2) || defined(NEAR_SSE4)
+
+    /* pick the best of the lanes, earliest point first on ties */
+    for (i = 0; i < NEAR_LANES; i++) {
+        if (lane_k[i] < 0)
+            continue;
+        if (lane_dist[i] < *min_dist || (lane_dist[i] == *min_dist && lane_k[i] < min_k)) {
+            *min_dist = lane_dist[i];
+            min_k = lane_k[i];
+        }
+    }
+
+    /* finish the points left over */
+    i = nearest_in_run_scalar(coords, normals, old_mesh, k, last, not_mesh, pnt, norm,
+                              min_dot, min_dist);
+    if (i >= 0)
+        min_k = i;
+
+    return (min_k);
+
+#else
+
+    return (nearest_in_run_scalar(coords, normals, old_mesh, first, last, not_mesh, pnt,
+                                  norm, min_dot, min_dist));
+
+#endif
+}
+
+/******************************************************************************
+Find the nearest vertex to a given position using a frozen hash table.
+
+Entry:
+  table    - hash table with a frozen copy
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  pnt      - position (in mesh's coordinate system) to find nearest vertex to
+  norm     - surface normal at pnt
+  width    - how many cells to look at on each side of pnt's cell
+  min_dot  - minimum allowed dot product between given normal and match point
+
+Exit:
+  returns pointer to the nearest vertex
+******************************************************************************/
+static Vertex* sorted_find_nearest(
+    Hash_Table* table, Mesh* not_mesh, Vector pnt, Vector norm,
+    int width, float min_dot
+) {
+    int a, b, c;
+    int aa, bb, cc;
+    int index;
+    int k;
+    int nverts = 0;
+    Cell_Table* sorted = table->sorted;
+    int min_k = -1;
+    float min_dist = 1e20;
+
+    /* determine which cell the position lies within */
+    aa = floor(table->scale * pnt[X]);
+    bb = floor(table->scale * pnt[Y]);
+    cc = floor(table->scale * pnt[Z]);
+
+    start_bucket_search(table);
+
+    for (a = aa - width; a <= aa + width; a++)
+        for (b = bb - width; b <= bb + width; b++)
+            for (c = cc - width; c <= cc + width; c++) {
+
+                /* compute position in hash table, skipping entries already seen */
+                index = CELL_INDEX(a, b, c, table->num_entries);
+                if (!visit_bucket(index))
+                    continue;
+
+                /* examine all points hashed to this cell */
+                nverts += sorted->first[index + 1] - sorted->first[index];
+                k = nearest_in_run(sorted->coords, sorted->normals, sorted->old_mesh,
+                                   sorted->first[index], sorted->first[index + 1],
+                                   not_mesh, pnt, norm, min_dot, &min_dist);
+                if (k >= 0)
+                    min_k = k;
+            }
+
+    end_bucket_search(nverts);
+
+    /* return nearest point */
+    if (min_k < 0)
+        return (NULL);
+    return (sorted->verts[min_k]);
+}
+
+/******************************************************************************
+Find the nearest vertex among those hashed to one cell of a mesh's table.
+Positions and normals are read from the mesh's arrays, and a vertex record
+is only looked at for one that is closer than the best so far.
+
+Entry:
+  mesh     - the mesh
+  index    - the hash cell
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  pnt      - position (in mesh's coordinate system) to find nearest vertex to
+  norm     - surface normal at pnt
+  min_dot  - minimum allowed dot product between given normal and match point
+  min_dist - squared distance that a vertex must beat
+  nverts   - count of vertices looked at so far
+
+Exit:
+  min_dist - squared distance to the vertex found, if there is one
+  nverts   - count, including this cell's vertices
+  returns the earliest vertex of the cell with the smallest distance, or NULL
+  if none was closer than min_dist
+******************************************************************************/
+static Vertex* cell_nearest(
+    Mesh* mesh, int index, Mesh* not_mesh, Vector pnt, Vector norm,
+    float min_dot, float* min_dist, int* nverts
+) {
+    int k;
+    Hash_Table* table = mesh->table;
+    Cell_Table* sorted = table->sorted;
+    Vertex* min_ptr = NULL;
+    float* pos;
+    float dx, dy, dz;
+    float dist;
+    float dot;
+
+    /* scan the points of a frozen table all at once */
+    if (sorted != NULL) {
+        *nverts += sorted->first[index + 1] - sorted->first[index];
+        k = nearest_in_run(sorted->coords, sorted->normals, sorted->old_mesh,
+                           sorted->first[index], sorted->first[index + 1],
+                           not_mesh, pnt, norm, min_dot, min_dist);
+        return ((k < 0) ? NULL : sorted->verts[k]);
+    }
+
+    for (k = table->cells[index]; k != -1; k = mesh->hash_next[k]) {
+
+        (*nverts)++;
+
+        /* distance (squared) to this point */
+        pos = mesh->coords[k];
+        dx = pos[X] - pnt[X];
+        dy = pos[Y] - pnt[Y];
+        dz = pos[Z] - pnt[Z];
+        dist = dx * dx + dy * dy + dz * dz;
+
+        /* maybe we've found new closest point */
+        if (dist < *min_dist) {
+
+            /* don't take point if it's old mesh is not_mesh */
+            if (mesh->verts[k]->old_mesh == not_mesh)
+                continue;
+
+            /* make sure the surface normals are roughly in the same direction */
+            dot = vdot(norm, mesh->normals[k]);
+            if (dot < min_dot)
+                continue;
+
+            *min_dist = dist;
+            min_ptr = mesh->verts[k];
+        }
+    }
+
+    return (min_ptr);
 }
 
 /******************************************************************************
@@ -191,13 +920,15 @@ Vertex* find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float
     int a, b, c;
     int aa, bb, cc;
     int index;
+    int nverts = 0;
     Hash_Table* table = mesh->table;
     Vertex* ptr;
     Vertex* min_ptr = NULL;
-    float dx, dy, dz;
-    float dist;
     float min_dist = 1e20;
-    float dot;
+
+    /* use the frozen copy of the table if there is one */
+    if (table->sorted != NULL)
+        return (sorted_find_nearest(table, not_mesh, pnt, norm, 1, min_dot));
 
     /* determine which cell the position lies within */
     aa = floor(table->scale * pnt[X]);
@@ -206,42 +937,26 @@ Vertex* find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float
 
     /* look at nine cells, centered at cell containing location */
 
+    start_bucket_search(table);
+
     for (a = aa - 1; a <= aa + 1; a++)
         for (b = bb - 1; b <= bb + 1; b++)
             for (c = cc - 1; c <= cc + 1; c++) {
 
-                /* compute position in hash table */
-                index = (a * PR1 + b * PR2 + c) % table->num_entries;
-                if (index < 0)
-                    index += table->num_entries;
+                /* compute position in hash table, skipping entries already seen */
+                index = CELL_INDEX(a, b, c, table->num_entries);
+                if (!visit_bucket(index))
+                    continue;
 
                 /* examine all points hashed to this cell */
-                for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
-
-                    /* don't examine point if it's old mesh is not_mesh */
-                    if (ptr->old_mesh == not_mesh)
-                        continue;
-
-                    /* distance (squared) to this point */
-                    dx = ptr->coord[X] - pnt[X];
-                    dy = ptr->coord[Y] - pnt[Y];
-                    dz = ptr->coord[Z] - pnt[Z];
-                    dist = dx * dx + dy * dy + dz * dz;
-
-                    /* maybe we've found new closest point */
-                    if (dist < min_dist) {
-
-                        /* make sure the surface normals are roughly in the same direction */
-                        dot = vdot(norm, ptr->normal);
-                        if (dot < min_dot)
-                            continue;
-
-                        min_dist = dist;
-                        min_ptr = ptr;
-                    }
-                }
+                ptr = cell_nearest(mesh, index, not_mesh, pnt, norm, min_dot, &min_dist,
+                                   &nverts);
+                if (ptr != NULL)
+                    min_ptr = ptr;
             }
 
+    end_bucket_search(nverts);
+
     /* return nearest point */
     return (min_ptr);
 }
@@ -265,59 +980,147 @@ Vertex* large_find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm,
     int a, b, c;
     int aa, bb, cc;
     int index;
+    int nverts = 0;
     Hash_Table* table = mesh->table;
     Vertex* ptr;
     Vertex* min_ptr = NULL;
-    float dx, dy, dz;
-    float dist;
     float min_dist = 1e20;
-    float dot;
     int width = 2;
 
+    /* use the frozen copy of the table if there is one */
+    if (table->sorted != NULL)
+        return (sorted_find_nearest(table, not_mesh, pnt, norm, width, min_dot));
+
     /* determine which cell the position lies within */
     aa = floor(table->scale * pnt[X]);
     bb = floor(table->scale * pnt[Y]);
     cc = floor(table->scale * pnt[Z]);
 
     /* look at nine cells, centered at cell containing location */
+    start_bucket_search(table);
+
     for (a = aa - width; a <= aa + width; a++)
         for (b = bb - width; b <= bb + width; b++)
             for (c = cc - width; c <= cc + width; c++) {
 
-                /* compute position in hash table */
-                index = (a * PR1 + b * PR2 + c) % table->num_entries;
-                if (index < 0)
-                    index += table->num_entries;
+                /* compute position in hash table, skipping entries already seen */
+                index = CELL_INDEX(a, b, c, table->num_entries);
+                if (!visit_bucket(index))
+                    continue;
 
                 /* examine all points hashed to this cell */
-                for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
+                ptr = cell_nearest(mesh, index, not_mesh, pnt, norm, min_dot, &min_dist,
+                                   &nverts);
+                if (ptr != NULL)
+                    min_ptr = ptr;
+            }
 
-                    /* don't examine point if it's old mesh is not_mesh */
-                    if (ptr->old_mesh == not_mesh)
-                        continue;
+    end_bucket_search(nverts);
 
-                    /* distance (squared) to this point */
-                    dx = ptr->coord[X] - pnt[X];
-                    dy = ptr->coord[Y] - pnt[Y];
-                    dz = ptr->coord[Z] - pnt[Z];
-                    dist = dx * dx + dy * dy + dz * dz;
+    /* return nearest point */
+    return (min_ptr);
+}
 
-                    /* maybe we've found new closest point */
-                    if (dist < min_dist) {
+/******************************************************************************
+Find the nearest vertex to a given position by looking at the cells around
+the position's cell in shells of growing size, stopping once no vertex in
+the next shell could be closer than the best one found so far.
+
+Every vertex that could beat the one returned has been looked at, so the
+answer is that of a search of all the cells unless two different vertices
+are exactly the same distance away.  The full search picks between these
+by the order it visits the cells in, so in that case this routine gives
+up and leaves it to the full search.
+
+Entry:
+  mesh     - the mesh
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  pnt      - position (in mesh's coordinate system) to find nearest vertex to
+  norm     - surface normal at pnt
+  aa,bb,cc - the cell that pnt lies within
+  width    - how many cells to look at on each side of pnt's cell
+  min_dot  - minimum allowed dot product between given normal and match point
+
+Exit:
+  near - the nearest vertex, or NULL if there is none
+  returns 1 if the answer was found, 0 if there was a tie
+******************************************************************************/
+static int shell_find_nearest(
+    Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm,
+    int aa, int bb, int cc, int width, float min_dot, Vertex** near
+) {
+    int a, b, c;
+    int s, step;
+    int index;
+    int tie = 0;
+    int nverts = 0;
+    Hash_Table* table = mesh->table;
+    Vertex* ptr;
+    Vertex* min_ptr = NULL;
+    float dist;
+    float min_dist = 1e20;
+    double inner, slop;
+    double f, gap;
+
+    /* how far pnt is from the nearest face of its cell, less a little */
+    /* for the roundoff in placing points into cells */
+    inner = 1;
+    for (a = 0; a < 3; a++) {
+        f = table->scale * pnt[a] - floor(table->scale * pnt[a]);
+        inner = MIN(inner, MIN(f, 1 - f));
+    }
+    slop = 1e-5 * (1 + fabs((double) aa) + fabs((double) bb) + fabs((double) cc));
+
+    start_bucket_search(table);
+
+    for (s = 0; s <= width; s++) {
+
+        /* any vertex outside the cells already seen is at least this far away */
+        if (s > 0 && min_ptr != NULL) {
+            gap = (s - 1 + inner - slop) / table->scale;
+            if (gap > 0 && gap * gap * 0.9999 > min_dist)
+                break;
+        }
+
+        /* visit the cells of the shell in the usual order */
+        for (a = aa - s; a <= aa + s; a++)
+            for (b = bb - s; b <= bb + s; b++) {
+
+                /* only the two end cells of a row are in the shell, unless */
+                /* the row is in one of the shell's faces */
+                if (a == aa - s || a == aa + s || b == bb - s || b == bb + s)
+                    step = 1;
+                else
+                    step = 2 * s;
+
+                for (c = cc - s; c <= cc + s; c += step) {
 
-                        /* make sure the surface normals are roughly in the same direction */
-                        dot = vdot(norm, ptr->normal);
-                        if (dot < min_dot)
-                            continue;
+                    /* compute position in hash table, skipping entries already seen */
+                    index = CELL_INDEX(a, b, c, table->num_entries);
+                    if (!visit_bucket(index))
+                        continue;
+
+                    /* look for a vertex at least as close as the best one */
+                    dist = (min_ptr == NULL) ? min_dist : nextafterf(min_dist, 2e20f);
+                    ptr = cell_nearest(mesh, index, not_mesh, pnt, norm, min_dot, &dist,
+                                       &nverts);
+                    if (ptr == NULL)
+                        continue;
 
+                    if (dist < min_dist) {
                         min_dist = dist;
                         min_ptr = ptr;
-                    }
+                        tie = 0;
+                    } else if (ptr != min_ptr)
+                        tie = 1;
                 }
             }
+    }
 
-    /* return nearest point */
-    return (min_ptr);
+    end_bucket_search(nverts);
+
+    *near = min_ptr;
+    return (!tie);
 }
 
 /******************************************************************************
@@ -339,13 +1142,11 @@ Vertex* new_find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, fl
     int a, b, c;
     int aa, bb, cc;
     int index, width;
+    int nverts = 0;
     Hash_Table* table = mesh->table;
     Vertex* ptr;
     Vertex* min_ptr = NULL;
-    float dx, dy, dz;
-    float dist;
     float min_dist = 1e20;
-    float dot;
 
     /* determine which cell the position lies within */
     aa = floor(table->scale * pnt[X]);
@@ -354,74 +1155,60 @@ Vertex* new_find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, fl
 
     width = ceil(max * table->scale - 1e-4);
 
+    /* look outward from pnt's cell, stopping as soon as we can */
+    if (shell_find_nearest(mesh, not_mesh, pnt, norm, aa, bb, cc, width, min_dot, &min_ptr))
+        return (min_ptr);
+
+    /* two vertices were equally near, so visit all the cells in order */
+    /* to decide between them the same way as always */
+    min_ptr = NULL;
+    start_bucket_search(table);
+
     for (a = aa - width; a <= aa + width; a++)
         for (b = bb - width; b <= bb + width; b++)
             for (c = cc - width; c <= cc + width; c++) {
 
-                /* compute position in hash table */
-                index = (a * PR1 + b * PR2 + c) % table->num_entries;
-                if (index < 0)
-                    index += table->num_entries;
+                /* compute position in hash table, skipping entries already seen */
+                index = CELL_INDEX(a, b, c, table->num_entries);
+                if (!visit_bucket(index))
+                    continue;
 
                 /* examine all points hashed to this cell */
-                for (ptr = table->verts[index]; ptr != NULL; ptr = ptr->next) {
-
-                    /* don't examine point if it's old mesh is not_mesh */
-                    if (ptr->old_mesh == not_mesh)
-                        continue;
-
-                    /* distance (squared) to this point */
-                    dx = ptr->coord[X] - pnt[X];
-                    dy = ptr->coord[Y] - pnt[Y];
-                    dz = ptr->coord[Z] - pnt[Z];
-                    dist = dx * dx + dy * dy + dz * dz;
-
-                    /* maybe we've found new closest point */
-                    if (dist < min_dist) {
-
-                        /* make sure the surface normals are roughly in the same direction */
-                        dot = vdot(norm, ptr->normal);
-                        if (dot < min_dot)
-                            continue;
-
-                        min_dist = dist;
-                        min_ptr = ptr;
-                    }
-                }
+                ptr = cell_nearest(mesh, index, not_mesh, pnt, norm, min_dot, &min_dist,
+                                   &nverts);
+                if (ptr != NULL)
+                    min_ptr = ptr;
             }
 
+    end_bucket_search(nverts);
+
     /* return nearest point */
     return (min_ptr);
 }
 
 /******************************************************************************
-Find the nearest location on a mesh to a given position.  This nearest
-position can be at a vertex, on an edge or within a triangle of the mesh.
+Find the nearest location on a mesh to a given position, starting from the
+mesh vertex that is nearest to that position.  This nearest position can be
+at the vertex, on one of its edges or within one of its triangles.
 
 Entry:
-  sc       - the scan of the mesh
-  mesh     - the mesh
-  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
-  pos      - position (in global coordinates) to find nearest point to
-  norm     - surface normal at pos
-  max      - maximum acceptable distance
-  min_dot  - minimum allowed dot product between given normal and match point
+  sc   - the scan of the mesh
+  mesh - the mesh
+  v    - position (in the mesh's coordinates) to find nearest point to
+  near - nearest vertex to v, or NULL if none was found
+  max  - maximum acceptable distance
 
 Exit:
   near_info - information about nearest position on mesh, including 3D position
           in global coordinates
   returns 1 if it found a near point, 0 if it couldn't find any near point
 ******************************************************************************/
-int nearest_on_mesh(
-    Scan* sc, Mesh* mesh, Mesh* not_mesh,
-    Vector pos, Vector norm, float max, float min_dot,
-    NearPosition* near_info
+static int nearest_from_vertex(
+    Scan* sc, Mesh* mesh, Vector v, Vertex* near, float max, NearPosition* near_info
 ) {
-    Vector v;
-    Vector tnorm;
     Vector near_pos;
     Vector diff;
-    Vertex* near, *near2;
+    Vertex* near2;
     float min_dist;
     float edge_min_dist, tri_min_dist;
     int on_edge1, on_edge2;
@@ -431,13 +1218,6 @@ int nearest_on_mesh(
     float ival;
     Vector barycentric;
 
-    /* transform position into the meshes coordinate space */
-    world_to_mesh(sc, pos, v);
-    world_to_mesh_normal(sc, norm, tnorm);
-
-    /* look for nearby vertex of mesh */
-    near = new_find_nearest(mesh, not_mesh, v, tnorm, max, min_dot);
-
     /* return now if there was no nearby vertex or if vertex has no triangles */
     if ((near == NULL) || (near->ntris == 0)) {
         return (0);
@@ -450,16 +1230,16 @@ int nearest_on_mesh(
     on_edge1 = near->on_edge;  /* is this vertex on the edge of the mesh? */
     near_type = NEAR_VERTEX;   /* so far, nearest position is this vertex */
     near_info->v1 = near;      /* remember which vertex was nearest */
-    near_info->confidence = near->confidence;
+    near_info->confidence = mesh->confidence[near->index];
 
     /* see if position is nearer to any edges of the vertex */
 
     /*
-      new_min_dist = nearest_on_edges (v, near, min_dist, near_pos,
+      new_min_dist = nearest_on_edges (mesh, v, near, min_dist, near_pos,
                        &on_edge2, &near2, &conf, &ival);
     */
 
-    edge_min_dist = nearest_on_edges(v, near, 1e20, near_pos,
+    edge_min_dist = nearest_on_edges(mesh, v, near, 1e20, near_pos,
                                      &on_edge2, &near2, &conf, &ival);
     near_info->v2 = near2;    /* remember other vertex involved */
 
@@ -475,7 +1255,7 @@ int nearest_on_mesh(
     /* get nearest position on triangles radiating from "near" vertex, */
     /* or leave current best position alone */
 
-    tri_min_dist = nearest_on_tris(v, near, 1e20, near_pos, &near_tri, &conf,
+    tri_min_dist = nearest_on_tris(mesh, v, near, 1e20, near_pos, &near_tri, &conf,
                                    barycentric);
     near_info->tri = near_tri;
 
@@ -516,11 +1296,362 @@ int nearest_on_mesh(
     return (0);
 }
 
+/******************************************************************************
+Find the nearest location on a mesh to a given position.  This nearest
+position can be at a vertex, on an edge or within a triangle of the mesh.
+
+Entry:
+  sc       - the scan of the mesh
+  mesh     - the mesh
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  pos      - position (in global coordinates) to find nearest point to
+  norm     - surface normal at pos
+  max      - maximum acceptable distance
+  min_dot  - minimum allowed dot product between given normal and match point
+
+Exit:
+  near_info - information about nearest position on mesh, including 3D position
+          in global coordinates
+  returns 1 if it found a near point, 0 if it couldn't find any near point
+******************************************************************************/
+int nearest_on_mesh(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh,
+    Vector pos, Vector norm, float max, float min_dot,
+    NearPosition* near_info
+) {
+    Vector v;
+    Vector tnorm;
+    Vertex* near;
+
+    /* search the triangle tree instead, if this phase built one */
+    if (mesh->tri_tree != NULL)
+        return (tree_nearest_on_mesh(sc, mesh, not_mesh, pos, norm, max, min_dot,
+                                     near_info));
+
+    /* transform position into the meshes coordinate space */
+    world_to_mesh(sc, pos, v);
+    world_to_mesh_normal(sc, norm, tnorm);
+
+    /* look for nearby vertex of mesh */
+    near = new_find_nearest(mesh, not_mesh, v, tnorm, max, min_dot);
+
+    /* find the nearest place around this vertex */
+    return (nearest_from_vertex(sc, mesh, v, near, max, near_info));
+}
+
+/* centers cell numbers in the 21 bits used for each axis of a Morton code */
+#define MORTON_OFFSET (1 << 20)
+
+/* one query of a batch, with the hash cell it falls in */
+typedef struct Near_Query {
+    unsigned long long key;   /* position of the cell along a Morton curve */
+    int a, b, c;              /* the cell */
+    int index;                /* which query this is */
+} Near_Query;
+
+/* vertices gathered from the cells around one query cell; each batch */
+/* search has its own, so that batches can run in several threads at once */
+typedef struct Near_Block {
+    Vertex** verts;           /* the vertices */
+    float* coords[3];         /* their positions, one array per axis */
+    float* normals[3];        /* their normals, one array per axis */
+    int num;                  /* number of vertices */
+    int max;                  /* room in the arrays */
+    unsigned int* stamps;     /* search that last looked at each table entry */
+    unsigned int stamp;       /* number of the current search */
+    double searches;          /* statistics, added to the totals at the end */
+    double buckets;
+    double nverts;
+} Near_Block;
+
+/******************************************************************************
+Spread the low 21 bits of a number out so that there are two zero bits
+between each of them.
+******************************************************************************/
+static unsigned long long spread_bits(unsigned int n)
+{
+    unsigned long long x = n & 0x1fffff;
+
+    x = (x | (x << 32)) & 0x1f00000000ffffULL;
+    x = (x | (x << 16)) & 0x1f0000ff0000ffULL;
+    x = (x | (x << 8))  & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2))  & 0x1249249249249249ULL;
+
+    return (x);
+}
+
+/******************************************************************************
+Find where a cell lies along a Morton (Z-order) curve.
+
+Entry:
+  a,b,c - the cell, each in [-2^20, 2^20)
+
+Exit:
+  returns the cell's position along the curve
+******************************************************************************/
+unsigned long long morton_key(int a, int b, int c)
+{
+    return (spread_bits(a + MORTON_OFFSET) |
+            (spread_bits(b + MORTON_OFFSET) << 1) |
+            (spread_bits(c + MORTON_OFFSET) << 2));
+}
+
+/******************************************************************************
+Compare two queries by their place along the Morton curve, for qsort().
+******************************************************************************/
+static int compare_queries(const void* p1, const void* p2)
+{
+    const Near_Query* q1 = (const Near_Query*) p1;
+    const Near_Query* q2 = (const Near_Query*) p2;
+
+    if (q1->key < q2->key)
+        return (-1);
+    if (q1->key > q2->key)
+        return (1);
+    return (q1->index - q2->index);
+}
+
+/******************************************************************************
+Add a vertex to the block of vertices near the current query cell.
+******************************************************************************/
+static void add_to_block(Near_Block* block, Vertex* vert, float x, float y, float z,
+                         float nx, float ny, float nz)
+{
+    int j;
+    int num = block->num;
+
+    if (num == block->max) {
+        block->max = (block->max == 0) ? 200 : block->max * 2;
+        block->verts = (Vertex**) realloc(block->verts, sizeof(Vertex*) * block->max);
+        for (j = 0; j < 3; j++) {
+            block->coords[j] = (float*) realloc(block->coords[j], sizeof(float) * block->max);
+            block->normals[j] = (float*) realloc(block->normals[j], sizeof(float) * block->max);
+        }
+        if (block->verts == NULL ||
+                block->coords[X] == NULL || block->coords[Y] == NULL ||
+                block->coords[Z] == NULL || block->normals[X] == NULL ||
+                block->normals[Y] == NULL || block->normals[Z] == NULL) {
+            fprintf(stderr, "add_to_block: can't allocate room for %d vertices\n",
+                    block->max);
+            exit(-1);
+        }
+    }
+
+    block->verts[num] = vert;
+    block->coords[X][num] = x;
+    block->coords[Y][num] = y;
+    block->coords[Z][num] = z;
+    block->normals[X][num] = nx;
+    block->normals[Y][num] = ny;
+    block->normals[Z][num] = nz;
+    block->num++;
+}
+
+/******************************************************************************
+Collect the vertices in the cells around a given cell, in the same order
+that new_find_nearest() would visit them.
+
+Entry:
+  block    - where to put the vertices
+  mesh     - the mesh
+  not_mesh - mesh to reject vertices from (old_mesh field of Vertex)
+  aa,bb,cc - the center cell
+  width    - how many cells to look at on each side of the center cell
+******************************************************************************/
+static void gather_block(Near_Block* block, Mesh* mesh, Mesh* not_mesh,
+                         int aa, int bb, int cc, int width)
+{
+    int a, b, c;
+    int index;
+    int k, last;
+    Hash_Table* table = mesh->table;
+    Cell_Table* sorted = table->sorted;
+    Vertex* ptr;
+    float* pos;
+    float* norm;
+    int nverts = 0;
+
+    block->num = 0;
+    block->stamp++;
+    block->searches++;
+
+    for (a = aa - width; a <= aa + width; a++)
+        for (b = bb - width; b <= bb + width; b++)
+            for (c = cc - width; c <= cc + width; c++) {
+
+                /* compute position in hash table, skipping entries already seen */
+                index = CELL_INDEX(a, b, c, table->num_entries);
+                if (block->stamps[index] == block->stamp)
+                    continue;
+                block->stamps[index] = block->stamp;
+                block->buckets++;
+
+                if (sorted != NULL) {
+                    last = sorted->first[index + 1];
+                    nverts += last - sorted->first[index];
+                    for (k = sorted->first[index]; k < last; k++)
+                        if (sorted->old_mesh[k] != not_mesh)
+                            add_to_block(block, sorted->verts[k],
+                                         sorted->coords[X][k], sorted->coords[Y][k],
+                                         sorted->coords[Z][k], sorted->normals[X][k],
+                                         sorted->normals[Y][k], sorted->normals[Z][k]);
+                } else {
+                    for (k = table->cells[index]; k != -1; k = mesh->hash_next[k]) {
+                        nverts++;
+                        ptr = mesh->verts[k];
+                        pos = mesh->coords[k];
+                        norm = mesh->normals[k];
+                        if (ptr->old_mesh != not_mesh)
+                            add_to_block(block, ptr, pos[X], pos[Y], pos[Z],
+                                         norm[X], norm[Y], norm[Z]);
+                    }
+                }
+            }
+
+    block->nverts += nverts;
+}
+
+/******************************************************************************
+Find the nearest locations on a mesh to a whole list of positions.  The
+answers are the same as calling nearest_on_mesh() on each position, but
+the positions are visited in the order of their hash cells along a Morton
+curve, and the vertices near a cell are gathered only once for all the
+positions in that cell.
+
+The positions must already be in the mesh's coordinate space (see
+xform_points), so that no per-position transformation is needed.
+
+Several batches may be searched at once in different threads, as long as
+the mesh doesn't change meanwhile and its triangles already have their
+edge planes (see make_edge_planes).
+
+Entry:
+  sc       - the scan of the mesh
+  mesh     - the mesh
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  num      - number of positions
+  pos      - positions (in mesh's coordinates) to find nearest points to
+  norm     - surface normals at the positions (in mesh's coordinates)
+  max      - maximum acceptable distance
+  min_dot  - minimum allowed dot product between given normal and match point
+
+Exit:
+  near_info - information about nearest position on mesh for each position
+  found     - for each position, 1 if it found a near point, 0 if not
+******************************************************************************/
+void nearest_on_mesh_batch(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh, int num,
+    Vector* pos, Vector* norm, float max, float min_dot,
+    NearPosition* near_info, int* found
+) {
+    int i, j, k;
+    int width;
+    int first, last;
+    Hash_Table* table = mesh->table;
+    Near_Query* queries;
+    Near_Block block;
+    Vertex* near;
+    float* p;
+    float min_dist;
+
+    if (num <= 0)
+        return;
+
+    /* search the triangle tree instead, if this phase built one */
+    if (mesh->tri_tree != NULL) {
+        for (i = 0; i < num; i++)
+            found[i] = tree_nearest_in_mesh(sc, mesh, not_mesh, pos[i], norm[i],
+                                            max, min_dot, &near_info[i]);
+        return;
+    }
+
+    queries = (Near_Query*) malloc(sizeof(Near_Query) * num);
+    if (queries == NULL) {
+        fprintf(stderr, "nearest_on_mesh_batch: can't allocate %d queries\n", num);
+        exit(-1);
+    }
+
+    /* find which cell each position lies within */
+
+    for (i = 0; i < num; i++) {
+        queries[i].a = floor(table->scale * pos[i][X]);
+        queries[i].b = floor(table->scale * pos[i][Y]);
+        queries[i].c = floor(table->scale * pos[i][Z]);
+        queries[i].key = morton_key(queries[i].a, queries[i].b, queries[i].c);
+        queries[i].index = i;
+    }
+
+    /* visit nearby cells one after the other */
+    qsort(queries, num, sizeof(Near_Query), compare_queries);
+
+    width = ceil(max * table->scale - 1e-4);
+
+    /* start with no vertices gathered and no table entries looked at */
+    block.verts = NULL;
+    for (j = 0; j < 3; j++) {
+        block.coords[j] = NULL;
+        block.normals[j] = NULL;
+    }
+    block.num = 0;
+    block.max = 0;
+    block.stamps = (unsigned int*) calloc(table->num_entries, sizeof(unsigned int));
+    if (block.stamps == NULL) {
+        fprintf(stderr, "nearest_on_mesh_batch: can't allocate %d cell stamps\n",
+                table->num_entries);
+        exit(-1);
+    }
+    block.stamp = 0;
+    block.searches = 0;
+    block.buckets = 0;
+    block.nverts = 0;
+
+    for (first = 0; first < num; first = last) {
+
+        /* find the run of queries in the same cell */
+        for (last = first + 1; last < num; last++)
+            if (queries[last].a != queries[first].a ||
+                queries[last].b != queries[first].b ||
+                queries[last].c != queries[first].c)
+                break;
+
+        /* collect the vertices around this cell just once */
+        gather_block(&block, mesh, not_mesh, queries[first].a, queries[first].b,
+                     queries[first].c, width);
+
+        for (j = first; j < last; j++) {
+
+            i = queries[j].index;
+            p = pos[i];
+
+            /* look for nearby vertex of mesh */
+            min_dist = 1e20;
+            k = nearest_in_run(block.coords, block.normals, NULL, 0, block.num,
+                               not_mesh, p, norm[i], min_dot, &min_dist);
+            near = (k < 0) ? NULL : block.verts[k];
+
+            /* find the nearest place around this vertex */
+            found[i] = nearest_from_vertex(sc, mesh, p, near, max, &near_info[i]);
+        }
+    }
+
+    add_search_stats(block.searches, block.buckets, block.nverts);
+
+    free(block.verts);
+    for (j = 0; j < 3; j++) {
+        free(block.coords[j]);
+        free(block.normals[j]);
+    }
+    free(block.stamps);
+    free(queries);
+}
+
 /******************************************************************************
 Find the nearest location on a group of edges of a vertex to a given
 position.
 
 Entry:
+  mesh - mesh the vertex belongs to
   pos  - position (in local coordinates) to find nearest point to
   near - the vertex whose edges will be checked
   max  - maximum acceptable distance
@@ -535,7 +1666,7 @@ Exit:
   couldn't find any near point
 ******************************************************************************/
 float nearest_on_edges(
-    Vector pos, Vertex* near, float max, Vector near_pos,
+    Mesh* mesh, Vector pos, Vertex* near, float max, Vector near_pos,
     int* on_edge, Vertex** near2, float* conf, float* ival
 ) {
     int i;
@@ -580,8 +1711,9 @@ float nearest_on_edges(
                 vcopy(close, near_pos);
                 *on_edge = near->verts[i]->on_edge;
                 *near2 = near->verts[i];
-                *conf = near->confidence +
-                        t * (near->verts[i]->confidence - near->confidence);
+                *conf = mesh->confidence[near->index] +
+                        t * (mesh->confidence[near->verts[i]->index] -
+                             mesh->confidence[near->index]);
                 *ival = t;
             }
         }
@@ -597,6 +1729,7 @@ Find the nearest location on a group of triangles of a vertex to a given
 position.
 
 Entry:
+  mesh - mesh the vertex belongs to
   pos  - position (in local coordinates) to find nearest point to
   near - the vertex whose triangles will be checked
   max  - maximum acceptable distance
@@ -610,11 +1743,12 @@ Exit:
   couldn't find any near point
 ******************************************************************************/
 float nearest_on_tris(
-    Vector pos, Vertex* near, float max, Vector near_pos,
+    Mesh* mesh, Vector pos, Vertex* near, float max, Vector near_pos,
     Triangle** near_tri, float* conf, Vector barycentric
 ) {
     int i;
     Triangle* tri;
+    Edge_Planes* planes;
     float r1, r2, r3;
     float len;
     Vector on;
@@ -633,11 +1767,12 @@ float nearest_on_tris(
         on[Z] = pos[Z] - len * tri->cc;
 
         /* see if this point is in the triangle */
-        r1 = on[X] * tri->a[0] + on[Y] * tri->b[0] + on[Z] * tri->c[0] + tri->d[0];
+        planes = tri_edge_planes(mesh, tri);
+        r1 = on[X] * planes->a[0] + on[Y] * planes->b[0] + on[Z] * planes->c[0] + planes->d[0];
         if (r1 < 0) continue;
-        r2 = on[X] * tri->a[1] + on[Y] * tri->b[1] + on[Z] * tri->c[1] + tri->d[1];
+        r2 = on[X] * planes->a[1] + on[Y] * planes->b[1] + on[Z] * planes->c[1] + planes->d[1];
         if (r2 < 0) continue;
-        r3 = on[X] * tri->a[2] + on[Y] * tri->b[2] + on[Z] * tri->c[2] + tri->d[2];
+        r3 = on[X] * planes->a[2] + on[Y] * planes->b[2] + on[Z] * planes->c[2] + planes->d[2];
         if (r3 < 0) continue;
 
         /* if we get here, the point is in the triangle, */
@@ -647,9 +1782,9 @@ float nearest_on_tris(
             max = len;
             vcopy(on, near_pos);
             *near_tri = tri;
-            *conf = (r2 * tri->verts[0]->confidence +
-                     r3 * tri->verts[1]->confidence +
-                     r1 * tri->verts[2]->confidence) / (r1 + r2 + r3);
+            *conf = (r2 * mesh->confidence[tri->verts[0]->index] +
+                     r3 * mesh->confidence[tri->verts[1]->index] +
+                     r1 * mesh->confidence[tri->verts[2]->index]) / (r1 + r2 + r3);
             barycentric[X] = r2;
             barycentric[Y] = r3;
             barycentric[Z] = r1;
@@ -661,6 +1796,197 @@ float nearest_on_tris(
     return (max);
 }
 
+/******************************************************************************
+Initialize an empty list for the results of radius searches.
+
+Entry:
+  list - the list
+******************************************************************************/
+void init_near_list(Near_List* list)
+{
+    list->verts = NULL;
+    list->num = 0;
+    list->max = 0;
+    list->stamps = NULL;
+    list->max_stamps = 0;
+    list->epoch = 0;
+}
+
+/******************************************************************************
+Free the memory used by a list of radius search results.
+
+Entry:
+  list - the list
+******************************************************************************/
+void free_near_list(Near_List* list)
+{
+    free(list->verts);
+    free(list->stamps);
+    init_near_list(list);
+}
+
+/******************************************************************************
+Make room in a list to stamp vertices with indices up to a given one.
+******************************************************************************/
+static void grow_near_stamps(Near_List* list, int index)
+{
+    int i;
+    int size;
+
+    size = MAX(index + 1, 2 * list->max_stamps);
+    list->stamps = (unsigned int*) realloc(list->stamps, sizeof(unsigned int) * size);
+    for (i = list->max_stamps; i < size; i++)
+        list->stamps[i] = 0;
+    list->max_stamps = size;
+}
+
+/******************************************************************************
+Empty a list of radius search results so that it can collect the vertices
+near a new position.  Rather than un-marking the vertices of the old list,
+the list moves on to a new epoch stamp.
+
+Entry:
+  list - the list
+  mesh - mesh that will be searched
+******************************************************************************/
+void clear_near_list(Near_List* list, Mesh* mesh)
+{
+    int i;
+
+    list->num = 0;
+
+    if (mesh->nverts > list->max_stamps)
+        grow_near_stamps(list, mesh->nverts - 1);
+
+    /* new stamp, starting over if the stamps run out */
+    list->epoch++;
+    if (list->epoch == 0) {
+        for (i = 0; i < list->max_stamps; i++)
+            list->stamps[i] = 0;
+        list->epoch = 1;
+    }
+}
+
+/******************************************************************************
+Add a vertex to a list of radius search results if it passes the tests
+of the search and isn't already in the list.
+******************************************************************************/
+static void take_near_vertex(
+    Near_List* list, Vertex* ptr, Mesh* not_mesh,
+    Vector norm, float min_dot, int flags
+) {
+    if (!(flags & NEAR_ANY_MESH) && ptr->old_mesh == not_mesh)
+        return;
+    if ((flags & NEAR_ON_EDGE) && ptr->nedges == 0)
+        return;
+    if ((flags & NEAR_IN_TRIS) && ptr->ntris == 0)
+        return;
+
+    /* go on if this vertex has already been placed on list */
+    if (ptr->index >= list->max_stamps)
+        grow_near_stamps(list, ptr->index);
+    if (list->stamps[ptr->index] == list->epoch)
+        return;
+
+    /* make sure the surface normals are roughly in the same direction */
+    if (norm != NULL && vdot(norm, ptr->normal) < min_dot)
+        return;
+
+    /* add this vertex to our list */
+    if (list->num == list->max) {
+        list->max = (list->max == 0) ? 50 : list->max + 20;
+        list->verts = (Vertex**) realloc(list->verts, sizeof(Vertex*) * list->max);
+    }
+    list->verts[list->num] = ptr;
+    list->num++;
+    list->stamps[ptr->index] = list->epoch;
+}
+
+/******************************************************************************
+Find the vertices of a mesh that are within a given distance of a position,
+and add them to a list owned by the caller.  Vertices already in the list
+since it was last cleared are not added again.  The search uses nothing
+but the list and the mesh, so different lists can be filled at the same
+time.
+
+Entry:
+  list     - list to add vertices to, cleared with clear_near_list()
+  mesh     - mesh to search
+  not_mesh - mesh to reject vertices from (old_mesh field of Vertex)
+  pnt      - position (in mesh's coordinate system) to search around
+  norm     - surface normal at pnt, or NULL to not compare normals
+  radius   - how far away vertices can be (no more than one cell)
+  min_dot  - minimum allowed dot product between norm and a vertex's normal
+  flags    - NEAR_ON_EDGE, NEAR_IN_TRIS and NEAR_ANY_MESH, or'ed together
+
+Exit:
+  list - the nearby vertices have been added
+******************************************************************************/
+void verts_near(
+    Near_List* list, Mesh* mesh, Mesh* not_mesh,
+    Vector pnt, Vector norm, float radius, float min_dot, int flags
+) {
+    int a, b, c;
+    int aa, bb, cc;
+    int i, k, last;
+    int index;
+    int seen[27];
+    int nseen = 0;
+    Hash_Table* table = mesh->table;
+    Cell_Table* sorted = table->sorted;
+    float dx, dy, dz;
+    float dist;
+
+    /* use squared distance */
+    radius = radius * radius;
+
+    /* determine which cell the position lies within */
+    aa = floor(table->scale * pnt[X]);
+    bb = floor(table->scale * pnt[Y]);
+    cc = floor(table->scale * pnt[Z]);
+
+    /* look at nine cells, centered at cell containing location */
+
+    for (a = aa - 1; a <= aa + 1; a++)
+        for (b = bb - 1; b <= bb + 1; b++)
+            for (c = cc - 1; c <= cc + 1; c++) {
+
+                /* compute position in hash table, skipping entries already seen */
+                index = CELL_INDEX(a, b, c, table->num_entries);
+                for (i = 0; i < nseen; i++)
+                    if (seen[i] == index)
+                        break;
+                if (i < nseen)
+                    continue;
+                seen[nseen++] = index;
+
+                /* examine the points of a frozen table in cell order */
+                if (sorted != NULL) {
+                    last = sorted->first[index + 1];
+                    for (k = sorted->first[index]; k < last; k++) {
+                        dx = sorted->coords[X][k] - pnt[X];
+                        dy = sorted->coords[Y][k] - pnt[Y];
+                        dz = sorted->coords[Z][k] - pnt[Z];
+                        dist = dx * dx + dy * dy + dz * dz;
+                        if (dist < radius)
+                            take_near_vertex(list, sorted->verts[k], not_mesh,
+                                             norm, min_dot, flags);
+                    }
+                    continue;
+                }
+
+                /* examine all points hashed to this cell */
+                for (k = table->cells[index]; k != -1; k = mesh->hash_next[k]) {
+                    dx = mesh->coords[k][X] - pnt[X];
+                    dy = mesh->coords[k][Y] - pnt[Y];
+                    dz = mesh->coords[k][Z] - pnt[Z];
+                    dist = dx * dx + dy * dy + dz * dz;
+                    if (dist < radius)
+                        take_near_vertex(list, mesh->verts[k], not_mesh, norm, min_dot, flags);
+                }
+            }
+}
+
 int is_near_edge(NearPosition* near)
 {
     int is_near;
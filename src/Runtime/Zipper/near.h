@@ -32,10 +32,34 @@
 #include "zipper.h"
 #include "matrix.h"
 
+// Which vertices a radius search takes
+#define NEAR_ON_EDGE  1   /* only vertices on the edge of the mesh */
+#define NEAR_IN_TRIS  2   /* only vertices used by some triangle */
+#define NEAR_ANY_MESH 4   /* don't reject vertices by their old mesh */
+
+// Vertices found by radius searches, owned by the caller
+typedef struct Near_List {
+    Vertex** verts;       /* the vertices found */
+    int num;              /* number of vertices found */
+    int max;              /* room in verts */
+    unsigned int* stamps; /* epoch when each vertex (by index) was last found */
+    int max_stamps;       /* room in stamps */
+    unsigned int epoch;   /* stamp of the vertices in the current list */
+} Near_List;
+
 // Declarations
 void init_table(Mesh* mesh, float size);
 void add_to_hash(Vertex* vert, Mesh* mesh);
 void remove_from_hash(Vertex* vert, Mesh* mesh);
+void rehash_table(Mesh* mesh);
+void renumber_in_hash(Mesh* mesh, int index);
+void freeze_table(Mesh* mesh);
+void thaw_table(Mesh* mesh);
+void start_bucket_search(Hash_Table* table);
+int visit_bucket(int index);
+void end_bucket_search(int nverts);
+void print_search_stats();
+unsigned long long morton_key(int a, int b, int c);
 Vertex* find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float min_dot);
 Vertex* large_find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float min_dot);
 Vertex* new_find_nearest(Mesh* mesh, Mesh* not_mesh, Vector pnt, Vector norm, float max, float min_dot);
@@ -44,14 +68,34 @@ int nearest_on_mesh(
     Vector pos, Vector norm, float max, float min_dot,
     NearPosition* near_info
 );
+int nearest_in_run_scalar(
+    float** coords, float** normals, Mesh** old_mesh, int first, int last,
+    Mesh* not_mesh, Vector pnt, Vector norm, float min_dot, float* min_dist
+);
+int nearest_in_run(
+    float** coords, float** normals, Mesh** old_mesh, int first, int last,
+    Mesh* not_mesh, Vector pnt, Vector norm, float min_dot, float* min_dist
+);
+void nearest_on_mesh_batch(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh, int num,
+    Vector* pos, Vector* norm, float max, float min_dot,
+    NearPosition* near_info, int* found
+);
 float nearest_on_edges(
-    Vector pos, Vertex* near, float max, Vector near_pos,
+    Mesh* mesh, Vector pos, Vertex* near, float max, Vector near_pos,
     int* on_edge, Vertex** near2, float* conf, float* ival
 );
 float nearest_on_tris(
-    Vector pos, Vertex* near, float max, Vector near_pos,
+    Mesh* mesh, Vector pos, Vertex* near, float max, Vector near_pos,
     Triangle** near_tri, float* conf, Vector barycentric
 );
+void init_near_list(Near_List* list);
+void free_near_list(Near_List* list);
+void clear_near_list(Near_List* list, Mesh* mesh);
+void verts_near(
+    Near_List* list, Mesh* mesh, Mesh* not_mesh,
+    Vector pnt, Vector norm, float radius, float min_dot, int flags
+);
 int is_near_edge(NearPosition* near);
 int is_vertex_near_edge(Vertex* v);
 
@@ -0,0 +1,251 @@
+/*
+ * Running loops over vertices and triangles in several threads.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Internal
+#include "parallel.h"
+
+// Parameters
+static int thread_count = 0;  /* 0 means one thread per processor */
+
+// Guards the few totals that threads add to
+static std::mutex shared_lock;
+
+void set_thread_count(int num)
+{
+    thread_count = num;
+}
+
+/******************************************************************************
+Find how many threads a parallel loop will use.
+
+Exit:
+  returns the number of threads (at least one)
+******************************************************************************/
+int get_thread_count()
+{
+    int num;
+
+    num = thread_count;
+    if (num <= 0)
+        num = std::thread::hardware_concurrency();
+    if (num <= 0)
+        num = 1;
+
+    return (num);
+}
+
+// Threads kept waiting between parallel loops, so that a loop doesn't pay
+// for starting and joining its own threads.  Worker i does range i of each
+// loop; the calling thread does range 0.  The pool is made once and never
+// freed, so it is still there for loops run while the program exits.
+typedef struct Thread_Pool {
+    std::mutex busy;               /* held by the loop using the pool */
+    std::mutex lock;               /* guards everything below */
+    std::condition_variable wake;  /* a new loop has been handed out */
+    std::condition_variable done;  /* the workers finished their ranges */
+    int nworkers;                  /* threads started so far */
+    unsigned int loop;             /* counts the loops handed out */
+    Range_Func func;               /* the current loop */
+    void* data;
+    int num;
+    int nranges;
+    int left;                      /* worker ranges not yet finished */
+} Thread_Pool;
+
+static Thread_Pool* get_pool()
+{
+    static Thread_Pool* pool = new Thread_Pool();
+    return (pool);
+}
+
+/******************************************************************************
+Find where one range of a parallel loop starts.
+
+Entry:
+  num     - number of items
+  i       - which range
+  nranges - number of ranges the items are split into
+
+Exit:
+  returns the first item of the range (range nranges gives num)
+******************************************************************************/
+static int range_start(int num, int i, int nranges)
+{
+    return ((int) ((long long) num * i / nranges));
+}
+
+/******************************************************************************
+Wait for loops and do one range of each.
+
+Entry:
+  pool   - the pool the thread belongs to
+  thread - which range of each loop the thread does
+  seen   - the last loop handed out before the thread was started
+******************************************************************************/
+static void pool_worker(Thread_Pool* pool, int thread, unsigned int seen)
+{
+    int first, last;
+    Range_Func func;
+    void* data;
+    std::unique_lock<std::mutex> lock(pool->lock);
+
+    for (;;) {
+        while (pool->loop == seen)
+            pool->wake.wait(lock);
+        seen = pool->loop;
+
+        /* short loops don't have a range for every worker */
+        if (thread >= pool->nranges)
+            continue;
+
+        first = range_start(pool->num, thread, pool->nranges);
+        last = range_start(pool->num, thread + 1, pool->nranges);
+        func = pool->func;
+        data = pool->data;
+
+        lock.unlock();
+        func(first, last, thread, data);
+        lock.lock();
+
+        pool->left--;
+        if (pool->left == 0)
+            pool->done.notify_one();
+    }
+}
+
+/******************************************************************************
+Split a list of items into contiguous ranges and work on the ranges in
+separate threads.  The calling thread takes the first range itself, and
+returns when all the ranges are done.  Each thread gets at least
+min_per_thread items, so short lists are done in fewer threads (or just
+the calling one).  A loop started from inside another one is done in the
+thread that starts it.
+
+Entry:
+  num            - number of items
+  min_per_thread - fewest items worth starting a thread for
+  func           - called once for each range
+  data           - passed along to func
+******************************************************************************/
+void parallel_for(int num, int min_per_thread, Range_Func func, void* data)
+{
+    int nthreads;
+    Thread_Pool* pool;
+
+    if (num <= 0)
+        return;
+
+    if (min_per_thread < 1)
+        min_per_thread = 1;
+
+    nthreads = get_thread_count();
+    if (nthreads > num / min_per_thread)
+        nthreads = num / min_per_thread;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    /* just do the work here if there's only one range */
+    if (nthreads == 1) {
+        func(0, num, 0, data);
+        return;
+    }
+
+    /* the pool's workers are busy with the loop this one was started from */
+    pool = get_pool();
+    if (!pool->busy.try_lock()) {
+        func(0, num, 0, data);
+        return;
+    }
+
+    /* hand the ranges but the first to the workers, starting more if needed */
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+
+        while (pool->nworkers < nthreads - 1) {
+            pool->nworkers++;
+            std::thread(pool_worker, pool, pool->nworkers, pool->loop).detach();
+        }
+
+        pool->func = func;
+        pool->data = data;
+        pool->num = num;
+        pool->nranges = nthreads;
+        pool->left = nthreads - 1;
+        pool->loop++;
+    }
+    pool->wake.notify_all();
+
+    func(0, range_start(num, 1, nthreads), 0, data);
+
+    {
+        std::unique_lock<std::mutex> lock(pool->lock);
+
+        while (pool->left > 0)
+            pool->done.wait(lock);
+    }
+
+    pool->busy.unlock();
+}
+
+/******************************************************************************
+Read a clock for timing the parallel parts of the program.  This is wall
+clock time, since the time used by all the threads together doesn't show
+whether they helped.
+
+Exit:
+  returns the time in seconds since some fixed moment
+******************************************************************************/
+double parallel_seconds()
+{
+    return (std::chrono::duration<double>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/******************************************************************************
+Take the lock that guards totals shared between threads.  Hold it only for
+a moment, to add to a total.
+******************************************************************************/
+void parallel_lock()
+{
+    shared_lock.lock();
+}
+
+/******************************************************************************
+Give back the lock taken by parallel_lock().
+******************************************************************************/
+void parallel_unlock()
+{
+    shared_lock.unlock();
+}
@@ -371,6 +371,8 @@ int read_ply(char* filename)
     /* make one mesh */
     sc->meshes[mesh_level] = (Mesh*) malloc(sizeof(Mesh));
     mesh = sc->meshes[mesh_level];
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     /* read in the vertices */
     plist = ply_get_element_description(ply, "vertex", &num_elems, &nprops);
@@ -431,11 +433,11 @@ int read_ply(char* filename)
                 pos[Y] = vert.y;
                 pos[Z] = vert.z;
                 index = make_vertex(mesh, pos);
-                mesh->verts[index]->confidence = vert.confidence;
-                mesh->verts[index]->intensity = vert.intensity;
-                mesh->verts[index]->red = vert.red;
-                mesh->verts[index]->grn = vert.grn;
-                mesh->verts[index]->blu = vert.blu;
+                mesh->confidence[index] = vert.confidence;
+                mesh->intensity[index] = vert.intensity;
+                mesh->colors[index][0] = vert.red;
+                mesh->colors[index][1] = vert.grn;
+                mesh->colors[index][2] = vert.blu;
             }
         } else if (equal_strings("face", elem_name)) {
             ply_get_element_setup(ply, elem_name, 1, tri_props);
@@ -887,22 +889,29 @@ int read_ply(char* filename)
     Mesh* mesh;
 
     sc = new_scan(filename, POLYFILE);
-    CGAL::Surface_mesh<Point_3> input_mesh;
-    CGAL::Polygon_mesh_processing::IO::read_polygon_mesh(filename, input_mesh);
     std::vector<Point_3> vertices;
     std::vector<Facet> facets;
-    CGAL::Polygon_mesh_processing::polygon_mesh_to_polygon_soup(input_mesh, vertices, facets);
+    {
+        /* the surface mesh is only needed until we have the polygon soup */
+        CGAL::Surface_mesh<Point_3> input_mesh;
+        CGAL::Polygon_mesh_processing::IO::read_polygon_mesh(filename, input_mesh);
+        CGAL::Polygon_mesh_processing::polygon_mesh_to_polygon_soup(input_mesh, vertices, facets);
+    }
+    size_t nverts = vertices.size();
+    size_t ntris = facets.size();
     /* make one mesh */
     sc->meshes[mesh_level] = (Mesh*)malloc(sizeof(Mesh));
     mesh = sc->meshes[mesh_level];
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     /* read in the vertices */
     mesh->nverts = 0;
-    mesh->max_verts = vertices.size() + 100;
+    mesh->max_verts = nverts + 100;
     mesh->verts = (Vertex**)malloc(sizeof(Vertex*) * mesh->max_verts);
 
     mesh->ntris = 0;
-    mesh->max_tris = facets.size() + 100;
+    mesh->max_tris = ntris + 100;
     mesh->tris = (Triangle**)malloc(sizeof(Triangle*) * mesh->max_tris);
 
     mesh->nedges = 0;
@@ -912,39 +921,42 @@ int read_ply(char* filename)
     mesh->eat_list_max = 200;
     mesh->parent_scan = sc;
 
-    for (size_t i = 0; i < vertices.size(); i++)
+    /* build the mesh from the polygon soup in one go, letting go of each */
+    /* part of the soup as soon as it has been copied */
+    std::vector<float> coords(3 * nverts + 1);
+    for (size_t i = 0; i < nverts; i++)
     {
-        Vector v;
-        v[0] = vertices[i].x();
-        v[1] = vertices[i].y();
-        v[2] = vertices[i].z();
-        make_vertex(mesh, v);
+        coords[3 * i] = vertices[i].x();
+        coords[3 * i + 1] = vertices[i].y();
+        coords[3 * i + 2] = vertices[i].z();
     }
-        
-    for (size_t i = 0; i < facets.size(); i++)
+    std::vector<Point_3>().swap(vertices);
+
+    std::vector<int> tri_verts(3 * ntris + 1);
+    for (size_t i = 0; i < ntris; i++)
     {
-        auto v1 = mesh->verts[facets[i][0]];
-        auto v2 = mesh->verts[facets[i][1]];
-        auto v3 = mesh->verts[facets[i][2]];
-        make_triangle(mesh, v1, v2, v3, 100.0);
+        tri_verts[3 * i] = facets[i][0];
+        tri_verts[3 * i + 1] = facets[i][1];
+        tri_verts[3 * i + 2] = facets[i][2];
     }
+    std::vector<Facet>().swap(facets);
+
+    /* keep vertices and triangles that are close together in space */
+    /* close together in memory */
+    order_mesh_arrays(nverts, coords.data(), ntris, tri_verts.data());
+
+    build_mesh_from_arrays(mesh, nverts, coords.data(), ntris, tri_verts.data(), 100.0);
 
     /* print info about polygons */
     printf("%d triangles\n", mesh->ntris);
     printf("%d vertices\n", mesh->nverts);
 
-    /* compute vertex normals */
-    find_vertex_normals(mesh);
-
     /* make guess about what resolution this mesh was created at */
     int inc = guess_mesh_inc(mesh);
 
     /* initialize hash table for vertices in mesh */
     init_table(mesh, 2.0f * get_zipper_resolution() * inc);
 
-    /* find the edges of the mesh */
-    find_mesh_edges(mesh);
-
     /* replicate this mesh at all levels */
     for (int j = 0; j < MAX_MESH_LEVELS; j++)
         sc->meshes[j] = mesh;
@@ -958,12 +970,14 @@ int write_ply(Scan* sc, char* filename, int writeInfo)
     Mesh* mesh;
 
     mesh = sc->meshes[mesh_level];
+
+    /* the positions are kept in one array, in the order of the vertex list */
     std::vector<Point_3> vertices;
     vertices.reserve(mesh->nverts);
     Point_set points;
     for (int i = 0; i < mesh->nverts; i++)
     {
-        Point_3 v = { mesh->verts[i]->coord[0], mesh->verts[i]->coord[1], mesh->verts[i]->coord[2] };
+        Point_3 v = { mesh->coords[i][0], mesh->coords[i][1], mesh->coords[i][2] };
         vertices.push_back(v);
         points.insert(v);
     }
@@ -144,6 +144,8 @@ int file_to_scan(char* filename)
     /* make one mesh */
     sc->meshes[mesh_level] = (Mesh*) malloc(sizeof(Mesh));
     mesh = sc->meshes[mesh_level];
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     mesh->ntris = 0;
     mesh->nverts = 0;
@@ -329,7 +331,7 @@ void write_bin_polyfile(Scan* scan, char* name)
         fwrite(mesh->verts[i]->coord, sizeof(float), 3, fp);
         /* maybe write out confidences of vertices */
         if (conf_flag) {
-            fconf = mesh->verts[i]->confidence;
+            fconf = mesh->confidence[i];
             if (fconf < 0)
                 conf = 0;
             else if (fconf > 1)
@@ -402,6 +404,8 @@ int read_bin_polyfile(char* filename)
     /* make one mesh */
     sc->meshes[mesh_level] = (Mesh*) malloc(sizeof(Mesh));
     mesh = sc->meshes[mesh_level];
+    mesh->tri_tree = NULL;
+    init_mesh_arena(mesh);
 
     mesh->ntris = 0;
     mesh->nverts = 0;
@@ -484,7 +488,7 @@ int read_bin_polyfile(char* filename)
         index = make_vertex(mesh, pos);
         if (conf_flag) {
             fread(&conf, sizeof(unsigned char), 1, fp);
-            mesh->verts[index]->confidence = ((int) conf) / 255.0;
+            mesh->confidence[index] = ((int) conf) / 255.0;
         }
     }
 
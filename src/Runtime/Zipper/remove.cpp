@@ -37,7 +37,9 @@
 #include "mesh.h"
 #include "draw.h"
 #include "near.h"
+#include "tritree.h"
 #include "edges.h"
+#include "parallel.h"
 
 // Variables
 static float global_near_dist; /* for passing to mark_for_eating */
@@ -225,15 +227,10 @@ void init_eating(Scan* scan)
 #define OFF_MESH  2  /* triangle that is definitely NOT on another mesh */
 #define REMOVE    3  /* triangle to be removed */
 
-    /* mark all triangles of the mesh as un-categorized */
+    /* mark all triangles and vertices of the mesh as un-categorized */
+    /* by starting a new epoch of marks */
 
-    for (i = 0; i < mesh->ntris; i++)
-        mesh->tris[i]->eat_mark = UNTOUCHED;
-
-    /* mark all vertices of the mesh as un-categorized */
-
-    for (i = 0; i < mesh->nverts; i++)
-        mesh->verts[i]->count = UNTOUCHED;
+    new_mark_epoch(mesh);
 
     /* see which triangles are currently on the mesh edge, and place */
     /* these on the list to examine */
@@ -259,7 +256,7 @@ void init_eating(Scan* scan)
             continue;
 
         /* place this triangle on the list */
-        tri->eat_mark = ON_LIST;
+        SET_TRI_EAT_MARK(mesh, tri, ON_LIST);
         if (mesh->eat_list_num == mesh->eat_list_max) {
             mesh->eat_list_max *= 2;
             mesh->eat_list = (Triangle**)
@@ -278,18 +275,13 @@ Entry:
 ******************************************************************************/
 void done_eating(Scan* scan)
 {
-    int i;
     Mesh* mesh;
 
     mesh = scan->meshes[mesh_level];
 
     /* remove marks from all triangles and vertices */
 
-    for (i = 0; i < mesh->ntris; i++)
-        mesh->tris[i]->eat_mark = 0;
-
-    for (i = 0; i < mesh->nverts; i++)
-        mesh->verts[i]->count = 0;
+    new_mark_epoch(mesh);
 
     free(mesh->eat_list);
 }
@@ -318,17 +310,19 @@ int eat_mesh_edges(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge, float
     Triangle* otri;
     Vertex* vert;
     int count;
+    Tri_Batch batch;
     void mark_for_eating(Scan * sc1, Scan * sc2, int draw, int conf, int to_edge);
 
     m2 = sc2->meshes[mesh_level];
 
     /* Look through triangles on the list of potentially deletable ones, */
-    /* marking those that should be deleted.  Maybe do this in parallel */
-    /* on several processors. */
+    /* marking those that should be deleted (in several threads). */
 
     global_near_dist = near_dist;
 
+    start_tri_tree_phase(EAT_PHASE, sc1->meshes[mesh_level]);
     mark_for_eating(sc1, sc2, draw, conf, to_edge);
+    free_tri_tree(sc1->meshes[mesh_level]);
 
     /* update the list of triangles to be examined */
     for (i = m2->eat_list_num - 1; i >= 0; i--) {
@@ -337,7 +331,7 @@ int eat_mesh_edges(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge, float
 
         /* if we're going to remove this triangle, examine its neighbors */
         /* to see if they need to be placed on the list */
-        if (tri->eat_mark == REMOVE) {
+        if (TRI_EAT_MARK(m2, tri) == REMOVE) {
             /* examine each vertex of triangle */
             for (j = 0; j < 3; j++) {
                 vert = tri->verts[j];
@@ -349,8 +343,8 @@ int eat_mesh_edges(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge, float
                         continue;
 #endif
                     /* place this triangle on the list if it is untouched */
-                    if (otri->eat_mark == UNTOUCHED) {
-                        otri->eat_mark = ON_LIST;
+                    if (TRI_EAT_MARK(m2, otri) == UNTOUCHED) {
+                        SET_TRI_EAT_MARK(m2, otri, ON_LIST);
                         if (m2->eat_list_num == m2->eat_list_max) {
                             m2->eat_list_max *= 2;
                             m2->eat_list = (Triangle**)
@@ -363,18 +357,21 @@ int eat_mesh_edges(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge, float
         }
     }
 
-    /* delete the marked triangles */
+    /* delete the marked triangles, all at once */
     count = 0;
+    init_tri_batch(&batch);
     for (i = m2->eat_list_num - 1; i >= 0; i--) {
         tri = m2->eat_list[i];
-        if (tri->eat_mark == REMOVE) {
-            delete_triangle(tri, m2, 1);
+        if (TRI_EAT_MARK(m2, tri) == REMOVE) {
+            add_to_tri_batch(&batch, tri, 1);
             count++;
             m2->eat_list[i] = m2->eat_list[--m2->eat_list_num];
-        } else if (tri->eat_mark == OFF_MESH) {
+        } else if (TRI_EAT_MARK(m2, tri) == OFF_MESH) {
             m2->eat_list[i] = m2->eat_list[--m2->eat_list_num];
         }
     }
+    delete_tri_batch(&batch, m2);
+    free_tri_batch(&batch);
 
     /* mark the edges of this mesh as invalid */
     m2->edges_valid = 0;
@@ -382,60 +379,59 @@ int eat_mesh_edges(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge, float
     return (count);
 }
 
+/* what mark_for_eating() hands to the threads that do its work */
+typedef struct Eat_Info {
+    Scan* sc1;                /* scan with mesh to match */
+    Mesh* m1;                 /* mesh to match */
+    Mesh* m2;                 /* mesh to remove triangles from */
+    int conf;                 /* how many vertices must be less confident */
+    int to_edge;              /* mark all the way to the edge? */
+    float max;                /* farthest a match on mesh 1 may be */
+    Vector* qpos;             /* vertex positions to match, in mesh 1's space */
+    Vector* qnorm;            /* vertex normals to match, in mesh 1's space */
+    NearPosition* near_list;  /* nearest place on mesh 1 to each vertex */
+    int* found_list;          /* whether each vertex found a near place */
+    int* slot;                /* where a vertex's answer is, by vertex index */
+    unsigned char* marks;     /* new mark of each listed triangle (0 = none) */
+    signed char* off_vert;    /* corner found off the mesh, or -1 if none */
+} Eat_Info;
+
 /******************************************************************************
-Go through list of potentially deletable triangles, marking them if they
-should be deleted.
+Find where a range of the vertices lie on the other mesh, for
+mark_for_eating().
+******************************************************************************/
+static void eat_nearest_range(int first, int last, int thread, void* data)
+{
+    Eat_Info* info = (Eat_Info*) data;
 
-Entry:
-  sc1   - scan with mesh to match
-  sc2   - scan with mesh to remove triangles from
-  draw  - whether or not to draw after eating
-  conf  - how many of the nearby positions on the other surface must be
-          more confident than the triangle's vertices for the tri to be deleted
-  to_edge - mark all the way to the edge?  If not, then stop short.
+    nearest_on_mesh_batch(info->sc1, info->m1, NULL, last - first,
+                          &info->qpos[first], &info->qnorm[first], info->max,
+                          EAT_NEAR_COS, &info->near_list[first],
+                          &info->found_list[first]);
+}
 
+/******************************************************************************
+Decide how to mark a range of the triangles on the list to examine, for
+mark_for_eating().  Nothing shared is written here: the marks are only
+recorded in info->marks and info->off_vert, to be set afterwards.
 ******************************************************************************/
-void mark_for_eating(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge)
+static void eat_mark_range(int first, int last, int thread, void* data)
 {
     int i, j;
-    Mesh* m1, *m2;
-    Triangle* tri;
-    Vertex* vert;
-    Vector c1;
-    Vector norm1;
     int r1;
     NearPosition n1;
-    int inc;
     float confidences[3];
     int conf_count;
-    float near_dist;
-    int myid;
-    int start, end;
-    int processes;
-
-    near_dist = global_near_dist;
-
-    m1 = sc1->meshes[mesh_level];
-    m2 = sc2->meshes[mesh_level];
-
-    inc = level_to_inc(mesh_level);
-
-    /* figure out which sub-range to examine, given my processor id */
-
-    myid = 0;
-    processes = 1;
-    start = m2->eat_list_num * (myid / (float) processes);
-    end   = m2->eat_list_num * ((myid + 1) / (float) processes) - 1;
-
-#if 0
-    printf("start end num: %d %d %d\n", start, end, m2->eat_list_num);
-#endif
-
-    /* examine all triangles in the list to examine */
+    Triangle* tri;
+    Vertex* vert;
+    Eat_Info* info = (Eat_Info*) data;
+    Mesh* m2 = info->m2;
 
-    for (i = start; i <= end; i++) {
+    for (i = first; i < last; i++) {
 
         tri = m2->eat_list[i];
+        info->marks[i] = 0;
+        info->off_vert[i] = -1;
 
         /* examine each triangle vertex in turn to see if they lie */
         /* on the other mesh */
@@ -446,57 +442,154 @@ void mark_for_eating(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge)
 
             /* if we already know that this vertex is off the mesh, */
             /* mark the triangle as such and move on */
-            if (vert->count == OFF_MESH) {
-                tri->eat_mark = OFF_MESH;
+            if (VERT_COUNT_MARK(m2, vert) == OFF_MESH) {
+                info->marks[i] = OFF_MESH;
                 goto break_loop;
             }
 
             /* see if this vertex is on the other mesh */
-            mesh_to_world(sc2, vert->coord, c1);
-            mesh_to_world_normal(sc2, vert->normal, norm1);
-            r1 = nearest_on_mesh(sc1, m1, NULL, c1, norm1, inc * near_dist,
-                                 EAT_NEAR_COS, &n1);
+            r1 = info->found_list[info->slot[vert->index]];
+            n1 = info->near_list[info->slot[vert->index]];
             r1 = r1 && (n1.on_edge == 0);
 
-            if (r1 && !to_edge) {
+            if (r1 && !info->to_edge) {
                 r1 = r1 && !is_near_edge(&n1);
-                if (!r1) {
-#if 0
-                    fprintf(stderr, "%d\n", n1.type);
-                    if (n1.type == NEAR_TRIANGLE)
-                        delete_triangle(n1.tri, sc1->meshes[mesh_level], 0);
-#endif
+                if (!r1)
                     goto break_loop;
-                }
             }
 
             confidences[j] = n1.confidence;
 
             /* if the vertex is NOT on the mesh, mark the triangle and go on */
             if (!r1) {
-                tri->eat_mark = OFF_MESH;
-                vert->count = OFF_MESH;
+                info->marks[i] = OFF_MESH;
+                info->off_vert[i] = j;
                 goto break_loop;
             }
         }
 
         /* remove this triangle if it's confidence is greater than */
         /* the near points to it */
-        conf_count  = confidences[0] > tri->verts[0]->confidence;
-        conf_count += confidences[1] > tri->verts[1]->confidence;
-        conf_count += confidences[2] > tri->verts[2]->confidence;
-        if (conf_count >= conf) {
-            tri->eat_mark = REMOVE;
+        conf_count  = confidences[0] > m2->confidence[tri->verts[0]->index];
+        conf_count += confidences[1] > m2->confidence[tri->verts[1]->index];
+        conf_count += confidences[2] > m2->confidence[tri->verts[2]->index];
+        if (conf_count >= info->conf)
+            info->marks[i] = REMOVE;
+
+    break_loop: ;  /* to break out of nested loop */
+    }
+}
+
+/******************************************************************************
+Go through list of potentially deletable triangles, marking them if they
+should be deleted.
+
+The vertices are matched against the other mesh and the triangles are
+judged in several threads.  The marks are then set in list order, which
+gives the same marks as judging the triangles one after the other: a vertex
+that one triangle finds to be off the mesh would be found off the mesh by
+any later triangle as well.
+
+Entry:
+  sc1   - scan with mesh to match
+  sc2   - scan with mesh to remove triangles from
+  draw  - whether or not to draw after eating
+  conf  - how many of the nearby positions on the other surface must be
+          more confident than the triangle's vertices for the tri to be deleted
+  to_edge - mark all the way to the edge?  If not, then stop short.
+
+******************************************************************************/
+void mark_for_eating(Scan* sc1, Scan* sc2, int draw, int conf, int to_edge)
+{
+    int i, j;
+    Mesh* m1, *m2;
+    Triangle* tri;
+    Vertex* vert;
+    int inc;
+    int num;
+    int nquery;
+    Scan_Xform xf;
+    Eat_Info info;
+
+    m1 = sc1->meshes[mesh_level];
+    m2 = sc2->meshes[mesh_level];
+
+    inc = level_to_inc(mesh_level);
+    num = m2->eat_list_num;
+
+    info.sc1 = sc1;
+    info.m1 = m1;
+    info.m2 = m2;
+    info.conf = conf;
+    info.to_edge = to_edge;
+    info.max = inc * global_near_dist;
+
+    /* find out where all the vertices we may need lie on the other mesh */
+    /* in one batch ("slot" says where a vertex's answer is) */
+
+    info.slot = (int*) malloc(sizeof(int) * (m2->nverts + 1));
+    info.qpos = (Vector*) malloc(sizeof(Vector) * 3 * (num + 1));
+    info.qnorm = (Vector*) malloc(sizeof(Vector) * 3 * (num + 1));
+    info.marks = (unsigned char*) malloc(sizeof(unsigned char) * (num + 1));
+    info.off_vert = (signed char*) malloc(sizeof(signed char) * (num + 1));
+    if (info.slot == NULL || info.qpos == NULL || info.qnorm == NULL ||
+            info.marks == NULL || info.off_vert == NULL) {
+        fprintf(stderr, "mark_for_eating: out of memory\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < num; i++)
+        for (j = 0; j < 3; j++)
+            info.slot[m2->eat_list[i]->verts[j]->index] = -1;
+
+    nquery = 0;
+    for (i = 0; i < num; i++)
+        for (j = 0; j < 3; j++) {
+            vert = m2->eat_list[i]->verts[j];
+            if (VERT_COUNT_MARK(m2, vert) == OFF_MESH || info.slot[vert->index] != -1)
+                continue;
+            info.slot[vert->index] = nquery;
+            vcopy(vert->coord, info.qpos[nquery]);
+            vcopy(vert->normal, info.qnorm[nquery]);
+            nquery++;
         }
 
-#if 0
-        /* if we get here then all three vertices are on the mesh, so */
-        /* we should mark the triangle for removal */
-        tri->eat_mark = REMOVE;
-#endif
+    /* take them all into mesh 1's coordinates at once */
+    scan_to_scan_xform(sc2, sc1, &xf);
+    xform_points(&xf, nquery, info.qpos, info.qnorm);
 
-    break_loop: ;  /* to break out of nested loop */
+    info.near_list = (NearPosition*) malloc(sizeof(NearPosition) * (nquery + 1));
+    info.found_list = (int*) malloc(sizeof(int) * (nquery + 1));
+    if (info.near_list == NULL || info.found_list == NULL) {
+        fprintf(stderr, "mark_for_eating: out of memory\n");
+        exit(-1);
     }
+
+    /* the threads may only read the triangles' edge planes */
+    if (m1->tri_tree == NULL)
+        make_edge_planes(m1);
+
+    parallel_for(nquery, 1024, eat_nearest_range, &info);
+
+    /* judge all triangles in the list to examine */
+    parallel_for(num, 1024, eat_mark_range, &info);
+
+    /* set the marks, in list order */
+    for (i = 0; i < num; i++) {
+        tri = m2->eat_list[i];
+        if (info.marks[i] != 0)
+            SET_TRI_EAT_MARK(m2, tri, info.marks[i]);
+        if (info.off_vert[i] != -1)
+            SET_VERT_COUNT_MARK(m2, tri->verts[info.off_vert[i]], OFF_MESH);
+    }
+
+    free(info.slot);
+    free(info.qpos);
+    free(info.qnorm);
+    free(info.near_list);
+    free(info.found_list);
+    free(info.marks);
+    free(info.off_vert);
 }
 
 /******************************************************************************
@@ -526,6 +619,7 @@ Entry:
 void gather_triangles(Scan* sc1, Scan* sc2)
 {
     int i;
+    int first;
     Mesh* m1, *m2;
     Vertex* vert;
     Triangle* tri;
@@ -533,6 +627,10 @@ void gather_triangles(Scan* sc1, Scan* sc2)
     m1 = sc1->meshes[mesh_level];
     m2 = sc2->meshes[mesh_level];
 
+    /* the triangles are changing hands, so any triangle trees are stale */
+    free_tri_tree(m1);
+    free_tri_tree(m2);
+
     /*** move the vertices from mesh 2 to mesh 1 ***/
 
     /* create room for new vertices */
@@ -545,6 +643,7 @@ void gather_triangles(Scan* sc1, Scan* sc2)
         fprintf(stderr, "could not realloc vertices\n");
         exit(-1);
     }
+    grow_vert_data(m1, m1->max_verts);
 
     /* mark the original vertices of mesh 1 as being from mesh 1 */
     for (i = 0; i < m1->nverts; i++)
@@ -558,12 +657,10 @@ void gather_triangles(Scan* sc1, Scan* sc2)
         /* convert between coordinate systems */
         mesh_to_world(sc2, vert->coord, vert->coord);
         world_to_mesh(sc1, vert->coord, vert->coord);
-        add_to_hash(vert, m1);
 
         /* place vertex in mesh 1 */
-        m1->verts[m1->nverts] = vert;
-        vert->index = m1->nverts;
-        m1->nverts++;
+        append_vertex(m1, m2, vert);
+        add_to_hash(vert, m1);
 
         /* mark the moved vertices as coming from m2 */
         vert->old_mesh = m2;
@@ -587,6 +684,7 @@ void gather_triangles(Scan* sc1, Scan* sc2)
     }
 
     /* move the triangles */
+    first = m1->ntris;
     for (i = 0; i < m2->ntris; i++) {
 
         tri = m2->tris[i];
@@ -596,28 +694,39 @@ void gather_triangles(Scan* sc1, Scan* sc2)
         tri->index = m1->ntris;
         m1->ntris++;
 
-        /* compute normal vector, plane coefficients and edge planes for triangle */
-        set_triangle_geometry(tri);
+        /* a mark from mesh 2's epochs means nothing in mesh 1 */
+        tri->mark_epoch = 0;
     }
 
-    /* re-calculate normals at vertices */
-    find_vertex_normals(m1);
+    /* compute normal vector, plane coefficients and edge planes for the */
+    /* moved triangles, and re-calculate normals at vertices */
+    refresh_geometry(&m1->tris[first], m2->ntris, m1->verts, m1->nverts);
 
     /* mark any edge information as invalid */
     m1->edges_valid = 0;
     m2->edges_valid = 0;
 
     /* free up hash table space in mesh 2 */
-    free(m2->table->verts);
-    m2->table->verts = NULL;
+    free(m2->table->cells);
+    m2->table->cells = NULL;
+    free_vert_data(m2);
 
     /* free up triangle space in mesh 2 */
     free(m2->tris);
     m2->tris = NULL;
 
+    /* mesh 1 now holds mesh 2's vertices and triangles */
+    absorb_mesh_arena(m1, m2);
+
     /* set mesh 2 to be empty */
     m2->ntris = 0;
     m2->nverts = 0;
+
+    /* the vertices and triangles of mesh 2 were put at the end of mesh 1's */
+    /* lists; sort them in among the others if asked to (this changes the */
+    /* order that the clipping and zippering passes visit them in) */
+    if (get_gather_reorder())
+        order_mesh(m1);
 }
 
 /******************************************************************************
@@ -634,8 +743,7 @@ void zipper_meshes(Scan* sc1, Scan* sc2)
     NearPosition near_info;
     int result;
     Vertex* vert;
-    Vector pos, norm;
-    Vector near_pos;
+    Vector pos;
     Vector diff;
     static Vertex* near_list[100];
     static float near_dist[100];
@@ -643,15 +751,29 @@ void zipper_meshes(Scan* sc1, Scan* sc2)
     int index;
     float min_dist;
     int inc;
+    int n, nquery;
+    Vertex** qverts;
+    Vector* qpos;
+    Vector* qnorm;
+    Scan_Xform xf;
+    Scan_Xform back_xf;
+    NearPosition* near_list_info;
+    int* found_list;
 
     m1 = sc1->meshes[mesh_level];
     m2 = sc2->meshes[mesh_level];
 
     inc = level_to_inc(mesh_level);
 
-    /* search the vertices along the edge of mesh 2 for nearby places */
-    /* on mesh 1 */
+    start_tri_tree_phase(ZIPPER_PHASE, m1);
+
+    /* collect the vertices along the edge of mesh 2 */
+
+    qverts = (Vertex**) malloc(sizeof(Vertex*) * (m2->nverts + 1));
+    qpos = (Vector*) malloc(sizeof(Vector) * (m2->nverts + 1));
+    qnorm = (Vector*) malloc(sizeof(Vector) * (m2->nverts + 1));
 
+    nquery = 0;
     for (i = 0; i < m2->nverts; i++) {
 
         vert = m2->verts[i];
@@ -660,13 +782,34 @@ void zipper_meshes(Scan* sc1, Scan* sc2)
         if (vert->ntris == 0 || !vert->on_edge)
             continue;
 
-        /* convert to global coordinates */
-        mesh_to_world(sc2, vert->coord, pos);
-        mesh_to_world_normal(sc2, vert->normal, norm);
+        qverts[nquery] = vert;
+        vcopy(vert->coord, qpos[nquery]);
+        vcopy(vert->normal, qnorm[nquery]);
+        nquery++;
+    }
+
+    /* convert them all to mesh 1's coordinates at once */
+    scan_to_scan_xform(sc2, sc1, &xf);
+    scan_to_scan_xform(sc1, sc2, &back_xf);
+    xform_points(&xf, nquery, qpos, qnorm);
+
+    /* find nearest places on the other mesh for all of them at once */
+
+    near_list_info = (NearPosition*) malloc(sizeof(NearPosition) * (nquery + 1));
+    found_list = (int*) malloc(sizeof(int) * (nquery + 1));
 
-        /* find nearest places on the other mesh */
-        result = nearest_on_mesh(sc1, m1, NULL, pos, norm,
-                                 inc * EAT_NEAR_DIST, FIND_COS, &near_info);
+    nearest_on_mesh_batch(sc1, m1, NULL, nquery, qpos, qnorm,
+                          inc * EAT_NEAR_DIST, FIND_COS, near_list_info, found_list);
+
+    /* search the vertices along the edge of mesh 2 for nearby places */
+    /* on mesh 1 */
+
+    for (n = 0; n < nquery; n++) {
+
+        vert = qverts[n];
+        vcopy(qpos[n], pos);
+        result = found_list[n];
+        near_info = near_list_info[n];
 
         /* go on to next vertex if there is no nearby place on the other */
         /* mesh or if the nearest position is on the edge of its mesh */
@@ -698,8 +841,7 @@ void zipper_meshes(Scan* sc1, Scan* sc2)
         nlist_count = 0;
         if (near_info.v1->on_edge) {
             near_list[0] = near_info.v1;
-            mesh_to_world(sc1, near_info.v1->coord, near_pos);
-            vsub(near_pos, pos, diff);
+            vsub(near_info.v1->coord, pos, diff);
             near_dist[0] = vlen(diff);
             nlist_count = 1;
         }
@@ -709,8 +851,7 @@ void zipper_meshes(Scan* sc1, Scan* sc2)
         for (j = 0; j < near_info.v1->nverts; j++) {
             if (near_info.v1->verts[j]->on_edge) {
                 near_list[nlist_count] = near_info.v1->verts[j];
-                mesh_to_world(sc1, near_list[nlist_count]->coord, near_pos);
-                vsub(near_pos, pos, diff);
+                vsub(near_list[nlist_count]->coord, pos, diff);
                 near_dist[nlist_count] = vlen(diff);
                 nlist_count++;
             }
@@ -732,13 +873,20 @@ void zipper_meshes(Scan* sc1, Scan* sc2)
         }
 
         /* for now, just move this vertex to the first edge vertex */
-        mesh_to_world(sc1, near_list[index]->coord, vert->coord);
-        world_to_mesh(sc2, vert->coord, vert->coord);
+        xform_point(&back_xf, near_list[index]->coord, vert->coord);
 
         /* and mark that it is being moved */
         vert->moving = 1;
         vert->move_to = near_list[index];
     }
+
+    free(qverts);
+    free(qpos);
+    free(qnorm);
+    free(near_list_info);
+    free(found_list);
+
+    free_tri_tree(m1);
 }
 
 /******************************************************************************
@@ -1027,10 +1175,15 @@ void move_vertices(Scan* source, Scan* dest)
     Vertex* dvert;
     Triangle* tri;
     int found;
+    int first;
 
     msource = source->meshes[mesh_level];
     mdest   = dest->meshes[mesh_level];
 
+    /* the triangles are changing hands, so any triangle trees are stale */
+    free_tri_tree(msource);
+    free_tri_tree(mdest);
+
     /* move the vertices from the source mesh to the destination mesh */
 
     for (i = 0; i < msource->nverts; i++) {
@@ -1047,11 +1200,8 @@ void move_vertices(Scan* source, Scan* dest)
         /* copy the triangles from one vertex to the other */
         for (j = 0; j < vert->ntris; j++) {
             /* make sure there is room in triangle list */
-            if (dvert->ntris >= dvert->max_tris) {
-                dvert->max_tris += 4;
-                dvert->tris = (Triangle**)
-                              realloc(dvert->tris, sizeof(Triangle*) * dvert->max_tris);
-            }
+            if (dvert->ntris >= dvert->max_tris)
+                grow_vertex_tris(mdest, dvert);
             /* add to the list */
             dvert->tris[dvert->ntris++] = vert->tris[j];
         }
@@ -1073,11 +1223,8 @@ void move_vertices(Scan* source, Scan* dest)
                 continue;
 
             /* make sure there is room in vertex list */
-            if (dvert->nverts >= dvert->max_verts) {
-                dvert->max_verts += 4;
-                dvert->verts = (Vertex**)
-                               realloc(dvert->verts, sizeof(Vertex*) * dvert->max_verts);
-            }
+            if (dvert->nverts >= dvert->max_verts)
+                grow_vertex_verts(mdest, dvert);
 
             /* add to the vertex list, using the name of the vertex AFTER */
             /* the move */
@@ -1108,27 +1255,18 @@ void move_vertices(Scan* source, Scan* dest)
         if (vert->moving)
             continue;
 
-        /* make sure there is room for new vertex */
-        if (mdest->nverts == mdest->max_verts) {
-            mdest->max_verts = (int)(mdest->max_verts * 1.5);
-            mdest->verts = (Vertex**)
-                           realloc(mdest->verts, sizeof(Vertex*) * mdest->max_verts);
-        }
-
-        /* add vertex to the list */
-        mdest->verts[mdest->nverts] = vert;
-        mdest->verts[mdest->nverts]->index = mdest->nverts;
-        mdest->nverts++;
-
         /* convert between coordinate systems */
         mesh_to_world(source, vert->coord, vert->coord);
         world_to_mesh(dest, vert->coord, vert->coord);
 
-        /* add this vertex to hash table */
+        /* add vertex to the list, and to the hash table */
+        append_vertex(mdest, msource, vert);
         add_to_hash(vert, mdest);
     }
 
-    /* delete triangles that have two or more vertices the same */
+    /* delete triangles that have two or more vertices the same (their */
+    /* vertices all belong to the destination mesh by now, so that is */
+    /* where any vertex left without triangles is deleted from) */
 
     for (i = msource->ntris - 1; i >= 0; i--) {
 
@@ -1139,11 +1277,19 @@ void move_vertices(Scan* source, Scan* dest)
         v2 = tri->verts[1];
         v3 = tri->verts[2];
 
-        if ((v1 == v2) || (v1 == v3) || (v2 == v3))
-            delete_triangle(tri, msource, 1);
+        if ((v1 == v2) || (v1 == v3) || (v2 == v3)) {
+            delete_triangle(tri, msource, 0);
+            if (v1->ntris == 0)
+                delete_vertex(v1, mdest);
+            if (v2 != v1 && v2->ntris == 0)
+                delete_vertex(v2, mdest);
+            if (v3 != v1 && v3 != v2 && v3->ntris == 0)
+                delete_vertex(v3, mdest);
+        }
     }
 
     /* copy over the triangles */
+    first = mdest->ntris;
     for (i = 0; i < msource->ntris; i++) {
 
         tri = msource->tris[i];
@@ -1160,8 +1306,8 @@ void move_vertices(Scan* source, Scan* dest)
         mdest->tris[mdest->ntris]->index = mdest->ntris;
         mdest->ntris++;
 
-        /* compute normal vector, plane coefficients and edge planes for triangle */
-        set_triangle_geometry(tri);
+        /* a mark from the source mesh's epochs means nothing here */
+        tri->mark_epoch = 0;
     }
 
 #if 0
@@ -1173,8 +1319,9 @@ void move_vertices(Scan* source, Scan* dest)
                       100.0);
 #endif
 
-    /* re-compute normal vectors at vertices */
-    find_vertex_normals(mdest);
+    /* compute normal vector, plane coefficients and edge planes for the */
+    /* copied triangles, and re-compute normal vectors at vertices */
+    refresh_geometry(&mdest->tris[first], msource->ntris, mdest->verts, mdest->nverts);
 
     /*** clean up junk in source mesh ***/
     /*** clean up junk in source mesh ***/
@@ -1185,9 +1332,22 @@ void move_vertices(Scan* source, Scan* dest)
     /*** clean up junk in source mesh ***/
     /*** clean up junk in source mesh ***/
 
+    /* the moved vertices may still be pointed to, so they keep */
+    /* their positions outside of the source mesh's arrays */
+    for (i = 0; i < msource->nverts; i++)
+        if (msource->verts[i]->moving)
+            retire_vertex(msource, msource->verts[i]);
+
     msource->nverts = 0;
     msource->ntris = 0;
 
+    /* empty the source mesh's hash table, and free its vertex arrays */
+    rehash_table(msource);
+    free_vert_data(msource);
+
+    /* the destination mesh now holds the source mesh's storage */
+    absorb_mesh_arena(mdest, msource);
+
     /* mark both mesh boundary structures as invalid */
     msource->edges_valid = 0;
     mdest->edges_valid   = 0;
@@ -0,0 +1,594 @@
+/*
+ * Bounding volume hierarchy over the triangles of a mesh, for finding
+ * the exact nearest position on a mesh.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Internal
+#include "tritree.h"
+#include "draw.h"
+
+// most triangles to place in one leaf of the tree
+#define TREE_LEAF_SIZE 4
+
+// deepest tree we can search (the tree is balanced, so this is plenty)
+#define TREE_STACK_MAX 128
+
+// Parameters
+static int TRI_TREE_PHASES[NUM_PHASES]; /* which phases search with a tree */
+
+void set_tri_tree_phase(int phase, int use_tree)
+{
+    if (phase < 0 || phase >= NUM_PHASES) {
+        fprintf(stderr, "set_tri_tree_phase: bad phase %d\n", phase);
+        return;
+    }
+    TRI_TREE_PHASES[phase] = use_tree;
+}
+
+int get_tri_tree_phase(int phase)
+{
+    if (phase < 0 || phase >= NUM_PHASES)
+        return (0);
+    return (TRI_TREE_PHASES[phase]);
+}
+
+/******************************************************************************
+Give a mesh a triangle tree if the given phase has been told to use one.
+While the mesh has a tree, nearest_on_mesh() searches the tree instead of
+the hash table.  Changing the mesh's triangles throws the tree away.
+
+Entry:
+  phase - which phase is about to search the mesh
+  mesh  - the mesh that will be searched
+******************************************************************************/
+void start_tri_tree_phase(int phase, Mesh* mesh)
+{
+    if (!get_tri_tree_phase(phase))
+        return;
+
+    if (mesh->tri_tree == NULL && mesh->ntris > 0)
+        mesh->tri_tree = build_tri_tree(mesh);
+}
+
+/******************************************************************************
+Free up the triangle tree of a mesh, if it has one.
+
+Entry:
+  mesh - mesh whose tree to free
+******************************************************************************/
+void free_tri_tree(Mesh* mesh)
+{
+    Tri_Tree* tree = mesh->tri_tree;
+
+    if (tree == NULL)
+        return;
+
+    free(tree->tris);
+    free(tree->nodes);
+    free(tree);
+
+    mesh->tri_tree = NULL;
+}
+
+/******************************************************************************
+Partially sort a range of triangles so that the one whose center is the
+median along a given axis is in the middle, with smaller ones before it
+and larger ones after it.
+
+Entry:
+  tris    - triangles
+  centers - triangle centers, in the same order
+  lo,hi   - range of triangles to sort (hi is one past the last)
+  axis    - axis to sort along
+******************************************************************************/
+static void split_at_median(Triangle** tris, Vector* centers, int lo, int hi, int axis)
+{
+    int i, j, k;
+    int mid;
+    float pivot;
+    Triangle* ttemp;
+    Vector vtemp;
+
+    mid = (lo + hi) / 2;
+    hi--;
+
+    while (lo < hi) {
+
+        pivot = centers[(lo + hi) / 2][axis];
+        i = lo;
+        j = hi;
+
+        /* partition around the pivot */
+        while (i <= j) {
+            while (centers[i][axis] < pivot)
+                i++;
+            while (centers[j][axis] > pivot)
+                j--;
+            if (i <= j) {
+                ttemp = tris[i];
+                tris[i] = tris[j];
+                tris[j] = ttemp;
+                for (k = 0; k < 3; k++) {
+                    vtemp[k] = centers[i][k];
+                    centers[i][k] = centers[j][k];
+                    centers[j][k] = vtemp[k];
+                }
+                i++;
+                j--;
+            }
+        }
+
+        /* keep going in the part that holds the median */
+        if (mid <= j)
+            hi = j;
+        else if (mid >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+/******************************************************************************
+Compute the bounding box of a range of triangles.
+
+Entry:
+  tris  - triangles
+  lo,hi - range of triangles (hi is one past the last)
+
+Exit:
+  node - min and max are set to the bounding box
+******************************************************************************/
+static void bound_triangles(Triangle** tris, int lo, int hi, Tri_Node* node)
+{
+    int i, j, k;
+    float* p;
+
+    for (k = 0; k < 3; k++) {
+        node->min[k] = 1e20;
+        node->max[k] = -1e20;
+    }
+
+    for (i = lo; i < hi; i++)
+        for (j = 0; j < 3; j++) {
+            p = tris[i]->verts[j]->coord;
+            for (k = 0; k < 3; k++) {
+                if (p[k] < node->min[k])
+                    node->min[k] = p[k];
+                if (p[k] > node->max[k])
+                    node->max[k] = p[k];
+            }
+        }
+}
+
+/******************************************************************************
+Build a bounding volume hierarchy over the triangles of a mesh.  Each node
+is split at the median triangle center along the longest side of the
+node's box.
+
+Entry:
+  mesh - mesh to build a tree for
+
+Exit:
+  returns the new tree
+******************************************************************************/
+Tri_Tree* build_tri_tree(Mesh* mesh)
+{
+    int i, k;
+    int n;
+    int top;
+    int index;
+    int axis;
+    int lo, hi, mid;
+    int stack[TREE_STACK_MAX][3];
+    Tri_Tree* tree;
+    Tri_Node* node;
+    Vector* centers;
+    Triangle* tri;
+    Vector size;
+
+    n = mesh->ntris;
+
+    tree = (Tri_Tree*) malloc(sizeof(Tri_Tree));
+    tree->ntris = n;
+    tree->tris = (Triangle**) malloc(sizeof(Triangle*) * (n + 1));
+    tree->nodes = (Tri_Node*) malloc(sizeof(Tri_Node) * (2 * n + 1));
+    centers = (Vector*) malloc(sizeof(Vector) * (n + 1));
+
+    /* copy the triangles and find their centers */
+    for (i = 0; i < n; i++) {
+        tri = mesh->tris[i];
+        tree->tris[i] = tri;
+        for (k = 0; k < 3; k++)
+            centers[i][k] = (tri->verts[0]->coord[k] + tri->verts[1]->coord[k] +
+                             tri->verts[2]->coord[k]) * (1 / 3.0);
+    }
+
+    /* create the root and split nodes until they are small enough */
+
+    tree->nnodes = 1;
+    top = 0;
+    stack[top][0] = 0;
+    stack[top][1] = 0;
+    stack[top][2] = n;
+    top++;
+
+    while (top > 0) {
+
+        top--;
+        index = stack[top][0];
+        lo = stack[top][1];
+        hi = stack[top][2];
+
+        node = &tree->nodes[index];
+        bound_triangles(tree->tris, lo, hi, node);
+
+        /* make a leaf if there are few enough triangles */
+        if (hi - lo <= TREE_LEAF_SIZE || top + 2 > TREE_STACK_MAX) {
+            node->first = lo;
+            node->count = hi - lo;
+            continue;
+        }
+
+        /* split along the longest side of the box */
+        vsub(node->max, node->min, size);
+        axis = X;
+        if (size[Y] > size[axis])
+            axis = Y;
+        if (size[Z] > size[axis])
+            axis = Z;
+
+        mid = (lo + hi) / 2;
+        split_at_median(tree->tris, centers, lo, hi, axis);
+
+        /* the two children are placed next to each other */
+        node->first = tree->nnodes;
+        node->count = 0;
+        tree->nnodes += 2;
+
+        stack[top][0] = node->first;
+        stack[top][1] = lo;
+        stack[top][2] = mid;
+        top++;
+        stack[top][0] = node->first + 1;
+        stack[top][1] = mid;
+        stack[top][2] = hi;
+        top++;
+    }
+
+    free(centers);
+
+    return (tree);
+}
+
+/******************************************************************************
+Find the squared distance from a point to a node's bounding box.
+******************************************************************************/
+static float box_dist_squared(Tri_Node* node, Vector p)
+{
+    int k;
+    float d;
+    float sum = 0;
+
+    for (k = 0; k < 3; k++) {
+        if (p[k] < node->min[k]) {
+            d = node->min[k] - p[k];
+            sum += d * d;
+        } else if (p[k] > node->max[k]) {
+            d = p[k] - node->max[k];
+            sum += d * d;
+        }
+    }
+
+    return (sum);
+}
+
+/******************************************************************************
+Find the nearest point on a triangle to a given point.
+
+Entry:
+  tri - the triangle
+  p   - the point
+
+Exit:
+  near        - nearest point on the triangle
+  barycentric - weights of the triangle's vertices at the near point
+  returns NEAR_VERTEX, NEAR_EDGE or NEAR_TRIANGLE, depending on whether the
+  near point is at a vertex, on an edge or inside the triangle
+******************************************************************************/
+static int nearest_on_triangle(Triangle* tri, Vector p, Vector near, Vector barycentric)
+{
+    float* a = tri->verts[0]->coord;
+    float* b = tri->verts[1]->coord;
+    float* c = tri->verts[2]->coord;
+    Vector ab, ac, ap, bp, cp;
+    float d1, d2, d3, d4, d5, d6;
+    float va, vb, vc;
+    float v, w;
+    float denom;
+
+    vsub(b, a, ab);
+    vsub(c, a, ac);
+
+    /* at vertex a? */
+    vsub(p, a, ap);
+    d1 = vdot(ab, ap);
+    d2 = vdot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) {
+        vset(barycentric, 1, 0, 0);
+        vcopy(a, near);
+        return (NEAR_VERTEX);
+    }
+
+    /* at vertex b? */
+    vsub(p, b, bp);
+    d3 = vdot(ab, bp);
+    d4 = vdot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) {
+        vset(barycentric, 0, 1, 0);
+        vcopy(b, near);
+        return (NEAR_VERTEX);
+    }
+
+    /* on edge ab? */
+    vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        v = d1 / (d1 - d3);
+        vset(barycentric, 1 - v, v, 0);
+        near[X] = a[X] + v * ab[X];
+        near[Y] = a[Y] + v * ab[Y];
+        near[Z] = a[Z] + v * ab[Z];
+        return (NEAR_EDGE);
+    }
+
+    /* at vertex c? */
+    vsub(p, c, cp);
+    d5 = vdot(ab, cp);
+    d6 = vdot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) {
+        vset(barycentric, 0, 0, 1);
+        vcopy(c, near);
+        return (NEAR_VERTEX);
+    }
+
+    /* on edge ac? */
+    vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        w = d2 / (d2 - d6);
+        vset(barycentric, 1 - w, 0, w);
+        near[X] = a[X] + w * ac[X];
+        near[Y] = a[Y] + w * ac[Y];
+        near[Z] = a[Z] + w * ac[Z];
+        return (NEAR_EDGE);
+    }
+
+    /* on edge bc? */
+    va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        vset(barycentric, 0, 1 - w, w);
+        near[X] = b[X] + w * (c[X] - b[X]);
+        near[Y] = b[Y] + w * (c[Y] - b[Y]);
+        near[Z] = b[Z] + w * (c[Z] - b[Z]);
+        return (NEAR_EDGE);
+    }
+
+    /* inside the triangle */
+    denom = 1 / (va + vb + vc);
+    v = vb * denom;
+    w = vc * denom;
+    vset(barycentric, 1 - v - w, v, w);
+    near[X] = a[X] + v * ab[X] + w * ac[X];
+    near[Y] = a[Y] + v * ab[Y] + w * ac[Y];
+    near[Z] = a[Z] + v * ab[Z] + w * ac[Z];
+    return (NEAR_TRIANGLE);
+}
+
+/******************************************************************************
+Find the nearest location on a mesh to a given position by searching the
+mesh's triangle tree.  This gives the same kind of answer as
+nearest_on_mesh(), but looks at every triangle that could be nearer than
+"max" instead of only the triangles around the nearest vertex.
+
+Entry:
+  sc       - the scan of the mesh
+  mesh     - the mesh (must have a triangle tree)
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  pos      - position (in global coordinates) to find nearest point to
+  norm     - surface normal at pos
+  max      - maximum acceptable distance
+  min_dot  - minimum allowed dot product between given normal and the
+             normal of the matching triangle
+
+Exit:
+  near_info - information about nearest position on mesh, including 3D position
+              in global coordinates
+  returns 1 if it found a near point, 0 if it couldn't find any near point
+******************************************************************************/
+int tree_nearest_on_mesh(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh,
+    Vector pos, Vector norm, float max, float min_dot,
+    NearPosition* near_info
+) {
+    Vector v, tnorm;
+
+    /* transform position into the meshes coordinate space */
+    world_to_mesh(sc, pos, v);
+    world_to_mesh_normal(sc, norm, tnorm);
+
+    return (tree_nearest_in_mesh(sc, mesh, not_mesh, v, tnorm, max, min_dot,
+                                 near_info));
+}
+
+/******************************************************************************
+Find the nearest location on a mesh to a position that is already in the
+mesh's coordinate space, by searching the mesh's triangle tree.
+
+Entry:
+  sc       - the scan of the mesh
+  mesh     - the mesh (must have a triangle tree)
+  not_mesh - mesh to reject matches from (old_mesh field of Vertex)
+  v        - position (in mesh's coordinates) to find nearest point to
+  tnorm    - surface normal at v (in mesh's coordinates)
+  max      - maximum acceptable distance
+  min_dot  - minimum allowed dot product between given normal and the
+             normal of the matching triangle
+
+Exit:
+  near_info - information about nearest position on mesh, including 3D position
+              in global coordinates
+  returns 1 if it found a near point, 0 if it couldn't find any near point
+******************************************************************************/
+int tree_nearest_in_mesh(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh,
+    Vector v, Vector tnorm, float max, float min_dot,
+    NearPosition* near_info
+) {
+    int i, k;
+    int top;
+    int stack[TREE_STACK_MAX];
+    int type;
+    int near_type = NEAR_VERTEX;
+    Tri_Tree* tree = mesh->tri_tree;
+    Tri_Node* node;
+    Triangle* tri;
+    Triangle* near_tri = NULL;
+    Vector on, near_pos;
+    Vector diff;
+    Vector bary, near_bary;
+    float dist;
+    float min_dist;
+    float dot;
+    float d0, d1;
+    Vertex* vert;
+
+    /* only positions nearer than max are of interest (use squared distance) */
+    min_dist = max * max;
+
+    /* search the tree, nearer child first */
+
+    top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+
+        node = &tree->nodes[stack[--top]];
+
+        if (box_dist_squared(node, v) >= min_dist)
+            continue;
+
+        /* interior node */
+        if (node->count == 0) {
+            d0 = box_dist_squared(&tree->nodes[node->first], v);
+            d1 = box_dist_squared(&tree->nodes[node->first + 1], v);
+            if (d0 < d1) {
+                stack[top++] = node->first + 1;
+                stack[top++] = node->first;
+            } else {
+                stack[top++] = node->first;
+                stack[top++] = node->first + 1;
+            }
+            continue;
+        }
+
+        /* leaf, so examine its triangles */
+        for (i = node->first; i < node->first + node->count; i++) {
+
+            tri = tree->tris[i];
+
+            /* don't examine triangle if it's old mesh is not_mesh */
+            if (tri->verts[0]->old_mesh == not_mesh)
+                continue;
+
+            /* make sure the surface normals are roughly in the same direction */
+            dot = -(tnorm[X] * tri->aa + tnorm[Y] * tri->bb + tnorm[Z] * tri->cc);
+            if (dot < min_dot)
+                continue;
+
+            type = nearest_on_triangle(tri, v, on, bary);
+            vsub(v, on, diff);
+            dist = vdot(diff, diff);
+
+            if (dist < min_dist) {
+                min_dist = dist;
+                near_tri = tri;
+                near_type = type;
+                vcopy(on, near_pos);
+                vcopy(bary, near_bary);
+            }
+        }
+    }
+
+    /* no triangle near enough */
+    if (near_tri == NULL)
+        return (0);
+
+    /* the nearest vertex is the one with the most weight */
+    k = 0;
+    if (near_bary[1] > near_bary[k])
+        k = 1;
+    if (near_bary[2] > near_bary[k])
+        k = 2;
+
+    near_info->tri = near_tri;
+    near_info->v1 = near_tri->verts[k];
+    near_info->v2 = NULL;
+    near_info->type = near_type;
+    near_info->dist = sqrt(min_dist);
+    near_info->on_edge = 0;
+    near_info->confidence = near_bary[0] * mesh->confidence[near_tri->verts[0]->index] +
+                            near_bary[1] * mesh->confidence[near_tri->verts[1]->index] +
+                            near_bary[2] * mesh->confidence[near_tri->verts[2]->index];
+
+    if (near_type == NEAR_VERTEX) {
+        near_info->on_edge = near_info->v1->on_edge;
+    } else if (near_type == NEAR_EDGE) {
+        /* the other end of the edge is the vertex with weight left over */
+        for (i = 0; i < 3; i++) {
+            vert = near_tri->verts[i];
+            if (i != k && near_bary[i] > 0)
+                near_info->v2 = vert;
+        }
+        if (near_info->v2 == NULL)
+            near_info->v2 = near_tri->verts[(k + 1) % 3];
+        near_info->b1 = near_bary[k];
+        near_info->b2 = 1 - near_bary[k];
+        near_info->on_edge = near_info->v1->on_edge && near_info->v2->on_edge;
+    } else {
+        near_info->b1 = near_bary[0];
+        near_info->b2 = near_bary[1];
+        near_info->b3 = near_bary[2];
+    }
+
+    mesh_to_world(sc, near_pos, near_info->pos);
+    return (1);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ZIPPER_TRITREE_H
+#define ZIPPER_TRITREE_H
+
+// Internal
+#include "zipper.h"
+#include "matrix.h"
+
+// Phases that can search with a triangle tree instead of the hash table
+#define EAT_PHASE       0
+#define CLIP_PHASE      1
+#define ZIPPER_PHASE    2
+#define CONSENSUS_PHASE 3
+#define NUM_PHASES      4
+
+// Node of a bounding volume hierarchy over triangles
+typedef struct Tri_Node {
+    Vector min, max;      /* bounding box of the node's triangles */
+    int first;            /* first triangle (leaf) or first child (interior) */
+    int count;            /* number of triangles in a leaf, 0 if interior */
+} Tri_Node;
+
+// Bounding volume hierarchy over the triangles of a mesh
+typedef struct Tri_Tree {
+    Triangle** tris;      /* triangles, in leaf order */
+    int ntris;            /* number of triangles */
+    Tri_Node* nodes;      /* nodes, root first; children are adjacent */
+    int nnodes;           /* number of nodes */
+} Tri_Tree;
+
+// Parameters
+void set_tri_tree_phase(int phase, int use_tree);
+int get_tri_tree_phase(int phase);
+
+// Declarations
+void start_tri_tree_phase(int phase, Mesh* mesh);
+Tri_Tree* build_tri_tree(Mesh* mesh);
+void free_tri_tree(Mesh* mesh);
+int tree_nearest_on_mesh(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh,
+    Vector pos, Vector norm, float max, float min_dot,
+    NearPosition* near_info
+);
+int tree_nearest_in_mesh(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh,
+    Vector v, Vector tnorm, float max, float min_dot,
+    NearPosition* near_info
+);
+
+#endif
@@ -49,40 +49,63 @@ struct FillTri;
 struct RawData;
 struct RangeData;
 
+/* room kept inside each vertex for its lists of triangles, vertices and */
+/* edges, enough for the valence of a vertex in a regular range grid (six */
+/* triangles and neighbors) and for the two edges of a boundary vertex; */
+/* vertices with more take their lists from the mesh's arena */
+#define VERT_INLINE_TRIS  6
+#define VERT_INLINE_VERTS 6
+#define VERT_INLINE_EDGES 2
+
+typedef unsigned char Color[3]; /* red, green and blue */
+
 typedef struct Vertex {     /* vertex for a mesh of triangles */
-    Vector coord;         /* position */
-    Vector normal;        /* surface normal */
-    struct Triangle** tris;   /* list of triangles that share this vertex */
-    struct Vertex** verts;    /* list of vertices that share an edge */
-    struct Edge** edges;      /* list of edges for vertex */
+
+    /* position and normal, kept in the mesh's coords and normals arrays */
+    float* coord;         /* position (mesh->coords[index]) */
+    float* normal;        /* surface normal (mesh->normals[index]) */
+    struct Mesh* old_mesh;    /* mesh this vertex used to belong to */
+    int index;            /* position of vertex in mesh array */
     unsigned char on_edge;    /* flag: is vertex on edge of mesh? */
     unsigned char count;      /* used to determine if vertex is on edge */
-    unsigned char ntris;      /* number of triangles in list */
-    unsigned char max_tris;   /* current maximum # of triangles in list */
-    unsigned char nverts;     /* number of vertices in list */
-    unsigned char max_verts;  /* current maximum # of vertices in list */
-    unsigned char nedges;     /* number of edges in list */
-    unsigned char max_edges;  /* current maximum number of edges in list */
     unsigned char moving;     /* is vertex being moved to another mesh? */
-    unsigned char red, grn, blu;  /* color at the vertex */
-    float confidence;     /* confidence about the position of vertex */
-    float intensity;      /* intensity at vertex */
+    unsigned int mark_epoch;  /* mesh epoch when count or move_to was marked */
+
+    /* connections to the rest of the mesh */
+    struct Triangle** tris;   /* list of triangles that share this vertex */
+    struct Vertex** verts;    /* list of vertices that share an edge */
+    struct Edge** edges;      /* list of edges for vertex */
+    int ntris;            /* number of triangles in list */
+    int max_tris;         /* current maximum # of triangles in list */
+    int nverts;           /* number of vertices in list */
+    int max_verts;        /* current maximum # of vertices in list */
+    int nedges;           /* number of edges in list */
+    int max_edges;        /* current maximum number of edges in list */
+
+    /* other attributes, kept apart from the connections */
     struct Cinfo* cinfo;      /* consensus geometry info */
-    struct Mesh* old_mesh;    /* mesh this vertex used to belong to */
     struct Vertex* move_to;   /* for moving vertex to another mesh */
-    struct Vertex* next;      /* for linked list */
-    int index;            /* position of vertex in mesh array */
+
+    struct Triangle* tri_space[VERT_INLINE_TRIS]; /* tris until it outgrows this */
+    struct Vertex* vert_space[VERT_INLINE_VERTS]; /* verts until it outgrows this */
+    struct Edge* edge_space[VERT_INLINE_EDGES];   /* edges until it outgrows this */
 } Vertex;
 
+typedef struct Edge_Planes { /* planes through a triangle's edges */
+    float a[3], b[3], c[3], d[3]; /* plane equations for edges */
+} Edge_Planes;
+
 typedef struct Triangle {   /* triangle in a mesh */
     Vertex* verts[3];     /* vertices of triangle */
-    float a[3], b[3], c[3], d[3]; /* plane equations for edges */
     float aa, bb, cc, dd;     /* plane equation containing triangle */
+    Edge_Planes* planes;  /* edge planes, made when first asked for (or NULL) */
     int index;            /* position of triangle in mesh array */
     struct Clipped_Edge* clips;   /* where tri is clipped (list of 3 (edges)) */
     struct More_Tri_Stuff* more;  /* double-precision numbers for clipping */
     unsigned char mark, eat_mark; /* flags */
     unsigned char dont_touch; /* don't touch this triangle during eating */
+    unsigned char deleted;    /* waiting in a Tri_Batch to be deleted */
+    unsigned int mark_epoch;  /* mesh epoch when eat_mark was marked */
 } Triangle;
 
 typedef struct More_Tri_Stuff {
@@ -98,17 +121,40 @@ typedef struct More_Tri_Stuff {
     struct FillTri* fill_tri; /* pointer to fill triangle (if one exists) */
 } More_Tri_Stuff;
 
-#define PR1  17
-#define PR2 101
-#define TABLE_SIZE1  5003
-#define TABLE_SIZE2 17003
-#define TABLE_SIZE3 53003
+/* large primes that mix a cell's coordinates into a hash table index */
+#define PR1 73856093u
+#define PR2 19349663u
+#define PR3 83492791u
+
+/* hash table index of cell (a,b,c) in a table with n cells */
+#define CELL_INDEX(a,b,c,n) \
+    ((int) ((((unsigned int) (a) * PR1) ^ ((unsigned int) (b) * PR2) ^ \
+             ((unsigned int) (c) * PR3)) % (unsigned int) (n)))
+
+#define TABLE_MIN_SIZE 5003 /* smallest number of hash cells */
+#define TABLE_LOAD        1 /* points per hash cell when table is (re)sized */
+#define TABLE_MAX_LOAD    2 /* points per hash cell before the table grows */
+
+typedef struct Cell_Table { /* hash table points copied out in cell order */
+    int* first;           /* start of each cell's points (num_entries + 1) */
+    Vertex** verts;       /* the vertices, sorted by hash cell */
+    float* coords[3];     /* copy of vertex positions, one array per axis */
+    float* normals[3];    /* copy of vertex normals, one array per axis */
+    struct Mesh** old_mesh; /* copy of vertex old_mesh, in the same order */
+} Cell_Table;
+
+/* a vertex's hash_prev when it is first in hash cell "cell", and when it */
+/* isn't in the table at all */
+#define HASH_HEAD(cell) (-2 - (cell))
+#define NOT_HASHED      (-1)
 
 typedef struct Hash_Table { /* uniform spatial subdivision, with hash */
     int npoints;          /* number of points placed in table */
-    Vertex** verts;       /* array of hash cells */
-    int num_entries;      /* number of array elements in verts */
+    int max_points;       /* grow the table when npoints exceeds this */
+    int* cells;           /* first vertex (by index) of each hash cell, or -1 */
+    int num_entries;      /* number of hash cells */
     float scale;          /* size of cell */
+    Cell_Table* sorted;   /* read-only copy while the table is frozen */
 } Hash_Table;
 
 /* where a segment of a triangle cuts an edge of a mesh or */
@@ -164,18 +210,40 @@ typedef struct Mesh {       /* mesh of triangles */
     Vertex** verts;       /* list of vertices */
     int nverts;           /* number of vertices */
     int max_verts;        /* maximum number of vertices in list */
+    Vector* coords;       /* vertex positions, by vertex index */
+    Vector* normals;      /* vertex normals, by vertex index */
+    int* hash_next;       /* next vertex in the same hash cell, or -1 */
+    int* hash_prev;       /* vertex before it in the cell, HASH_HEAD or NOT_HASHED */
+    float* confidence;    /* confidence about vertex positions, by vertex index */
+    float* intensity;     /* intensity at the vertices, by vertex index */
+    Color* colors;        /* color at the vertices, by vertex index */
+    int max_vert_data;    /* room in the arrays above, by vertex index */
     Edge** edges;         /* list of edges */
     int nedges;           /* number of edges */
     int max_edges;        /* maximum number of edges in list */
     EdgeLoop looplist;        /* edge loops */
     int edges_valid;      /* are the edges correct? */
     Hash_Table* table;        /* structure for nearest neighbor search */
+    struct Tri_Tree* tri_tree; /* tree of triangles for exact search (or NULL) */
+    struct Mesh_Arena* arena; /* storage for vertices, triangles and edges */
     Triangle** eat_list;      /* helper list for eating away edges */
     int eat_list_num;     /* number of tris in eat_list */
     int eat_list_max;     /* maximum number of tris in eat_list */
     struct Scan* parent_scan; /* which scan this mesh belongs to */
+    unsigned int mark_epoch;  /* marks stamped with another epoch are clear */
 } Mesh;
 
+/* Marks that are stamped with the epoch of the mesh.  Starting a new */
+/* epoch with new_mark_epoch() clears all of them at once. */
+
+#define MARK_CURRENT(mesh,obj) ((obj)->mark_epoch == (mesh)->mark_epoch)
+#define TRI_EAT_MARK(mesh,tri) (MARK_CURRENT(mesh,tri) ? (tri)->eat_mark : 0)
+#define SET_TRI_EAT_MARK(mesh,tri,m) \
+    ((tri)->eat_mark = (m), (tri)->mark_epoch = (mesh)->mark_epoch)
+#define VERT_COUNT_MARK(mesh,vert) (MARK_CURRENT(mesh,vert) ? (vert)->count : 0)
+#define SET_VERT_COUNT_MARK(mesh,vert,m) \
+    ((vert)->count = (m), (vert)->mark_epoch = (mesh)->mark_epoch)
+
 #define MAX_MESH_LEVELS 4
 typedef struct Scan {       /* information about one depth scan */
     char name[80];        /* name of scan */
@@ -0,0 +1,80 @@
+/*
+ * Globals that the zipper library expects the application to provide, set
+ * up the same way as in the zipper application.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdio.h>
+#include <stdlib.h>
+
+// Internal
+#include "Zipper/zipper.h"
+
+// Globals
+#define SCAN_MAX 200
+Scan* scans[SCAN_MAX];
+int nscans = 0;
+float ZIPPER_RESOLUTION = 0.0005; /* The "scale" of the system; formally SPACING. */
+int mesh_level = 3; /* mesh display level */
+
+// Parameters
+#define MAX_EDGE_LENGTH_FACTOR 4.0
+
+float get_zipper_resolution()
+{
+    return ZIPPER_RESOLUTION;
+}
+
+/******************************************************************************
+Return how many range image positions are between each vertex at a given
+mesh level.
+******************************************************************************/
+int level_to_inc(int level)
+{
+    switch (level) {
+        case 0:
+            return (1);
+        case 1:
+            return (2);
+        case 2:
+            return (4);
+        case 3:
+            return (8);
+        default:
+            fprintf(stderr, "level_to_inc: bad switch %d\n", level);
+            exit(-1);
+    }
+}
+
+/******************************************************************************
+Return maximum length allowed for a triangle of a given level.
+******************************************************************************/
+float edge_length_max(int level)
+{
+    return (ZIPPER_RESOLUTION * MAX_EDGE_LENGTH_FACTOR * level_to_inc(level));
+}
@@ -0,0 +1,231 @@
+/*
+ * Round trip of meshes through the half-edge form that the PLY reader and
+ * writer go through.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdlib.h>
+#include <math.h>
+#include <gtest/gtest.h>
+
+// Internal
+#include "Zipper/zipper.h"
+#include "Zipper/halfmesh.h"
+#include "Zipper/mesh.h"
+
+// a 3 by 3 grid of vertices in the XY plane, made of eight triangles that
+// all wind the same way
+static float grid_coords[9 * 3] = {
+    0, 0, 0,  1, 0, 0,  2, 0, 0,
+    0, 1, 0,  1, 1, 0,  2, 1, 0,
+    0, 2, 0,  1, 2, 0,  2, 2, 0,
+};
+
+static int grid_tris[8 * 3] = {
+    0, 1, 4,  0, 4, 3,
+    1, 2, 5,  1, 5, 4,
+    3, 4, 7,  3, 7, 6,
+    4, 5, 8,  4, 8, 7,
+};
+
+/******************************************************************************
+Make an empty mesh, set up the way the file readers do.
+******************************************************************************/
+static Mesh* new_empty_mesh(int nverts, int ntris)
+{
+    Mesh* mesh;
+
+    mesh = (Mesh*) calloc(1, sizeof(Mesh));
+    init_mesh_arena(mesh);
+
+    mesh->max_verts = nverts + 100;
+    mesh->verts = (Vertex**) malloc(sizeof(Vertex*) * mesh->max_verts);
+    mesh->max_tris = ntris + 100;
+    mesh->tris = (Triangle**) malloc(sizeof(Triangle*) * mesh->max_tris);
+    mesh->max_edges = 200;
+    mesh->edges = (Edge**) malloc(sizeof(Edge*) * mesh->max_edges);
+    mesh->eat_list_max = 200;
+
+    return (mesh);
+}
+
+/******************************************************************************
+Free a mesh made by new_empty_mesh().
+******************************************************************************/
+static void free_empty_mesh(Mesh* mesh)
+{
+    int i;
+
+    for (i = 0; i < mesh->nverts; i++)
+        free_vertex_lists(mesh, mesh->verts[i]);
+    for (i = 0; i < mesh->ntris; i++)
+        free(mesh->tris[i]->more);
+    free_mesh_arena(mesh);
+    free(mesh->verts);
+    free(mesh->tris);
+    free(mesh->edges);
+    free(mesh);
+}
+
+/******************************************************************************
+Check that two half-edge meshes have the same vertices and half-edges.
+******************************************************************************/
+static void expect_same_half_mesh(Half_Mesh* a, Half_Mesh* b)
+{
+    int i;
+
+    ASSERT_EQ(a->nverts, b->nverts);
+    ASSERT_EQ(a->ntris, b->ntris);
+    ASSERT_EQ(a->nhalf, b->nhalf);
+
+    for (i = 0; i < 3 * a->nverts; i++)
+        EXPECT_EQ(a->coords[i], b->coords[i]);
+    for (i = 0; i < a->nverts; i++)
+        EXPECT_EQ(a->vert_half[i], b->vert_half[i]);
+    for (i = 0; i < a->nhalf; i++) {
+        EXPECT_EQ(a->half_vert[i], b->half_vert[i]);
+        EXPECT_EQ(a->half_twin[i], b->half_twin[i]);
+        EXPECT_EQ(a->half_next[i], b->half_next[i]);
+    }
+}
+
+TEST(HalfMesh, BuildsTwinsAndBoundaryLoop)
+{
+    int h, g;
+    int steps;
+    Half_Mesh* hm;
+
+    hm = build_half_mesh(9, grid_coords, 8, grid_tris);
+
+    /* 24 triangle half-edges, and 8 around the outside of the grid */
+    ASSERT_EQ(hm->nhalf, 32);
+
+    for (h = 0; h < hm->nhalf; h++) {
+        EXPECT_EQ(hm->half_twin[hm->half_twin[h]], h);
+        EXPECT_EQ(hm->half_vert[hm->half_twin[h]], HALF_END(hm, h));
+    }
+
+    /* the boundary half-edges make one loop */
+    g = 3 * hm->ntris;
+    steps = 0;
+    h = g;
+    do {
+        EXPECT_TRUE(HALF_BOUNDARY(hm, h));
+        h = hm->half_next[h];
+        steps++;
+    } while (h != g && steps <= hm->nhalf);
+    EXPECT_EQ(steps, 8);
+
+    /* only the center vertex is away from the boundary */
+    for (h = 0; h < hm->nverts; h++)
+        EXPECT_EQ(HALF_BOUNDARY(hm, hm->vert_half[h]), h != 4);
+
+    free_half_mesh(hm);
+}
+
+TEST(HalfMesh, RoundTripsThroughMesh)
+{
+    int i, j;
+    Half_Mesh* hm;
+    Half_Mesh* hm2;
+    Mesh* mesh;
+    Mesh* mesh2;
+
+    /* arrays to half-edges to mesh to half-edges */
+    hm = build_half_mesh(9, grid_coords, 8, grid_tris);
+    mesh = new_empty_mesh(hm->nverts, hm->ntris);
+    half_mesh_to_mesh(hm, mesh, 100.0);
+
+    ASSERT_EQ(mesh->nverts, 9);
+    ASSERT_EQ(mesh->ntris, 8);
+    for (i = 0; i < mesh->ntris; i++)
+        for (j = 0; j < 3; j++)
+            EXPECT_EQ(mesh->tris[i]->verts[j]->index, grid_tris[3 * i + j]);
+
+    hm2 = mesh_to_half_mesh(mesh);
+    expect_same_half_mesh(hm, hm2);
+
+    /* the mesh found its normals and boundary while being built */
+    for (i = 0; i < mesh->nverts; i++) {
+        EXPECT_FLOAT_EQ(fabsf(hm2->normals[3 * i + 2]), 1.0f);
+        EXPECT_EQ(hm2->normals[3 * i + 2], hm2->normals[2]);
+        EXPECT_EQ(hm2->on_edge[i], i != 4);
+    }
+
+    /* vertex attributes come back through a second mesh */
+    for (i = 0; i < mesh->nverts; i++) {
+        mesh->confidence[i] = 0.1f * i;
+        mesh->intensity[i] = 0.2f * i;
+        mesh->colors[i][0] = 10 * i;
+        mesh->colors[i][1] = 20 * i;
+        mesh->colors[i][2] = 30 * i;
+    }
+    free_half_mesh(hm2);
+    hm2 = mesh_to_half_mesh(mesh);
+    mesh2 = new_empty_mesh(hm2->nverts, hm2->ntris);
+    half_mesh_to_mesh(hm2, mesh2, 100.0);
+
+    ASSERT_EQ(mesh2->nverts, mesh->nverts);
+    ASSERT_EQ(mesh2->ntris, mesh->ntris);
+    for (i = 0; i < mesh->nverts; i++) {
+        for (j = 0; j < 3; j++) {
+            EXPECT_EQ(mesh2->verts[i]->coord[j], mesh->verts[i]->coord[j]);
+            EXPECT_EQ(mesh2->verts[i]->normal[j], mesh->verts[i]->normal[j]);
+        }
+        EXPECT_EQ(mesh2->confidence[i], mesh->confidence[i]);
+        EXPECT_EQ(mesh2->intensity[i], mesh->intensity[i]);
+        for (j = 0; j < 3; j++)
+            EXPECT_EQ(mesh2->colors[i][j], mesh->colors[i][j]);
+        EXPECT_EQ(mesh2->verts[i]->on_edge, mesh->verts[i]->on_edge);
+    }
+    for (i = 0; i < mesh->ntris; i++)
+        for (j = 0; j < 3; j++)
+            EXPECT_EQ(mesh2->tris[i]->verts[j]->index, mesh->tris[i]->verts[j]->index);
+
+    free_half_mesh(hm);
+    free_half_mesh(hm2);
+    free_empty_mesh(mesh);
+    free_empty_mesh(mesh2);
+}
+
+TEST(HalfMesh, LeavesOutLongTriangles)
+{
+    Half_Mesh* hm;
+    Mesh* mesh;
+
+    /* every grid triangle has an edge longer than 1.2 */
+    hm = build_half_mesh(9, grid_coords, 8, grid_tris);
+    mesh = new_empty_mesh(hm->nverts, hm->ntris);
+    half_mesh_to_mesh(hm, mesh, 1.2);
+
+    EXPECT_EQ(mesh->nverts, 9);
+    EXPECT_EQ(mesh->ntris, 0);
+
+    free_half_mesh(hm);
+    free_empty_mesh(mesh);
+}
@@ -0,0 +1,291 @@
+/*
+ * Building meshes: a mesh built all at once from arrays has to be the same
+ * as one built a vertex and a triangle at a time.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdlib.h>
+#include <math.h>
+#include <gtest/gtest.h>
+
+// Internal
+#include "Zipper/zipper.h"
+#include "Zipper/mesh.h"
+
+// vertices per side of the grid part of the test mesh
+#define GRID_N 8
+
+// number of triangles around the vertex in the middle of the fan
+#define FAN_N 10
+
+// longest edge a triangle of the test mesh may have
+#define MAX_LEN 1.5f
+
+/******************************************************************************
+Make an empty mesh, set up the way the file readers do.
+******************************************************************************/
+static Mesh* new_empty_mesh(int nverts, int ntris)
+{
+    Mesh* mesh;
+
+    mesh = (Mesh*) calloc(1, sizeof(Mesh));
+    init_mesh_arena(mesh);
+
+    mesh->max_verts = nverts + 100;
+    mesh->verts = (Vertex**) malloc(sizeof(Vertex*) * mesh->max_verts);
+    mesh->max_tris = ntris + 100;
+    mesh->tris = (Triangle**) malloc(sizeof(Triangle*) * mesh->max_tris);
+    mesh->max_edges = 200;
+    mesh->edges = (Edge**) malloc(sizeof(Edge*) * mesh->max_edges);
+    mesh->eat_list_max = 200;
+
+    return (mesh);
+}
+
+/******************************************************************************
+Free a mesh made by new_empty_mesh().
+******************************************************************************/
+static void free_empty_mesh(Mesh* mesh)
+{
+    int i;
+
+    for (i = 0; i < mesh->nverts; i++)
+        free_vertex_lists(mesh, mesh->verts[i]);
+    for (i = 0; i < mesh->ntris; i++)
+        free(mesh->tris[i]->more);
+    free_mesh_arena(mesh);
+    free(mesh->verts);
+    free(mesh->tris);
+    free(mesh->edges);
+    free(mesh);
+}
+
+/******************************************************************************
+Make the positions and triangles of the test mesh: a bumpy grid with a hole
+in it, a fan whose middle vertex has more neighbors than fit inside a
+vertex, a triangle with an edge that is too long, a triangle with no area,
+and a vertex that no triangle uses.
+
+Exit:
+  coords    - vertex positions (3 per vertex), to be freed by the caller
+  tri_verts - vertices of each triangle (3 per triangle), the same
+  returns the number of triangles, and sets *nverts to the number of vertices
+******************************************************************************/
+static int make_test_arrays(float** coords, int** tri_verts, int* nverts)
+{
+    int i, j, k, n;
+    int a;
+    int fan;
+    float* c;
+    int* t;
+
+    *nverts = GRID_N * GRID_N + FAN_N + 1 + 5;
+    c = (float*) malloc(sizeof(float) * 3 * *nverts);
+    t = (int*) malloc(sizeof(int) * 3 * (2 * GRID_N * GRID_N + FAN_N + 2));
+
+    /* the grid */
+    for (i = 0; i < GRID_N; i++)
+        for (j = 0; j < GRID_N; j++) {
+            k = i * GRID_N + j;
+            c[3 * k] = i;
+            c[3 * k + 1] = j;
+            c[3 * k + 2] = 0.1f * ((i * 7 + j * 3) % 5);
+        }
+
+    n = 0;
+    for (i = 0; i < GRID_N - 1; i++)
+        for (j = 0; j < GRID_N - 1; j++) {
+            /* leave a hole */
+            if (i == 3 && j == 4)
+                continue;
+            a = i * GRID_N + j;
+            t[n++] = a;
+            t[n++] = a + GRID_N;
+            t[n++] = a + GRID_N + 1;
+            t[n++] = a;
+            t[n++] = a + GRID_N + 1;
+            t[n++] = a + 1;
+        }
+
+    /* the fan, off to the side of the grid */
+    fan = GRID_N * GRID_N;
+    c[3 * fan] = GRID_N + 2;
+    c[3 * fan + 1] = 2;
+    c[3 * fan + 2] = 0;
+    for (i = 0; i < FAN_N; i++) {
+        k = fan + 1 + i;
+        c[3 * k] = c[3 * fan] + cos(2 * M_PI * i / FAN_N);
+        c[3 * k + 1] = c[3 * fan + 1] + sin(2 * M_PI * i / FAN_N);
+        c[3 * k + 2] = 0.05f * (i % 3);
+    }
+    for (i = 0; i < FAN_N; i++) {
+        t[n++] = fan;
+        t[n++] = fan + 1 + i;
+        t[n++] = fan + 1 + (i + 1) % FAN_N;
+    }
+
+    /* an edge too long, no area, and a vertex not used */
+    k = fan + FAN_N + 1;
+    for (i = 0; i < 5; i++) {
+        c[3 * (k + i)] = -3 - 0.5f * i;
+        c[3 * (k + i) + 1] = (i == 1) ? 5 : 0;
+        c[3 * (k + i) + 2] = 0;
+    }
+    t[n++] = k;
+    t[n++] = k + 1;
+    t[n++] = k + 2;
+    t[n++] = k;
+    t[n++] = k + 2;
+    t[n++] = k + 3;
+
+    *coords = c;
+    *tri_verts = t;
+    return (n / 3);
+}
+
+TEST(BuildMesh, FromArraysMatchesOneAtATime)
+{
+    int i, j;
+    int nverts, ntris;
+    float* coords;
+    int* tri_verts;
+    int* tv;
+    Mesh* m1;
+    Mesh* m2;
+    Vertex* v1;
+    Vertex* v2;
+    Triangle* t1;
+    Triangle* t2;
+
+    ntris = make_test_arrays(&coords, &tri_verts, &nverts);
+
+    /* one vertex and one triangle at a time, the way the readers did */
+    m1 = new_empty_mesh(nverts, ntris);
+    for (i = 0; i < nverts; i++)
+        make_vertex(m1, &coords[3 * i]);
+    for (i = 0; i < ntris; i++) {
+        tv = &tri_verts[3 * i];
+        make_triangle(m1, m1->verts[tv[0]], m1->verts[tv[1]], m1->verts[tv[2]],
+                      MAX_LEN);
+    }
+    find_vertex_normals(m1);
+    find_mesh_edges(m1);
+
+    /* all at once */
+    m2 = new_empty_mesh(nverts, ntris);
+    build_mesh_from_arrays(m2, nverts, coords, ntris, tri_verts, MAX_LEN);
+
+    /* the long and the flat triangles are left out */
+    ASSERT_EQ(m1->nverts, nverts);
+    ASSERT_EQ(m2->nverts, nverts);
+    ASSERT_EQ(m1->ntris, ntris - 2);
+    ASSERT_EQ(m2->ntris, m1->ntris);
+
+    for (i = 0; i < m1->ntris; i++) {
+        t1 = m1->tris[i];
+        t2 = m2->tris[i];
+        EXPECT_EQ(t2->index, i);
+        for (j = 0; j < 3; j++)
+            EXPECT_EQ(t2->verts[j]->index, t1->verts[j]->index) << "triangle " << i;
+        EXPECT_FLOAT_EQ(t2->aa, t1->aa) << "triangle " << i;
+        EXPECT_FLOAT_EQ(t2->bb, t1->bb) << "triangle " << i;
+        EXPECT_FLOAT_EQ(t2->cc, t1->cc) << "triangle " << i;
+        EXPECT_FLOAT_EQ(t2->dd, t1->dd) << "triangle " << i;
+    }
+
+    for (i = 0; i < nverts; i++) {
+        v1 = m1->verts[i];
+        v2 = m2->verts[i];
+        EXPECT_EQ(v2->index, i);
+
+        for (j = 0; j < 3; j++) {
+            EXPECT_EQ(v2->coord[j], v1->coord[j]) << "vertex " << i;
+            EXPECT_FLOAT_EQ(v2->normal[j], v1->normal[j]) << "vertex " << i;
+        }
+        EXPECT_EQ(v2->on_edge, v1->on_edge) << "vertex " << i;
+
+        /* the same lists, in the same order */
+        ASSERT_EQ(v2->ntris, v1->ntris) << "vertex " << i;
+        for (j = 0; j < v1->ntris; j++)
+            EXPECT_EQ(v2->tris[j]->index, v1->tris[j]->index) << "vertex " << i;
+        ASSERT_EQ(v2->nverts, v1->nverts) << "vertex " << i;
+        for (j = 0; j < v1->nverts; j++)
+            EXPECT_EQ(v2->verts[j]->index, v1->verts[j]->index) << "vertex " << i;
+    }
+
+    /* the middle of the fan outgrew the room inside the vertex */
+    EXPECT_EQ(m2->verts[GRID_N * GRID_N]->ntris, FAN_N);
+    EXPECT_GT(m2->verts[GRID_N * GRID_N]->ntris, VERT_INLINE_TRIS);
+
+    /* and the unused vertex has nothing */
+    EXPECT_EQ(m2->verts[nverts - 1]->ntris, 0);
+    EXPECT_EQ(m2->verts[nverts - 1]->nverts, 0);
+
+    free_empty_mesh(m1);
+    free_empty_mesh(m2);
+    free(coords);
+    free(tri_verts);
+}
+
+TEST(MarkEpoch, WrapClearsOldMarks)
+{
+    int i;
+    int nverts, ntris;
+    float* coords;
+    int* tri_verts;
+    Mesh* mesh;
+    Triangle* tri;
+    Vertex* vert;
+
+    ntris = make_test_arrays(&coords, &tri_verts, &nverts);
+    mesh = new_empty_mesh(nverts, ntris);
+    build_mesh_from_arrays(mesh, nverts, coords, ntris, tri_verts, MAX_LEN);
+
+    /* stamp marks in the last epoch before the counter wraps */
+    mesh->mark_epoch = 0xffffffffu;
+    tri = mesh->tris[0];
+    vert = mesh->verts[0];
+    SET_TRI_EAT_MARK(mesh, tri, 1);
+    SET_VERT_COUNT_MARK(mesh, vert, 2);
+    EXPECT_EQ(TRI_EAT_MARK(mesh, tri), 1);
+    EXPECT_EQ(VERT_COUNT_MARK(mesh, vert), 2);
+
+    /* a mark left from an epoch long ago must not come back either */
+    mesh->verts[1]->count = 3;
+    mesh->verts[1]->mark_epoch = 1;
+
+    EXPECT_EQ(new_mark_epoch(mesh), 1u);
+    for (i = 0; i < mesh->ntris; i++)
+        EXPECT_EQ(TRI_EAT_MARK(mesh, mesh->tris[i]), 0) << "triangle " << i;
+    for (i = 0; i < mesh->nverts; i++)
+        EXPECT_EQ(VERT_COUNT_MARK(mesh, mesh->verts[i]), 0) << "vertex " << i;
+
+    free_empty_mesh(mesh);
+    free(coords);
+    free(tri_verts);
+}
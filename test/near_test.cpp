@@ -0,0 +1,444 @@
+/*
+ * Nearest point searches: the batch search has to give the same answers as
+ * searching for one position at a time, and the vector loops over the points
+ * of a hash cell the same answers as the plain loop.
+ *
+ * Copyright (c) 1995-2017, Stanford University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Stanford University nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY STANFORD UNIVERSITY ''AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL STANFORD UNIVERSITY BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// External
+#include <stdlib.h>
+#include <gtest/gtest.h>
+
+// Internal
+#include "Zipper/zipper.h"
+#include "Zipper/mesh.h"
+#include "Zipper/near.h"
+
+// vertices per side of the test grid, and the distance between them
+#define GRID_N       12
+#define GRID_SPACING 1.0f
+
+/******************************************************************************
+Make a scan whose mesh coordinates are its world coordinates.
+******************************************************************************/
+static Scan* new_identity_scan()
+{
+    int i;
+    Scan* sc;
+
+    sc = (Scan*) calloc(1, sizeof(Scan));
+    for (i = 0; i < 4; i++)
+        sc->rotmat[i][i] = 1;
+
+    return (sc);
+}
+
+/******************************************************************************
+Make a bumpy grid mesh of GRID_N by GRID_N vertices, with its hash table.
+******************************************************************************/
+static Mesh* new_grid_mesh()
+{
+    int i, j, k;
+    int a;
+    int nverts = GRID_N * GRID_N;
+    int ntris = 2 * (GRID_N - 1) * (GRID_N - 1);
+    float* coords;
+    int* tri_verts;
+    Mesh* mesh;
+
+    coords = (float*) malloc(sizeof(float) * 3 * nverts);
+    tri_verts = (int*) malloc(sizeof(int) * 3 * ntris);
+
+    for (i = 0; i < GRID_N; i++)
+        for (j = 0; j < GRID_N; j++) {
+            k = i * GRID_N + j;
+            coords[3 * k] = i * GRID_SPACING;
+            coords[3 * k + 1] = j * GRID_SPACING;
+            coords[3 * k + 2] = 0.3f * GRID_SPACING * ((i * 7 + j * 3) % 5) / 4;
+        }
+
+    k = 0;
+    for (i = 0; i < GRID_N - 1; i++)
+        for (j = 0; j < GRID_N - 1; j++) {
+            a = i * GRID_N + j;
+            tri_verts[k++] = a;
+            tri_verts[k++] = a + GRID_N;
+            tri_verts[k++] = a + GRID_N + 1;
+            tri_verts[k++] = a;
+            tri_verts[k++] = a + GRID_N + 1;
+            tri_verts[k++] = a + 1;
+        }
+
+    mesh = (Mesh*) calloc(1, sizeof(Mesh));
+    init_mesh_arena(mesh);
+
+    mesh->max_verts = nverts + 100;
+    mesh->verts = (Vertex**) malloc(sizeof(Vertex*) * mesh->max_verts);
+    mesh->max_tris = ntris + 100;
+    mesh->tris = (Triangle**) malloc(sizeof(Triangle*) * mesh->max_tris);
+    mesh->max_edges = 200;
+    mesh->edges = (Edge**) malloc(sizeof(Edge*) * mesh->max_edges);
+    mesh->eat_list_max = 200;
+
+    build_mesh_from_arrays(mesh, nverts, coords, ntris, tri_verts, 100.0);
+    init_table(mesh, 2.0f * GRID_SPACING);
+
+    for (i = 0; i < nverts; i++)
+        mesh->confidence[i] = 0.1f * (i % 9);
+
+    free(coords);
+    free(tri_verts);
+
+    return (mesh);
+}
+
+/******************************************************************************
+Free a mesh made by new_grid_mesh().
+******************************************************************************/
+static void free_grid_mesh(Mesh* mesh)
+{
+    clear_mesh(mesh);
+    free(mesh->table);
+    free_mesh_arena(mesh);
+    free(mesh);
+}
+
+/******************************************************************************
+Search for the nearest point on a mesh for positions all over (and past) the
+grid, both in one batch and one position at a time, and check that the
+answers are the same.
+******************************************************************************/
+static void expect_batch_matches_single(
+    Scan* sc, Mesh* mesh, Mesh* not_mesh, float max, float min_dot
+) {
+    int i, j, k;
+    int side = 4 * GRID_N;
+    int num = side * side;
+    int nfound = 0;
+    int single;
+    Vector* pos;
+    Vector* norm;
+    NearPosition* near_list;
+    NearPosition near_info;
+    int* found;
+
+    pos = (Vector*) malloc(sizeof(Vector) * num);
+    norm = (Vector*) malloc(sizeof(Vector) * num);
+    near_list = (NearPosition*) malloc(sizeof(NearPosition) * num);
+    found = (int*) malloc(sizeof(int) * num);
+
+    /* positions a little over a quarter of the spacing apart, starting */
+    /* off the grid, some above and some below it, with normals facing */
+    /* the way the grid's do, the other way, or partway between */
+    for (i = 0; i < side; i++)
+        for (j = 0; j < side; j++) {
+            k = i * side + j;
+            pos[k][X] = (-1.0f + 0.27f * i) * GRID_SPACING;
+            pos[k][Y] = (-1.0f + 0.27f * j) * GRID_SPACING;
+            pos[k][Z] = (0.2f * ((i + 2 * j) % 3) - 0.2f) * GRID_SPACING;
+            switch ((i + j) % 4) {
+                case 0:
+                    vset(norm[k], 0.0, 0.0, 1.0);
+                    break;
+                case 1:
+                    vset(norm[k], 0.0, 0.0, -1.0);
+                    break;
+                case 2:
+                    vset(norm[k], 0.6, 0.0, -0.8);
+                    break;
+                default:
+                    vset(norm[k], 0.0, 0.8, -0.6);
+                    break;
+            }
+        }
+
+    nearest_on_mesh_batch(sc, mesh, not_mesh, num, pos, norm, max, min_dot,
+                          near_list, found);
+
+    for (k = 0; k < num; k++) {
+        single = nearest_on_mesh(sc, mesh, not_mesh, pos[k], norm[k], max, min_dot,
+                                 &near_info);
+        ASSERT_EQ(found[k], single) << "position " << k;
+        if (!single)
+            continue;
+        nfound++;
+
+        EXPECT_EQ(near_list[k].type, near_info.type) << "position " << k;
+        EXPECT_EQ(near_list[k].v1, near_info.v1) << "position " << k;
+        EXPECT_EQ(near_list[k].on_edge, near_info.on_edge) << "position " << k;
+        EXPECT_EQ(near_list[k].dist, near_info.dist) << "position " << k;
+        EXPECT_EQ(near_list[k].confidence, near_info.confidence) << "position " << k;
+        for (j = 0; j < 3; j++)
+            EXPECT_EQ(near_list[k].pos[j], near_info.pos[j]) << "position " << k;
+        if (near_info.type == NEAR_EDGE)
+            EXPECT_EQ(near_list[k].v2, near_info.v2) << "position " << k;
+        if (near_info.type == NEAR_TRIANGLE)
+            EXPECT_EQ(near_list[k].tri, near_info.tri) << "position " << k;
+    }
+
+    /* the positions must not all have been missed */
+    EXPECT_GT(nfound, num / 4);
+    EXPECT_LT(nfound, num);
+
+    free(pos);
+    free(norm);
+    free(near_list);
+    free(found);
+}
+
+TEST(NearestOnMesh, BatchMatchesSingle)
+{
+    Scan* sc = new_identity_scan();
+    Mesh* mesh = new_grid_mesh();
+
+    expect_batch_matches_single(sc, mesh, NULL, GRID_SPACING, -1.0);
+    expect_batch_matches_single(sc, mesh, NULL, 0.4f * GRID_SPACING, -1.0);
+
+    /* both searches go through the frozen table too */
+    freeze_table(mesh);
+    expect_batch_matches_single(sc, mesh, NULL, GRID_SPACING, -1.0);
+    thaw_table(mesh);
+
+    free_grid_mesh(mesh);
+    free(sc);
+}
+
+TEST(NearestOnMesh, BatchMatchesSingleWithNormalFilter)
+{
+    Scan* sc = new_identity_scan();
+    Mesh* mesh = new_grid_mesh();
+
+    expect_batch_matches_single(sc, mesh, NULL, GRID_SPACING, 0.5);
+    expect_batch_matches_single(sc, mesh, NULL, GRID_SPACING, 0.7f);
+
+    freeze_table(mesh);
+    expect_batch_matches_single(sc, mesh, NULL, GRID_SPACING, 0.5);
+    thaw_table(mesh);
+
+    free_grid_mesh(mesh);
+    free(sc);
+}
+
+TEST(NearestOnMesh, BatchMatchesSingleWithoutOtherMesh)
+{
+    int i;
+    Scan* sc = new_identity_scan();
+    Mesh* mesh = new_grid_mesh();
+    Mesh* other = (Mesh*) calloc(1, sizeof(Mesh));
+
+    /* every third vertex came from the other mesh, and is passed over */
+    for (i = 0; i < mesh->nverts; i += 3)
+        mesh->verts[i]->old_mesh = other;
+
+    expect_batch_matches_single(sc, mesh, other, GRID_SPACING, -1.0);
+    expect_batch_matches_single(sc, mesh, other, GRID_SPACING, 0.5);
+
+    freeze_table(mesh);
+    expect_batch_matches_single(sc, mesh, other, GRID_SPACING, 0.5);
+    thaw_table(mesh);
+
+    free_grid_mesh(mesh);
+    free(other);
+    free(sc);
+}
+
+// points for the run tests, with room for a run of the longest length to
+// start past the beginning of the arrays
+#define RUN_MAX 32
+
+/******************************************************************************
+Fill the arrays of a run of points.  Positions are whole numbers on a small
+lattice, so many points lie at exactly the same distance from the position
+being searched for, and some points are copies of earlier ones.
+******************************************************************************/
+static void fill_run(float** coords, float** normals, Mesh** old_mesh, Mesh* other,
+                     int seed)
+{
+    int i, j;
+    unsigned int r = seed * 2654435761u + 1;
+
+    for (i = 0; i < RUN_MAX; i++) {
+        r = r * 1103515245u + 12345u;
+        if (i >= 3 && (r >> 16) % 4 == 0) {
+            /* a copy of an earlier point */
+            j = (r >> 8) % i;
+            coords[X][i] = coords[X][j];
+            coords[Y][i] = coords[Y][j];
+            coords[Z][i] = coords[Z][j];
+        } else {
+            coords[X][i] = (float) ((r >> 4) % 5) - 2;
+            coords[Y][i] = (float) ((r >> 9) % 5) - 2;
+            coords[Z][i] = (float) ((r >> 14) % 3) - 1;
+        }
+        switch ((r >> 20) % 3) {
+            case 0:
+                normals[X][i] = 0;
+                normals[Y][i] = 0;
+                normals[Z][i] = 1;
+                break;
+            case 1:
+                normals[X][i] = 0;
+                normals[Y][i] = 0;
+                normals[Z][i] = -1;
+                break;
+            default:
+                normals[X][i] = 0.6f;
+                normals[Y][i] = 0;
+                normals[Z][i] = 0.8f;
+                break;
+        }
+        old_mesh[i] = ((r >> 24) % 4 == 0) ? other : NULL;
+    }
+}
+
+/******************************************************************************
+Check that nearest_in_run() picks the same point, at the same distance, as
+the plain loop of nearest_in_run_scalar().  In a build without AVX2 or
+SSE4.1 the two are the same code, and this passes trivially; configure with
+ENABLE_AVX2 or ENABLE_SSE4 to test the vector loops.
+******************************************************************************/
+static void expect_run_matches_scalar(
+    float** coords, float** normals, Mesh** old_mesh, int first, int last,
+    Mesh* not_mesh, Vector pnt, Vector norm, float min_dot, float start_dist
+) {
+    int k, k_scalar;
+    float dist = start_dist;
+    float dist_scalar = start_dist;
+
+    k = nearest_in_run(coords, normals, old_mesh, first, last, not_mesh, pnt, norm,
+                       min_dot, &dist);
+    k_scalar = nearest_in_run_scalar(coords, normals, old_mesh, first, last, not_mesh,
+                                     pnt, norm, min_dot, &dist_scalar);
+
+    EXPECT_EQ(k, k_scalar) << "run " << first << " to " << last;
+    EXPECT_EQ(dist, dist_scalar) << "run " << first << " to " << last;
+}
+
+TEST(NearestInRun, VectorMatchesScalar)
+{
+    static const int lengths[] = {0, 1, 7, 8, 9, 17};
+    static const int firsts[] = {0, 1, 3, 8};
+    int i, j, f, l;
+    int seed;
+    float x[RUN_MAX], y[RUN_MAX], z[RUN_MAX];
+    float nx[RUN_MAX], ny[RUN_MAX], nz[RUN_MAX];
+    float* coords[3] = {x, y, z};
+    float* normals[3] = {nx, ny, nz};
+    Mesh* old_mesh[RUN_MAX];
+    Mesh* other = (Mesh*) calloc(1, sizeof(Mesh));
+    Vector pnt;
+    Vector up = {0, 0, 1};
+    Vector tilted = {0.6f, 0, 0.8f};
+
+    for (seed = 0; seed < 40; seed++) {
+        fill_run(coords, normals, old_mesh, other, seed);
+
+        /* lattice points, so that several points tie for nearest */
+        pnt[X] = (float) (seed % 3) - 1;
+        pnt[Y] = (float) (seed % 5) - 2;
+        pnt[Z] = (seed % 2) ? 0.5f : 0;
+
+        for (f = 0; f < 4; f++)
+            for (l = 0; l < 6; l++) {
+                i = firsts[f];
+                j = i + lengths[l];
+
+                /* no filters */
+                expect_run_matches_scalar(coords, normals, NULL, i, j, NULL, pnt, up,
+                                          -2.0, 1e20);
+
+                /* normal filter */
+                expect_run_matches_scalar(coords, normals, NULL, i, j, NULL, pnt, up,
+                                          0.5, 1e20);
+                expect_run_matches_scalar(coords, normals, NULL, i, j, NULL, pnt, tilted,
+                                          0.9f, 1e20);
+
+                /* points of another mesh passed over */
+                expect_run_matches_scalar(coords, normals, old_mesh, i, j, other, pnt, up,
+                                          -2.0, 1e20);
+                expect_run_matches_scalar(coords, normals, old_mesh, i, j, other, pnt,
+                                          tilted, 0.5, 1e20);
+
+                /* a distance to beat that only some points do, and one */
+                /* that the nearest points only tie */
+                expect_run_matches_scalar(coords, normals, old_mesh, i, j, other, pnt, up,
+                                          -2.0, 2.0);
+                expect_run_matches_scalar(coords, normals, NULL, i, j, NULL, pnt, up,
+                                          -2.0, 1.0);
+            }
+    }
+
+    free(other);
+}
+
+TEST(NearestInRun, EarliestOfTiedPointsWins)
+{
+    static const int lengths[] = {1, 7, 8, 9, 17};
+    int i, l;
+    int k;
+    float dist;
+    float x[RUN_MAX], y[RUN_MAX], z[RUN_MAX];
+    float nx[RUN_MAX], ny[RUN_MAX], nz[RUN_MAX];
+    float* coords[3] = {x, y, z};
+    float* normals[3] = {nx, ny, nz};
+    Vector pnt = {0, 0, 0};
+    Vector up = {0, 0, 1};
+
+    /* every point the same distance away, in different directions */
+    for (i = 0; i < RUN_MAX; i++) {
+        x[i] = (i % 2) ? 1.0f : -1.0f;
+        y[i] = (i % 4 < 2) ? 2.0f : -2.0f;
+        z[i] = 0;
+        nx[i] = 0;
+        ny[i] = 0;
+        nz[i] = 1;
+    }
+
+    for (l = 0; l < 5; l++) {
+        dist = 1e20;
+        k = nearest_in_run(coords, normals, NULL, 2, 2 + lengths[l], NULL, pnt, up, 0.5,
+                           &dist);
+        EXPECT_EQ(k, 2) << "length " << lengths[l];
+        EXPECT_EQ(dist, 5.0f) << "length " << lengths[l];
+    }
+
+    /* with the first few facing away, the first one facing the same way wins */
+    for (i = 0; i < 12; i++)
+        nz[i] = -1;
+    for (l = 0; l < 5; l++) {
+        dist = 1e20;
+        k = nearest_in_run(coords, normals, NULL, 2, 2 + lengths[l], NULL, pnt, up, 0.5,
+                           &dist);
+        if (2 + lengths[l] <= 12) {
+            EXPECT_EQ(k, -1) << "length " << lengths[l];
+            EXPECT_EQ(dist, 1e20f) << "length " << lengths[l];
+        } else {
+            EXPECT_EQ(k, 12) << "length " << lengths[l];
+            EXPECT_EQ(dist, 5.0f) << "length " << lengths[l];
+        }
+    }
+}